@@ -0,0 +1,559 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "include/nn_from_scratch.h"
+#include "util/kernels.h"
+/*
+    Benchmarks of the C engine on synthetic models, independent of the generated model and data.
+    Weights and samples come from a fixed seed, so runs only differ in timing.
+    Results are printed as a table and written as JSON, see write_results.
+
+    usage: bench [--output path] [--min-time seconds] [--shape name]
+*/
+
+#define BENCH_MAX_LAYERS 8
+#define BENCH_MAX_ITERATIONS 10000 // latencies kept per benchmark
+#define BENCH_MIN_ITERATIONS 20
+#define BENCH_WARMUP 5
+#define BENCH_BATCH_ROWS 1024 // rows per batched prediction
+#define BENCH_MAX_RESULTS 256
+#define BENCH_SEED 42u
+
+typedef struct
+{
+    const char *name;
+    int input_size;
+    int n_layers;
+    int layers_size[BENCH_MAX_LAYERS];
+} BenchShape;
+
+/* sinus and boston follow the generator settings (setting_1 and setting_2), the others are larger synthetic shapes */
+static const BenchShape shapes[] = {
+    {"sinus", 1, 3, {4, 2, 1}},
+    {"boston", 13, 4, {64, 32, 16, 1}},
+    {"wide", 128, 3, {512, 256, 10}},
+    {"deep", 32, 7, {128, 128, 128, 128, 128, 128, 1}},
+};
+#define N_SHAPES (int)(sizeof(shapes) / sizeof(shapes[0]))
+
+typedef struct
+{
+    char model[32];
+    char benchmark[48];
+    int iterations;
+    int samples; // samples per iteration
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double samples_per_sec;
+} BenchResult;
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int n_results = 0;
+static double latencies[BENCH_MAX_ITERATIONS];
+static double min_time = 0.25; // seconds spent per benchmark, after the minimum iterations
+
+static uint32_t rng_state = BENCH_SEED;
+
+/* uniform in [-1, 1), a fixed sequence for a fixed seed */
+static float bench_random()
+{
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)(rng_state >> 8) / (float)(1u << 23) - 1.0f;
+}
+
+static double now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+typedef struct
+{
+    Model *model;
+    int layers_size[BENCH_MAX_LAYERS];
+    enum ActivationType layers_activation[BENCH_MAX_LAYERS];
+} BenchModel;
+
+/* builds a flat model with random weights scaled by the fan-in, relu hidden layers and a linear output */
+static BenchModel *create_bench_model(const BenchShape *shape)
+{
+    BenchModel *bench = (BenchModel *)malloc(sizeof(BenchModel));
+    float *layers_weights[BENCH_MAX_LAYERS];
+    float *layers_biases[BENCH_MAX_LAYERS];
+    int size = shape->input_size;
+    for (int i = 0; i < shape->n_layers; i++)
+    {
+        bench->layers_size[i] = shape->layers_size[i];
+        bench->layers_activation[i] = (i == shape->n_layers - 1) ? LINEAR : RELU;
+        layers_weights[i] = (float *)malloc(size * shape->layers_size[i] * sizeof(float));
+        layers_biases[i] = (float *)malloc(shape->layers_size[i] * sizeof(float));
+        for (int j = 0; j < size * shape->layers_size[i]; j++)
+        {
+            layers_weights[i][j] = bench_random() / size;
+        }
+        for (int j = 0; j < shape->layers_size[i]; j++)
+        {
+            layers_biases[i][j] = 0.1f * bench_random();
+        }
+        size = shape->layers_size[i];
+    }
+
+    bench->model = createAndSetModel(shape->n_layers, shape->input_size, shape->layers_size[shape->n_layers - 1],
+                                     bench->layers_size, layers_weights, layers_biases, bench->layers_activation);
+    // flattening copies the parameters into memory owned by the model
+    if (flattenModel(bench->model) != 0)
+    {
+        printf("Error: could not flatten the %s model! \n", shape->name);
+        exit(1);
+    }
+    for (int i = 0; i < shape->n_layers; i++)
+    {
+        free(layers_weights[i]);
+        free(layers_biases[i]);
+    }
+    return bench;
+}
+
+static void free_bench_model(BenchModel *bench)
+{
+    freeModel(bench->model);
+    free(bench);
+}
+
+static float *random_floats(int n)
+{
+    float *values = (float *)malloc(n * sizeof(float));
+    for (int i = 0; i < n; i++)
+    {
+        values[i] = bench_random();
+    }
+    return values;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* state of one benchmark, run as: for (start_bench(...); bench_running(&run);) { start = now_ns(); work; bench_lap(&run, start); } */
+typedef struct
+{
+    const char *model;
+    const char *benchmark;
+    int samples;
+    int iterations;
+    double started;
+} BenchRun;
+
+static void start_bench(BenchRun *run, const char *model, const char *benchmark, int samples)
+{
+    run->model = model;
+    run->benchmark = benchmark;
+    run->samples = samples;
+    run->iterations = -BENCH_WARMUP;
+    run->started = 0;
+}
+
+static void finish_bench(BenchRun *run)
+{
+    // past BENCH_MAX_RESULTS the last result is overwritten
+    BenchResult *result = &results[(n_results < BENCH_MAX_RESULTS) ? n_results++ : BENCH_MAX_RESULTS - 1];
+    double sum = 0;
+    for (int i = 0; i < run->iterations; i++)
+    {
+        sum += latencies[i];
+    }
+    qsort(latencies, run->iterations, sizeof(double), compare_doubles);
+
+    snprintf(result->model, sizeof(result->model), "%s", run->model);
+    snprintf(result->benchmark, sizeof(result->benchmark), "%s", run->benchmark);
+    result->iterations = run->iterations;
+    result->samples = run->samples;
+    result->mean_ns = sum / run->iterations;
+    result->p50_ns = latencies[run->iterations / 2];
+    result->p99_ns = latencies[(int)(0.99 * (run->iterations - 1))];
+    result->samples_per_sec = run->samples * 1e9 / result->mean_ns;
+    printf("%-8s %-28s %8d %14.0f %14.0f %14.0f %14.0f\n", result->model, result->benchmark, result->iterations,
+           result->mean_ns, result->p50_ns, result->p99_ns, result->samples_per_sec);
+}
+
+/* @return 1 while more iterations are needed, records the result once done */
+static int bench_running(BenchRun *run)
+{
+    if (run->iterations == 0)
+    {
+        run->started = now_ns();
+    }
+    if (run->iterations >= BENCH_MAX_ITERATIONS ||
+        (run->iterations >= BENCH_MIN_ITERATIONS && now_ns() - run->started >= min_time * 1e9))
+    {
+        finish_bench(run);
+        return 0;
+    }
+    return 1;
+}
+
+static void bench_lap(BenchRun *run, double start)
+{
+    double elapsed = now_ns() - start;
+    if (run->iterations >= 0)
+    {
+        latencies[run->iterations] = elapsed;
+    }
+    run->iterations++;
+}
+
+static void bench_predict(const BenchShape *shape, Model *model, const float *x)
+{
+    BenchRun run;
+    double start;
+
+    // single sample through the allocating API
+    for (start_bench(&run, shape->name, "predict", 1); bench_running(&run);)
+    {
+        start = now_ns();
+        float *output = fc_model_predict(model, (float *)x);
+        bench_lap(&run, start);
+        free(output);
+    }
+
+    InferencePlan *plan = createInferencePlan(model);
+    float *output = (float *)malloc(model->output_size * sizeof(float));
+    float *outputs = (float *)malloc(BENCH_BATCH_ROWS * model->output_size * sizeof(float));
+    int scratch_size = fc_model_batch_scratch_size(model);
+    float *scratch = (float *)malloc((scratch_size > 0 ? scratch_size : 1) * sizeof(float));
+
+    // the weights as they are, then packed into panels
+    for (int packed = 0; packed < 2; packed++)
+    {
+        if (packed && packModel(model) != 0)
+        {
+            break;
+        }
+
+        // single sample through a preplanned arena, no allocation
+        for (start_bench(&run, shape->name, packed ? "predict_plan_packed" : "predict_plan", 1); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_predict_plan(plan, x, output);
+            bench_lap(&run, start);
+        }
+
+        // batched throughput
+        for (start_bench(&run, shape->name, packed ? "predict_batch_packed" : "predict_batch", BENCH_BATCH_ROWS); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_predict_batch_scratch(model, x, BENCH_BATCH_ROWS, outputs, scratch);
+            bench_lap(&run, start);
+        }
+    }
+    unpackModel(model);
+
+    // weights stored in 16 bits, expanded to float by the kernels
+    const char *half_names[N_HALF_FORMATS][2] = {{"predict_plan_bf16", "predict_batch_bf16"}, {"predict_plan_fp16", "predict_batch_fp16"}};
+    for (int format = 0; format < N_HALF_FORMATS; format++)
+    {
+        Model *half = createAndSetModel(model->n_layers, model->input_size, model->output_size, model->layers_size,
+                                        model->layers_weights, model->layers_biases, model->layers_activation);
+        if (compressModelWeights(half, (enum HalfFormat)format) != 0)
+        {
+            freeModel(half);
+            break;
+        }
+        InferencePlan *half_plan = createInferencePlan(half);
+        for (start_bench(&run, shape->name, half_names[format][0], 1); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_predict_plan(half_plan, x, output);
+            bench_lap(&run, start);
+        }
+        for (start_bench(&run, shape->name, half_names[format][1], BENCH_BATCH_ROWS); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_predict_batch_scratch(half, x, BENCH_BATCH_ROWS, outputs, scratch);
+            bench_lap(&run, start);
+        }
+        freeInferencePlan(half_plan);
+        freeModel(half);
+    }
+
+    // every layer pruned to 1 in 10 and 1 in 4 nonzero weights, stored sparse regardless of SPARSE_MAX_DENSITY
+    int densities[2] = {10, 25};
+    for (int d = 0; d < 2; d++)
+    {
+        Model *sparse = createAndSetModel(model->n_layers, model->input_size, model->output_size, model->layers_size,
+                                          model->layers_weights, model->layers_biases, model->layers_activation);
+        if (flattenModel(sparse) != 0)
+        {
+            freeModel(sparse);
+            break;
+        }
+        int size = sparse->input_size;
+        for (int i = 0; i < sparse->n_layers; i++)
+        {
+            for (int j = 0; j < size * sparse->layers_size[i]; j++)
+            {
+                sparse->layers_weights[i][j] = (j * 37 % 100 < densities[d]) ? sparse->layers_weights[i][j] : 0;
+            }
+            size = sparse->layers_size[i];
+        }
+        if (sparsifyModel(sparse, 1.0f) < 0)
+        {
+            freeModel(sparse);
+            break;
+        }
+        InferencePlan *sparse_plan = createInferencePlan(sparse);
+        char name[48];
+        snprintf(name, sizeof(name), "predict_plan_sparse%d", densities[d]);
+        for (start_bench(&run, shape->name, name, 1); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_predict_plan(sparse_plan, x, output);
+            bench_lap(&run, start);
+        }
+        snprintf(name, sizeof(name), "predict_batch_sparse%d", densities[d]);
+        for (start_bench(&run, shape->name, name, BENCH_BATCH_ROWS); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_predict_batch_scratch(sparse, x, BENCH_BATCH_ROWS, outputs, scratch);
+            bench_lap(&run, start);
+        }
+        freeInferencePlan(sparse_plan);
+        freeModel(sparse);
+    }
+
+    // single sample through the int8 model, calibrated on the batch the benchmarks run on
+    QuantizedModel *quantized = quantizeModel(model, x, BENCH_BATCH_ROWS);
+    if (quantized != NULL)
+    {
+        for (start_bench(&run, shape->name, "predict_quantized", 1); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_predict_quantized(quantized, x, output);
+            bench_lap(&run, start);
+        }
+        freeQuantizedModel(quantized);
+    }
+    freeInferencePlan(plan);
+    free(output);
+    free(scratch);
+    free(outputs);
+}
+
+static void bench_train(const BenchShape *shape, Model *model, float *x, float *y)
+{
+    float (*samples_x)[model->input_size] = (float (*)[model->input_size])x;
+    float (*samples_y)[model->output_size] = (float (*)[model->output_size])y;
+    TrainContext *context = create_train_context();
+    BenchRun run;
+    double start;
+    char name[48];
+
+    for (start_bench(&run, shape->name, "train_step", BATCH_SIZE); bench_running(&run);)
+    {
+        start = now_ns();
+        fc_model_train_with_context(model, samples_x, samples_y, context);
+        bench_lap(&run, start);
+    }
+
+    // keeping the net inputs of every second layer only, the others are recomputed during backprop
+    context->checkpoint_interval = 2;
+    for (start_bench(&run, shape->name, "train_step_checkpoint_2", BATCH_SIZE); bench_running(&run);)
+    {
+        start = now_ns();
+        fc_model_train_with_context(model, samples_x, samples_y, context);
+        bench_lap(&run, start);
+    }
+    context->checkpoint_interval = 0;
+
+    // the update of every optimizer alone, zero gradients leave the weights as they are
+    const char *optimizers[] = {"sgd", "momentum", "adam", "adamw"};
+    Gradients *gradients = train_context_gradients(context, model);
+    zero_gradients(gradients, model);
+    for (int type = OPTIMIZER_SGD; type <= OPTIMIZER_ADAMW; type++)
+    {
+        Optimizer *optimizer = create_optimizer((enum OptimizerType)type, LEARNING_RATE, BATCH_SIZE);
+        snprintf(name, sizeof(name), "apply_%s", optimizers[type]);
+        for (start_bench(&run, shape->name, name, BATCH_SIZE); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_apply_gradients(model, gradients, optimizer);
+            bench_lap(&run, start);
+        }
+        free_optimizer(optimizer);
+    }
+
+    // one shuffled epoch over the batch rows per lap, the loss for early stopping measured on the first BATCH_SIZE of them
+    int fit_batch_sizes[] = {16, 64, 256};
+    TrainConfig config = default_train_config();
+    config.shuffle_seed = 1;
+    config.validation_x = x;
+    config.validation_y = y;
+    config.n_validation = BATCH_SIZE;
+    for (int b = 0; b < 3; b++)
+    {
+        config.batch_size = fit_batch_sizes[b];
+        snprintf(name, sizeof(name), "fit_epoch_b%d", fit_batch_sizes[b]);
+        for (start_bench(&run, shape->name, name, BENCH_BATCH_ROWS); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_fit(model, samples_x, samples_y, BENCH_BATCH_ROWS, &config, context, NULL);
+            bench_lap(&run, start);
+        }
+    }
+
+#ifdef ENABLE_THREADS
+    ThreadPool *pool = create_thread_pool(4);
+    for (start_bench(&run, shape->name, "train_step_parallel_4", BATCH_SIZE); bench_running(&run);)
+    {
+        start = now_ns();
+        fc_model_train_parallel_with_context(model, samples_x, samples_y, pool, context);
+        bench_lap(&run, start);
+    }
+    free_thread_pool(pool);
+#endif
+
+    // whole layers, and the first half of the incoming weights of each layer
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        snprintf(name, sizeof(name), "train_layer_%d", i);
+        for (start_bench(&run, shape->name, name, BATCH_SIZE); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_train_layer_with_context(model, samples_x, samples_y, i, context);
+            bench_lap(&run, start);
+        }
+
+        int n_weights = (size + 1) / 2;
+        snprintf(name, sizeof(name), "train_partial_%d_%dof%d", i, n_weights, size);
+        for (start_bench(&run, shape->name, name, BATCH_SIZE); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_train_partial_layer_with_context(model, samples_x, samples_y, i, n_weights, 0, context);
+            bench_lap(&run, start);
+        }
+        size = model->layers_size[i];
+    }
+
+    // the last layer with the frozen layers below it read from a cache in RAM, filled by the first step
+    int last = model->n_layers - 1;
+    ActivationCache *cache = (last > 0) ? create_activation_cache(model, last, BATCH_SIZE, NULL) : NULL;
+    if (cache != NULL)
+    {
+        snprintf(name, sizeof(name), "train_layer_%d_cached", last);
+        for (start_bench(&run, shape->name, name, BATCH_SIZE); bench_running(&run);)
+        {
+            start = now_ns();
+            fc_model_train_layer_cached(model, samples_x, samples_y, 0, last, context, cache);
+            bench_lap(&run, start);
+        }
+        free_activation_cache(cache);
+    }
+    free_train_context(context, model);
+}
+
+/* Writes the configuration and all results as JSON
+    @return 0 on success */
+static int write_results(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Error: could not create %s! \n", path);
+        return -1;
+    }
+    fprintf(file, "{\n  \"config\": {\"batch_size\": %d, \"kernels\": \"%s\", \"threads\": %d, \"track_memory\": %d, "
+                  "\"profiling\": %d, \"min_time\": %g, \"seed\": %u},\n",
+            BATCH_SIZE, get_kernels()->name,
+#ifdef ENABLE_THREADS
+            1,
+#else
+            0,
+#endif
+#ifdef ENABLE_TRACK_MEMORY
+            1,
+#else
+            0,
+#endif
+#ifdef ENABLE_PROFILING
+            1,
+#else
+            0,
+#endif
+            min_time, BENCH_SEED);
+    fprintf(file, "  \"results\": [\n");
+    for (int i = 0; i < n_results; i++)
+    {
+        BenchResult *r = &results[i];
+        fprintf(file, "    {\"model\": \"%s\", \"benchmark\": \"%s\", \"iterations\": %d, \"samples\": %d, "
+                      "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"samples_per_sec\": %.1f}%s\n",
+                r->model, r->benchmark, r->iterations, r->samples, r->mean_ns, r->p50_ns, r->p99_ns, r->samples_per_sec,
+                (i + 1 < n_results) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (fclose(file) != 0)
+    {
+        printf("Error: could not write %s! \n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = "bench_results.json";
+    const char *only = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+        {
+            min_time = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--shape") == 0 && i + 1 < argc)
+        {
+            only = argv[++i];
+        }
+        else
+        {
+            printf("usage: %s [--output path] [--min-time seconds] [--shape name]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("kernels: %s, BATCH_SIZE: %d \n", get_kernels()->name, BATCH_SIZE);
+    printf("%-8s %-28s %8s %14s %14s %14s %14s\n", "model", "benchmark", "iters", "mean ns", "p50 ns", "p99 ns", "samples/s");
+    for (int s = 0; s < N_SHAPES; s++)
+    {
+        const BenchShape *shape = &shapes[s];
+        if (only != NULL && strcmp(only, shape->name) != 0)
+        {
+            continue;
+        }
+        // every shape starts from the same seed, so its weights and samples do not depend on the shapes run before
+        rng_state = BENCH_SEED;
+        BenchModel *bench = create_bench_model(shape);
+        Model *model = bench->model;
+        int n_rows = (BENCH_BATCH_ROWS > BATCH_SIZE) ? BENCH_BATCH_ROWS : BATCH_SIZE;
+        float *x = random_floats(n_rows * model->input_size);
+        float *y = random_floats(n_rows * model->output_size);
+
+        bench_predict(shape, model, x);
+        bench_train(shape, model, x, y);
+
+        free(x);
+        free(y);
+        free_bench_model(bench);
+    }
+    return write_results(output) == 0 ? 0 : 1;
+}
@@ -6,86 +6,489 @@
 #include "../util/back_prop.h"
 #include "../util/loss_functions.h"
 #include "../util/config.h"
+#include "../util/profiler.h"
 #include <stdio.h>
+/* Forward propagates one sample through layers [first, last) into their net inputs. The input of layer first is the
+    sample, or the net inputs of the layer before it with its activation applied.
+    @param op: what the time is profiled as, PROFILE_RECOMPUTE for the segments of checkpointed gradients
+*/
+static void fc_forward_layers(Model *model, float *input, float **net_inputs, int first, int last, enum ProfileOp op)
+{
+    float *curr_in = (first == 0) ? input : net_inputs[first - 1];
+    int size = (first == 0) ? model->input_size : model->layers_size[first - 1];
+    ActivationFunc func = (first == 0) ? &linear : get_activation_func(model->layers_activation[first - 1]); // input activation func is set to linear
+    ForwardPropTFunc forward = (first == 0) ? fc_forward_prop_t_linear : get_forward_prop_t_func(model->layers_activation[first - 1]);
+    (void)op; // only read by PROFILE_STOP
+
+    for (int i = first; i < last; i++)
+    {
+
+        PROFILE_START(forward_time);
+        const SparseWeights *sparse = modelSparseWeights(model, i);
+        if (sparse != NULL)
+        {
+            fc_forward_prop_t_sparse(curr_in, size, net_inputs[i], model->layers_size[i], sparse,
+                                     model->layers_biases[i], func);
+        }
+        else
+        {
+            forward(curr_in, size, net_inputs[i],
+                    model->layers_size[i], model->layers_weights[i], model->layers_biases[i]);
+        }
+        PROFILE_STOP(forward_time, op, i, 2 * (uint64_t)size * model->layers_size[i], 1);
+        curr_in = net_inputs[i];
+        size = model->layers_size[i];
+        func = get_activation_func(model->layers_activation[i]);
+        forward = get_forward_prop_t_func(model->layers_activation[i]);
+    }
+}
+
 /* Fully connected model functionality, does forward propagation,
     backpropagation with training to calculate gradients into gradient structure.
+    Checkpointed gradients recompute the net inputs of a segment from the checkpoint below it before propagating
+    back through it, see allocate_checkpointed_gradients.
     @return nothing.
 */
 void fc_calc_gradients(Model *model, float *input, float *actual, Gradients *gradients)
 {
-    float *curr_in = input;
-    int size = model->input_size;
-    ActivationFunc func = &linear;             // input activation func is set to linear
-    ActivationFunc func_deriv = &linear_deriv; // input activation func is set to linear
+    int last = model->n_layers - 1;
+    int interval = gradients->checkpoint_interval;
+    float *curr_in = gradients->net_inputs[last];
+    ActivationFunc func = get_activation_func(model->layers_activation[last]);
+    ActivationFunc func_deriv = get_activation_func_deriv(model->layers_activation[last]);
 
+    MEMORY_PHASE_BEGIN("forward");
     // forward propagate through each layer
-    for (int i = 0; i < model->n_layers; i++)
-    {
-
-        curr_in = fc_forward_prop_t(curr_in, size, gradients->net_inputs[i],
-                                    model->layers_size[i], model->layers_weights[i], model->layers_biases[i], func);
-        size = model->layers_size[i];
-        func = get_activation_func(model->layers_activation[i]);
-        func_deriv = get_activation_func_deriv(model->layers_activation[i]);
-    } // if not training return output (input from prev loop with activation func applied)
-    for (int i = 0; i < model->layers_size[model->n_layers - 1]; i++)
+    fc_forward_layers(model, input, gradients->net_inputs, 0, model->n_layers, PROFILE_FORWARD);
+    // if not training return output (input from prev loop with activation func applied)
+    for (int i = 0; i < model->layers_size[last]; i++)
     {
         curr_in[i] = func(curr_in[i]);
     }
+    MEMORY_PHASE_END();
     // if training flag do backpropagate
     // start getting error derivative and overwrite last layer net_inputs with gradients
+    MEMORY_PHASE_BEGIN("loss");
     float loss_deriv = MSE_derivative(curr_in, actual, model->layers_size[model->n_layers - 1]); // last layer size is output size
     for (int i = 0; i < model->layers_size[model->n_layers - 1]; i++)
     {
 
         gradients->net_inputs[model->n_layers - 1][i] = loss_deriv * func_deriv(gradients->net_inputs[model->n_layers - 1][i]);
     }
+    MEMORY_PHASE_END();
     // perform backprop
+    MEMORY_PHASE_BEGIN("backward");
     for (int i = model->n_layers - 1; i > 0; i--)
     {
-        fc_back_prop(gradients->net_inputs[i], gradients->net_inputs[i - 1], model->layers_weights[i],
-                     model->layers_size[i], model->layers_size[i - 1], get_activation_func(model->layers_activation[i - 1]), get_activation_func_deriv(model->layers_activation[i - 1]), gradients->weights[i], gradients->biases[i]);
+        // entering a segment below its checkpoint, which holds its gradients by now
+        if (interval > 1 && i % interval == interval - 1 && i < last)
+        {
+            MEMORY_PHASE_BEGIN("recompute");
+            fc_forward_layers(model, input, gradients->net_inputs, i - interval + 1, i, PROFILE_RECOMPUTE);
+            MEMORY_PHASE_END();
+        }
+        PROFILE_START(backward_time);
+        const SparseWeights *sparse = modelSparseWeights(model, i);
+        if (sparse != NULL)
+        {
+            fc_back_prop_sparse(gradients->net_inputs[i], gradients->net_inputs[i - 1], sparse,
+                                model->layers_size[i], model->layers_size[i - 1], get_activation_func(model->layers_activation[i - 1]), get_activation_func_deriv(model->layers_activation[i - 1]), gradients->weights[i], gradients->biases[i]);
+        }
+        else
+        {
+            fc_back_prop(gradients->net_inputs[i], gradients->net_inputs[i - 1], model->layers_weights[i],
+                         model->layers_size[i], model->layers_size[i - 1], get_activation_func(model->layers_activation[i - 1]), get_activation_func_deriv(model->layers_activation[i - 1]), gradients->weights[i], gradients->biases[i]);
+        }
+        PROFILE_STOP(backward_time, PROFILE_BACKWARD, i, 4 * (uint64_t)model->layers_size[i] * model->layers_size[i - 1], 1);
     }
 
-    // edge case for input to first layer
-    curr_in = input;
-    fc_back_prop(gradients->net_inputs[0], curr_in, model->layers_weights[0],
-                 model->layers_size[0], model->input_size, linear, linear_deriv, gradients->weights[0], gradients->biases[0]);
+    // edge case for input to first layer, only weight and bias gradients so the caller's input is left untouched
+    PROFILE_START(backward_time);
+    const SparseWeights *sparse = modelSparseWeights(model, 0);
+    if (sparse != NULL)
+    {
+        specific_fc_back_prop_sparse(gradients->net_inputs[0], input, model->layers_size[0], linear,
+                                     gradients->weights[0], gradients->biases[0], model->input_size, sparse, 0);
+    }
+    else
+    {
+        specific_fc_back_prop(gradients->net_inputs[0], input, model->layers_size[0], linear,
+                              gradients->weights[0], gradients->biases[0], model->input_size);
+    }
+    PROFILE_STOP(backward_time, PROFILE_BACKWARD, 0, 2 * (uint64_t)model->input_size * model->layers_size[0], 1);
+    MEMORY_PHASE_END();
     return;
 }
 
 /* Applies gradients for a fully connected layer*/
-void fc_apply_gradient(Model *model, int layer, int layer_size, int prev_layer_size, Gradients *gradients)
+void fc_apply_gradient(Model *model, int layer, int layer_size, int prev_layer_size, Gradients *gradients,
+                       Optimizer *optimizer, const OptimizerStep *step)
+{
+    optimizer_update(optimizer, step, model->layers_biases[layer], gradients->biases[layer],
+                     optimizer_biases_offset(optimizer, layer), layer_size);
+    optimizer_update(optimizer, step, model->layers_weights[layer], gradients->weights[layer],
+                     optimizer_weights_offset(optimizer, layer), prev_layer_size * layer_size);
+    repackModelWeights(model, layer, 0, prev_layer_size);
+}
+
+/* Applies the gradients of every layer, in one linear pass when the model and gradients use the flat layout.
+    The padding between layers has zero gradients and is left unchanged.
+    @param optimizer: update rule, NULL for sgd with LEARNING_RATE and BATCH_SIZE
+*/
+void fc_apply_gradients(Model *model, Gradients *gradients, Optimizer *optimizer)
 {
-    for (int i = 0; i < layer_size; i++)
+    OptimizerStep step;
+    if (optimizer_begin_step(optimizer, model, &step) != 0)
+    {
+        return;
+    }
+    if (model->params != NULL && gradients->params != NULL)
     {
-        model->layers_biases[layer][i] -= LEARNING_RATE * (gradients->biases[layer][i] / BATCH_SIZE);
-        for (int j = 0; j < prev_layer_size; j++)
+        PROFILE_START(apply_time);
+        optimizer_update(optimizer, &step, model->params, gradients->params, 0, model->n_params);
+        PROFILE_STOP(apply_time, PROFILE_APPLY, -1, 3 * (uint64_t)model->n_params, optimizer_batch_size(optimizer));
+        int size = model->input_size;
+        for (int i = 0; i < model->n_layers; i++)
         {
-            model->layers_weights[layer][i + j * layer_size] -= LEARNING_RATE * (gradients->weights[layer][i + j * layer_size] / BATCH_SIZE);
+            repackModelWeights(model, i, 0, size);
+            size = model->layers_size[i];
         }
+        return;
+    }
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        PROFILE_START(apply_time);
+        fc_apply_gradient(model, i, model->layers_size[i], size, gradients, optimizer, &step);
+        PROFILE_STOP(apply_time, PROFILE_APPLY, i, 3 * (uint64_t)(size + 1) * model->layers_size[i],
+                     optimizer_batch_size(optimizer));
+        size = model->layers_size[i];
     }
 }
 
-/* train fully connected layer for batch_size amount of samples*/
-void fc_model_train(Model *model, float (*samples_x)[model->output_size], float (*samples_y)[model->output_size])
+/* Training the whole model updates every layer, so a compressed model is trained on fp32 master copies of all of them.
+    @return 0 on success, -1 if a copy could not be allocated */
+static int fc_create_master_weights(Model *model)
 {
-    /* create gradient struct*/
-    Gradients *gradients = (Gradients *)allocate_gradients(model);
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        if (createMasterWeights(model, i) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* train fully connected layer for batch_size amount of samples, reusing the gradients of the context between calls*/
+void fc_model_train_with_context(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                 TrainContext *context)
+{
+    if (fc_create_master_weights(model) != 0)
+    {
+        return;
+    }
+    MEMORY_PHASE_BEGIN("setup");
+    Gradients *gradients = train_context_gradients(context, model);
+    zero_gradients(gradients, model);
+    MEMORY_PHASE_END();
 
     for (int i = 0; i < BATCH_SIZE; i++)
     {
         fc_calc_gradients(model, samples_x[i], samples_y[i], gradients);
     }
-    // loop over the gradients and apply step
-    int size = model->input_size;
-    for (int i = 0; i < model->n_layers; i++)
+    MEMORY_PHASE_BEGIN("apply");
+    fc_apply_gradients(model, gradients, context->optimizer);
+    MEMORY_PHASE_END();
+}
+
+/* train fully connected layer for batch_size amount of samples*/
+void fc_model_train(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size])
+{
+    TrainContext *context = create_train_context();
+    fc_model_train_with_context(model, samples_x, samples_y, context);
+    free_train_context(context, model);
+}
+
+/* train one epoch of a sample stream, one step per BATCH_SIZE samples. A short last batch is skipped.
+    @return number of training steps
+*/
+int fc_model_train_stream(Model *model, SampleStream *stream, TrainContext *context)
+{
+    if (stream->input_size != model->input_size || stream->output_size != model->output_size || stream->batch_size != BATCH_SIZE)
     {
-        fc_apply_gradient(model, i, model->layers_size[i], size, gradients);
-        size = model->layers_size[i];
+        printf("Sample stream does not match the model or BATCH_SIZE! \n");
+        return 0;
     }
+    int steps = 0;
+    float *x;
+    float *y;
+    while (sample_stream_next(stream, &x, &y) == BATCH_SIZE)
+    {
+        fc_model_train_with_context(model, (float (*)[model->input_size])x, (float (*)[model->output_size])y, context);
+        steps++;
+    }
+    return steps;
+}
 
-    free_gradients(gradients, model);
+/* Mean squared error of the model over n samples, predicted FIT_EVAL_ROWS at a time
+    @param buffer: FIT_EVAL_ROWS outputs followed by the scratch of fc_model_batch_scratch_size
+*/
+static float fc_model_loss(Model *model, float *samples_x, float *samples_y, int n, float *buffer)
+{
+    double loss = 0;
+    float *scratch = buffer + FIT_EVAL_ROWS * model->output_size;
+    for (int row = 0; row < n; row += FIT_EVAL_ROWS)
+    {
+        int rows = (n - row < FIT_EVAL_ROWS) ? n - row : FIT_EVAL_ROWS;
+        fc_model_predict_batch_scratch(model, samples_x + (size_t)row * model->input_size, rows, buffer, scratch);
+        for (int i = 0; i < rows; i++)
+        {
+            loss += MSE(buffer + i * model->output_size, samples_y + (size_t)(row + i) * model->output_size, model->output_size);
+        }
+    }
+    return (float)(loss / n);
+}
+
+/* One training step on the samples of order[0..n) */
+static void fc_model_fit_step(Model *model, float *samples_x, float *samples_y, const int *order, int n, TrainContext *context)
+{
+    MEMORY_PHASE_BEGIN("setup");
+    Gradients *gradients = train_context_gradients(context, model);
+    zero_gradients(gradients, model);
+    MEMORY_PHASE_END();
+
+    for (int i = 0; i < n; i++)
+    {
+        fc_calc_gradients(model, samples_x + (size_t)order[i] * model->input_size,
+                          samples_y + (size_t)order[i] * model->output_size, gradients);
+    }
+    MEMORY_PHASE_BEGIN("apply");
+    fc_apply_gradients(model, gradients, context->optimizer);
+    MEMORY_PHASE_END();
+}
+
+/* Trains the model for the epochs of a config, shuffling the samples every epoch and following its learning rate
+    schedule. After every epoch the loss is measured on the validation samples of the config, or the training samples,
+    and training stops early once it has not improved for patience epochs. The weights of the last epoch are kept.
+    The optimizer of the context is used with the batch size and learning rate of the config, plain sgd if it has none.
+    Every layer is trained, layer and partial training keep the compile-time BATCH_SIZE.
+    @param stats: what the run did, may be NULL
+    @return number of training steps, -1 on failure */
+int fc_model_fit(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size], int n_samples,
+                 const TrainConfig *config, TrainContext *context, FitStats *stats)
+{
+    if (n_samples < 1 || config->batch_size < 1 || config->n_epochs < 1 || config->max_steps < 0 ||
+        config->learning_rate <= 0 || (config->schedule == LR_STEP_DECAY && config->decay_steps < 1) ||
+        (config->validation_x != NULL && (config->validation_y == NULL || config->n_validation < 1)))
+    {
+        printf("Invalid training config! \n");
+        return -1;
+    }
+    if (fc_create_master_weights(model) != 0)
+    {
+        return -1;
+    }
+
+    MEMORY_PHASE_BEGIN("setup");
+    int batch_scratch = fc_model_batch_scratch_size(model);
+    float *buffer = (float *)malloc((FIT_EVAL_ROWS * model->output_size + batch_scratch) * sizeof(float));
+    int *order = (int *)malloc(n_samples * sizeof(int));
+    Optimizer *optimizer = context->optimizer;
+    Optimizer *own_optimizer = NULL;
+    if (optimizer == NULL)
+    {
+        own_optimizer = create_optimizer(OPTIMIZER_SGD, config->learning_rate, config->batch_size);
+        optimizer = own_optimizer;
+    }
+    MEMORY_PHASE_END();
+    if (buffer == NULL || order == NULL || optimizer == NULL)
+    {
+        printf("Error: could not allocate training buffers! \n");
+        if (buffer != NULL)
+        {
+            free(buffer);
+        }
+        if (order != NULL)
+        {
+            free(order);
+        }
+        if (own_optimizer != NULL)
+        {
+            free_optimizer(own_optimizer);
+        }
+        return -1;
+    }
+
+    for (int i = 0; i < n_samples; i++)
+    {
+        order[i] = i;
+    }
+    float *loss_x = (config->validation_x != NULL) ? config->validation_x : (float *)samples_x;
+    float *loss_y = (config->validation_x != NULL) ? config->validation_y : (float *)samples_y;
+    int loss_n = (config->validation_x != NULL) ? config->n_validation : n_samples;
+
+    int steps_per_epoch = (n_samples + config->batch_size - 1) / config->batch_size;
+    int total_steps = config->n_epochs * steps_per_epoch;
+    if (config->max_steps > 0 && config->max_steps < total_steps)
+    {
+        total_steps = config->max_steps;
+    }
+
+    float learning_rate = optimizer->learning_rate;
+    int batch_size = optimizer->batch_size;
+    uint32_t seed = config->shuffle_seed;
+    Optimizer *context_optimizer = context->optimizer;
+    context->optimizer = optimizer;
+
+    FitStats run = {0, 0, 0, 0, 0};
+    int stale_epochs = 0;
+    while (run.epochs < config->n_epochs && run.steps < total_steps)
+    {
+        if (config->shuffle_seed != 0)
+        {
+            shuffle_samples(order, n_samples, &seed);
+        }
+        for (int start = 0; start < n_samples && run.steps < total_steps; start += config->batch_size)
+        {
+            int n = (n_samples - start < config->batch_size) ? n_samples - start : config->batch_size;
+            optimizer->learning_rate = train_config_learning_rate(config, run.steps, total_steps);
+            optimizer->batch_size = n;
+            fc_model_fit_step(model, (float *)samples_x, (float *)samples_y, order + start, n, context);
+            run.steps++;
+        }
+        run.epochs++;
+
+        run.loss = fc_model_loss(model, loss_x, loss_y, loss_n, buffer);
+        if (run.epochs == 1 || run.loss < run.best_loss - config->min_delta)
+        {
+            run.best_loss = run.loss;
+            run.best_epoch = run.epochs;
+            stale_epochs = 0;
+        }
+        else if (config->patience > 0 && ++stale_epochs >= config->patience)
+        {
+            break;
+        }
+    }
+
+    context->optimizer = context_optimizer;
+    optimizer->learning_rate = learning_rate;
+    optimizer->batch_size = batch_size;
+    if (own_optimizer != NULL)
+    {
+        free_optimizer(own_optimizer);
+    }
+    free(order);
+    free(buffer);
+    if (stats != NULL)
+    {
+        *stats = run;
+    }
+    return run.steps;
+}
+
+#ifdef ENABLE_THREADS
+typedef struct
+{
+    Model *model;
+    float *samples_x; // row-major, input_size per sample
+    float *samples_y; // row-major, output_size per sample
+    Gradients **gradients; // one private buffer per thread
+    int stride;            // distance between the buffers combined in the current reduction level
+} ParallelTrainArgs;
+
+/* each thread accumulates the gradients of a contiguous slice of the batch */
+static void parallel_calc_gradients(void *args, int thread_id, int n_threads)
+{
+    ParallelTrainArgs *train = (ParallelTrainArgs *)args;
+    Model *model = train->model;
+    int start = BATCH_SIZE * thread_id / n_threads;
+    int end = BATCH_SIZE * (thread_id + 1) / n_threads;
+    zero_gradients(train->gradients[thread_id], model);
+    for (int i = start; i < end; i++)
+    {
+        fc_calc_gradients(model, train->samples_x + i * model->input_size, train->samples_y + i * model->output_size,
+                          train->gradients[thread_id]);
+    }
+}
+
+/* one level of the pairwise tree reduction, buffer t takes in buffer t + stride */
+static void parallel_reduce_gradients(void *args, int thread_id, int n_threads)
+{
+    ParallelTrainArgs *train = (ParallelTrainArgs *)args;
+    if (thread_id % (2 * train->stride) == 0 && thread_id + train->stride < n_threads)
+    {
+        add_gradients(train->gradients[thread_id], train->gradients[thread_id + train->stride], train->model);
+    }
+}
+
+/* train fully connected model for batch_size amount of samples, split over the threads of the pool.
+    Every thread owns its gradients, zeroed by the thread itself, and they are combined by a tree
+    reduction in a fixed order, so the result only depends on the number of threads.
+*/
+void fc_model_train_parallel_with_context(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                          ThreadPool *pool, TrainContext *context)
+{
+    if (fc_create_master_weights(model) != 0)
+    {
+        return;
+    }
+    ParallelTrainArgs train;
+    train.model = model;
+    train.samples_x = samples_x[0];
+    train.samples_y = samples_y[0];
+    MEMORY_PHASE_BEGIN("setup");
+    train.gradients = train_context_thread_gradients(context, model, pool->n_threads);
+    MEMORY_PHASE_END();
+
+    thread_pool_run(pool, parallel_calc_gradients, &train);
+    for (train.stride = 1; train.stride < pool->n_threads; train.stride *= 2)
+    {
+        thread_pool_run(pool, parallel_reduce_gradients, &train);
+    }
+
+    MEMORY_PHASE_BEGIN("apply");
+    fc_apply_gradients(model, train.gradients[0], context->optimizer);
+    MEMORY_PHASE_END();
+}
+
+void fc_model_train_parallel(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                             ThreadPool *pool)
+{
+    TrainContext *context = create_train_context();
+    fc_model_train_parallel_with_context(model, samples_x, samples_y, pool, context);
+    free_train_context(context, model);
+}
+#endif
+
+/* allocating forward propagation of one layer, from its 16-bit weights when the model is compressed
+    and from its sparse weights when the layer is sparse */
+static float *fc_model_forward_layer(Model *model, int layer, float *input, int input_size, ActivationFunc func)
+{
+    const uint16_t *half_weights = modelHalfWeights(model, layer);
+    const SparseWeights *sparse = modelSparseWeights(model, layer);
+    if (half_weights == NULL && sparse == NULL)
+    {
+        return fc_forward_prop(input, model->layers_weights[layer], model->layers_biases[layer],
+                               input_size, model->layers_size[layer], func);
+    }
+    float *output = (float *)malloc(model->layers_size[layer] * sizeof(float));
+    if (output == NULL)
+    {
+        printf("Error: could not allocate layer output! \n");
+        return NULL;
+    }
+    if (sparse != NULL)
+    {
+        fc_forward_prop_batch_sparse(input, 1, input_size, output, model->layers_size[layer], sparse, model->layers_biases[layer], func);
+    }
+    else
+    {
+        fc_forward_prop_batch_half(input, 1, input_size, output, model->layers_size[layer], half_weights,
+                                   model->half_format, model->layers_biases[layer], func);
+    }
+    return output;
 }
 
 /* Function to calculated fully-connected model output */
@@ -95,8 +498,9 @@ float *fc_model_predict(Model *model, float *input)
     int size = model->input_size;
     ActivationFunc func = get_activation_func(model->layers_activation[0]);
     // forward propagate through each layer
-    float *output = fc_forward_prop(input, model->layers_weights[0], model->layers_biases[0],
-                                    size, model->layers_size[0], func);
+    PROFILE_START(forward_time);
+    float *output = fc_model_forward_layer(model, 0, input, size, func);
+    PROFILE_STOP(forward_time, PROFILE_FORWARD, 0, 2 * (uint64_t)size * model->layers_size[0], 1);
     input = output;
     size = model->layers_size[0];
 
@@ -104,8 +508,9 @@ float *fc_model_predict(Model *model, float *input)
     {
 
         func = get_activation_func(model->layers_activation[i]);
-        output = fc_forward_prop(input, model->layers_weights[i], model->layers_biases[i],
-                                 size, model->layers_size[i], func);
+        PROFILE_START(layer_time);
+        output = fc_model_forward_layer(model, i, input, size, func);
+        PROFILE_STOP(layer_time, PROFILE_FORWARD, i, 2 * (uint64_t)size * model->layers_size[i], 1);
 
         free(input);
         input = output;
@@ -113,3 +518,173 @@ float *fc_model_predict(Model *model, float *input)
     }
     return input;
 }
+
+/* Number of floats of scratch memory fc_model_predict_batch_scratch needs for a model */
+int fc_model_batch_scratch_size(Model *model)
+{
+    int max_size = 0;
+    for (int i = 0; i < model->n_layers - 1; i++)
+    {
+        if (model->layers_size[i] > max_size)
+        {
+            max_size = model->layers_size[i];
+        }
+    }
+    return 2 * FC_BATCH_BLOCK_ROWS * max_size;
+}
+
+/* Function to calculate fully-connected model outputs for n samples at once, using caller-provided scratch.
+    Samples are processed in blocks of FC_BATCH_BLOCK_ROWS, with intermediate layers
+    ping-ponging between the two halves of the scratch buffer. A sparse layer uses its sparse weights, see sparsifyModel,
+    a packed model its panels, see packModel, and a compressed model its 16-bit weights, see compressModelWeights.
+    @param X: input samples, row-major (n x input_size)
+    @param n: number of samples
+    @param Y: caller-provided output, row-major (n x output_size)
+    @param scratch: fc_model_batch_scratch_size(model) floats
+*/
+void fc_model_predict_batch_scratch(Model *model, const float *X, int n, float *Y, float *scratch)
+{
+    int half = fc_model_batch_scratch_size(model) / 2;
+
+    for (int row = 0; row < n; row += FC_BATCH_BLOCK_ROWS)
+    {
+        int rows = (n - row < FC_BATCH_BLOCK_ROWS) ? n - row : FC_BATCH_BLOCK_ROWS;
+        const float *input = X + row * model->input_size;
+        int size = model->input_size;
+
+        for (int i = 0; i < model->n_layers; i++)
+        {
+            // last layer writes straight into the caller's output
+            float *output = (i == model->n_layers - 1) ? Y + row * model->output_size : scratch + (i % 2) * half;
+            PROFILE_START(forward_time);
+            const uint16_t *half_weights = modelHalfWeights(model, i);
+            const SparseWeights *sparse = modelSparseWeights(model, i);
+            if (sparse != NULL)
+            {
+                fc_forward_prop_batch_sparse(input, rows, size, output, model->layers_size[i], sparse, model->layers_biases[i],
+                                             get_activation_func(model->layers_activation[i]));
+            }
+            else if (model->layers_panels != NULL)
+            {
+                ForwardPropPackedFunc forward = get_forward_prop_packed_func(model->layers_activation[i]);
+                forward(input, rows, size, output, model->layers_size[i], model->layers_panels[i], model->layers_biases[i]);
+            }
+            else if (half_weights != NULL)
+            {
+                fc_forward_prop_batch_half(input, rows, size, output, model->layers_size[i], half_weights, model->half_format,
+                                           model->layers_biases[i], get_activation_func(model->layers_activation[i]));
+            }
+            else
+            {
+                ForwardPropBatchFunc forward = get_forward_prop_batch_func(model->layers_activation[i]);
+                forward(input, rows, size, output, model->layers_size[i], model->layers_weights[i], model->layers_biases[i]);
+            }
+            PROFILE_STOP(forward_time, PROFILE_FORWARD, i, 2 * (uint64_t)rows * size * model->layers_size[i], rows);
+            input = output;
+            size = model->layers_size[i];
+        }
+    }
+}
+
+/* Function to calculate fully-connected model outputs for n samples at once.
+    The scratch buffer is allocated once per call.
+    @param X: input samples, row-major (n x input_size)
+    @param n: number of samples
+    @param Y: caller-provided output, row-major (n x output_size)
+*/
+void fc_model_predict_batch(Model *model, const float *X, int n, float *Y)
+{
+    int scratch_size = fc_model_batch_scratch_size(model);
+
+    // a single layer model writes straight into Y and needs no scratch
+    if (scratch_size == 0)
+    {
+        fc_model_predict_batch_scratch(model, X, n, Y, NULL);
+        return;
+    }
+
+    float *scratch = (float *)malloc(scratch_size * sizeof(float));
+    if (scratch == NULL)
+    {
+        printf("Error: could not allocate scratch buffers for batch prediction! \n");
+        return;
+    }
+    fc_model_predict_batch_scratch(model, X, n, Y, scratch);
+    free(scratch);
+}
+
+/* Function to calculate fully-connected model output without any heap allocation.
+    Hidden layer outputs are placed in the plan's arena. A sparse layer uses its sparse weights, a packed model
+    its panels, see packModel, and a compressed model its 16-bit weights.
+    @param output: caller-provided output of size output_size
+*/
+void fc_model_predict_plan(InferencePlan *plan, const float *input, float *output)
+{
+    Model *model = plan->model;
+    int size = model->input_size;
+
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        float *layer_output = (i == model->n_layers - 1) ? output : inferencePlanLayerOutput(plan, i);
+        PROFILE_START(forward_time);
+        const uint16_t *half_weights = modelHalfWeights(model, i);
+        const SparseWeights *sparse = modelSparseWeights(model, i);
+        if (sparse != NULL)
+        {
+            fc_forward_prop_batch_sparse(input, 1, size, layer_output, model->layers_size[i], sparse, model->layers_biases[i],
+                                         get_activation_func(model->layers_activation[i]));
+        }
+        else if (model->layers_panels != NULL)
+        {
+            ForwardPropPackedFunc forward = get_forward_prop_packed_func(model->layers_activation[i]);
+            forward(input, 1, size, layer_output, model->layers_size[i], model->layers_panels[i], model->layers_biases[i]);
+        }
+        else if (half_weights != NULL)
+        {
+            fc_forward_prop_batch_half(input, 1, size, layer_output, model->layers_size[i], half_weights, model->half_format,
+                                       model->layers_biases[i], get_activation_func(model->layers_activation[i]));
+        }
+        else
+        {
+            ForwardPropBatchFunc forward = get_forward_prop_batch_func(model->layers_activation[i]);
+            forward(input, 1, size, layer_output, model->layers_size[i], model->layers_weights[i], model->layers_biases[i]);
+        }
+        PROFILE_STOP(forward_time, PROFILE_FORWARD, i, 2 * (uint64_t)size * model->layers_size[i], 1);
+        input = layer_output;
+        size = model->layers_size[i];
+    }
+}
+
+/* Function to calculate the output of an int8 quantized model, see quantizeModel.
+    Every layer's activated output is requantized with the input scale of the next layer,
+    only the last layer is left in float. Uses the model's scratch, so calls must not overlap.
+    @param output: caller-provided output of size output_size
+*/
+void fc_model_predict_quantized(QuantizedModel *model, const float *input, float *output)
+{
+    int size = model->input_size;
+    int8_t *q_input = model->activations[0];
+    quantizeValues(input, size, model->layers_input_scale[0], q_input);
+
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        int output_size = model->layers_size[i];
+        int last = (i == model->n_layers - 1);
+        float *net_inputs = last ? output : model->net_inputs;
+        PROFILE_START(forward_time);
+        fc_forward_prop_q8(q_input, size, model->layers_input_scale[i], net_inputs, output_size, model->layers_weights[i],
+                           model->layers_weight_scales[i], model->layers_biases[i]);
+        ActivationFunc activation_func = get_activation_func(model->layers_activation[i]);
+        for (int j = 0; j < output_size; j++)
+        {
+            net_inputs[j] = activation_func(net_inputs[j]);
+        }
+        if (!last)
+        {
+            q_input = model->activations[(i + 1) % 2];
+            quantizeValues(net_inputs, output_size, model->layers_input_scale[i + 1], q_input);
+        }
+        PROFILE_STOP(forward_time, PROFILE_FORWARD, i, 2 * (uint64_t)size * output_size, 1);
+        size = output_size;
+    }
+}
@@ -2,9 +2,31 @@
 #define MODEL_FC_H
 
 #include "../util/model_binding.h"
+#include "../util/quantized_model.h"
 #include "../util/model_gradients.h"
+#include "../util/thread_pool.h"
+#include "../util/sample_stream.h"
+#include "../util/train_config.h"
 
-void fc_model_train(Model *model, float (*samples_x)[model->output_size], float (*samples_y)[model->output_size]);
+void fc_calc_gradients(Model *model, float *input, float *actual, Gradients *gradients);
+void fc_apply_gradients(Model *model, Gradients *gradients, Optimizer *optimizer);
+void fc_model_train(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size]);
+void fc_model_train_with_context(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                 TrainContext *context);
+int fc_model_train_stream(Model *model, SampleStream *stream, TrainContext *context);
+int fc_model_fit(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size], int n_samples,
+                 const TrainConfig *config, TrainContext *context, FitStats *stats);
+#ifdef ENABLE_THREADS
+void fc_model_train_parallel(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                             ThreadPool *pool);
+void fc_model_train_parallel_with_context(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                          ThreadPool *pool, TrainContext *context);
+#endif
 float *fc_model_predict(Model *model, float *input);
+void fc_model_predict_batch(Model *model, const float *X, int n, float *Y);
+int fc_model_batch_scratch_size(Model *model);
+void fc_model_predict_batch_scratch(Model *model, const float *X, int n, float *Y, float *scratch);
+void fc_model_predict_plan(InferencePlan *plan, const float *input, float *output);
+void fc_model_predict_quantized(QuantizedModel *model, const float *input, float *output);
 
 #endif
@@ -8,67 +8,132 @@
 #include "../util/config.h"
 #include <stdio.h>
 
+/* forward propagation used when training of one layer, from its sparse or 16-bit weights if it has them
+    @param func: activation function for the input of the layer */
+static void partial_forward_layer(Model *model, int layer, float *input, int input_size, float *output, ActivationFunc func)
+{
+    const uint16_t *half_weights = modelHalfWeights(model, layer);
+    const SparseWeights *sparse = modelSparseWeights(model, layer);
+    if (sparse != NULL)
+    {
+        fc_forward_prop_t_sparse(input, input_size, output, model->layers_size[layer], sparse, model->layers_biases[layer], func);
+    }
+    else if (half_weights != NULL)
+    {
+        fc_forward_prop_t_half(input, input_size, output, model->layers_size[layer], half_weights, model->half_format,
+                               model->layers_biases[layer], func);
+    }
+    else
+    {
+        fc_forward_prop_t(input, input_size, output, model->layers_size[layer], model->layers_weights[layer],
+                          model->layers_biases[layer], func);
+    }
+}
+
+/* forward propagation through the frozen layers below the target layer, into the workspace buffers of gradients
+    @return the net inputs of the layer below the target, the input itself for target layer 0 */
+static float *partial_forward_frozen(float *input, Model *model, int target_layer, PartialGradients *gradients)
+{
+    float *curr_in = input;
+    int size = model->input_size;
+    ActivationFunc func = &linear; // input activation func is set to linear
+
+    for (int i = 0; i < target_layer; i++)
+    {
+        float *output = gradients->layer_buffers[i % 2]; // never the buffer holding curr_in
+        PROFILE_START(forward_time);
+        partial_forward_layer(model, i, curr_in, size, output, func);
+        PROFILE_STOP(forward_time, PROFILE_FORWARD, i, 2 * (uint64_t)size * model->layers_size[i], 1);
+        curr_in = output;
+        size = model->layers_size[i];
+        func = get_activation_func(model->layers_activation[i]);
+    }
+    return curr_in;
+}
+
 /*
     Calculates partial gradients, meaning it will store the gradients for the target layer and activation for the previous neurons
-    given n_weights and offset.
+    given n_weights and offset. Layer outputs and gradients use the workspace buffers in gradients, nothing is allocated.
 */
 void partial_calc_gradients(float *input, Model *model, int target_layer, int n_weights, int offset, float *actual, PartialGradients *gradients)
 {
+    MEMORY_PHASE_BEGIN("forward");
+    float *target_input = partial_forward_frozen(input, model, target_layer, gradients);
+    MEMORY_PHASE_END();
+    partial_calc_gradients_from_target(target_input, model, target_layer, n_weights, offset, actual, gradients);
+}
 
-    float *curr_in = input;
+/* partial_calc_gradients starting at the target layer, from the output of the frozen layers below it
+    @param target_input: net inputs of the layer below the target as returned by partial_forward_frozen, e.g. cached,
+        the input of the model for target layer 0. Must not be one of the workspace buffers of gradients
+        unless it is the buffer partial_forward_frozen left it in.
+*/
+void partial_calc_gradients_from_target(float *target_input, Model *model, int target_layer, int n_weights, int offset, float *actual,
+                                        PartialGradients *gradients)
+{
+    float *curr_in = target_input;
     float *output;
-    int size = model->input_size;
-    ActivationFunc func = &linear; // input activation func is set to linear
-    ActivationFunc func_deriv = &linear_deriv;
-    size = model->layers_size[0];
+    int size = (target_layer == 0) ? model->input_size : model->layers_size[target_layer - 1];
+    ActivationFunc func = (target_layer == 0) ? &linear : get_activation_func(model->layers_activation[target_layer - 1]);
 
-    for (int i = 0; i < model->n_layers; i++)
+    MEMORY_PHASE_BEGIN("forward");
+    for (int i = target_layer; i < model->n_layers; i++)
     {
-        output = (float *)malloc(model->layers_size[i] * sizeof(float)); // allocate output
+        output = gradients->layer_buffers[i % 2]; // never the buffer holding curr_in
 
-        /* forward propagate, store needed data otherwise free */
-        output = fc_forward_prop_t(curr_in, size, output, model->layers_size[i], model->layers_weights[i], model->layers_biases[i], func);
+        /* forward propagate, store needed data */
+        PROFILE_START(forward_time);
+        partial_forward_layer(model, i, curr_in, size, output, func);
+        PROFILE_STOP(forward_time, PROFILE_FORWARD, i, 2 * (uint64_t)size * model->layers_size[i], 1);
 
         if (i == target_layer) // store neuron if at target layer
         {
             memcpy(gradients->net_input, curr_in + offset, n_weights * sizeof(float));
-            if (target_layer != 0)
-            {
-                free(curr_in);
-            }
-        }
-        else if (i != 0 && (i < target_layer || i > target_layer)) // free if below target layer or larget than target, since not needed
-        {
-            free(curr_in);
         }
 
-        if (i >= target_layer)
-        { // else only store derivative of the input
-            for (int j = 0; j < model->layers_size[i]; j++)
-            {
-                gradients->deriv_activations[i - target_layer][j] = (uint8_t)func_deriv(output[j]);
-            }
-        }
         curr_in = output;
         size = model->layers_size[i];
         func = get_activation_func(model->layers_activation[i]);
-        func_deriv = get_activation_func_deriv(model->layers_activation[i]);
+        pack_deriv_mask(gradients->deriv_masks[i - target_layer], output, size, model->layers_activation[i]);
     }
-    float loss_deriv = MSE_derivative(curr_in, actual, model->layers_size[model->n_layers - 1]);
+    MEMORY_PHASE_END();
+    MEMORY_PHASE_BEGIN("loss");
+    int output_size = model->layers_size[model->n_layers - 1];
+    float loss_deriv = MSE_derivative(curr_in, actual, output_size);
 
     /* use new backprop until target layer the use normal backprop for that layer only.*/
 
-    for (int i = 0; i < model->layers_size[model->n_layers - 1]; i++)
+    for (int i = 0; i < output_size; i++)
     {
-        curr_in[i] = loss_deriv * func_deriv(curr_in[i]);
+        curr_in[i] = loss_deriv;
     }
+    // scaled by the derivative of the output layer
+    get_kernels()->mask_apply(curr_in, gradients->deriv_masks[model->n_layers - 1 - target_layer], output_size);
+    MEMORY_PHASE_END();
+    MEMORY_PHASE_BEGIN("backward");
     // perform packprop using the backprop that uses the stored derivative activation values until target layer
     for (int i = model->n_layers - 1; i > target_layer; i--)
     {
-        float *output = light_fc_back_prop(curr_in, model->layers_weights[i], model->layers_size[i],
-                                           model->layers_size[i - 1], gradients->deriv_activations[i - target_layer - 1]);
-        free(curr_in);
-        curr_in = output;
+        output = (curr_in == gradients->layer_buffers[0]) ? gradients->layer_buffers[1] : gradients->layer_buffers[0];
+        PROFILE_START(backward_time);
+        const uint16_t *half_weights = modelHalfWeights(model, i);
+        const SparseWeights *sparse = modelSparseWeights(model, i);
+        if (sparse != NULL)
+        {
+            curr_in = light_fc_back_prop_sparse(curr_in, sparse, model->layers_size[i - 1],
+                                                gradients->deriv_masks[i - target_layer - 1], output);
+        }
+        else if (half_weights != NULL)
+        {
+            curr_in = light_fc_back_prop_half(curr_in, half_weights, model->half_format, model->layers_size[i],
+                                              model->layers_size[i - 1], gradients->deriv_masks[i - target_layer - 1], output);
+        }
+        else
+        {
+            curr_in = light_fc_back_prop(curr_in, model->layers_weights[i], model->layers_size[i],
+                                         model->layers_size[i - 1], gradients->deriv_masks[i - target_layer - 1], output);
+        }
+        PROFILE_STOP(backward_time, PROFILE_LIGHT_BACKWARD, i, 2 * (uint64_t)model->layers_size[i] * model->layers_size[i - 1], 1);
     }
     // Apply last backprop, using 'normal backprop' to calculate the gradient to target weights.
     func = &linear;
@@ -76,79 +141,161 @@ void partial_calc_gradients(float *input, Model *model, int target_layer, int n_
     {
         func = get_activation_func(model->layers_activation[target_layer - 1]);
     }
-    specific_fc_back_prop(curr_in, gradients->net_input, model->layers_size[target_layer],
-                          func, gradients->weights, gradients->biases, n_weights);
-
-    free(curr_in);
+    PROFILE_START(backward_time);
+    const SparseWeights *sparse = modelSparseWeights(model, target_layer);
+    if (sparse != NULL)
+    {
+        specific_fc_back_prop_sparse(curr_in, gradients->net_input, model->layers_size[target_layer],
+                                     func, gradients->weights, gradients->biases, n_weights, sparse, offset);
+    }
+    else
+    {
+        specific_fc_back_prop(curr_in, gradients->net_input, model->layers_size[target_layer],
+                              func, gradients->weights, gradients->biases, n_weights);
+    }
+    PROFILE_STOP(backward_time, PROFILE_BACKWARD, target_layer, 2 * (uint64_t)n_weights * model->layers_size[target_layer], 1);
+    MEMORY_PHASE_END();
 
     return;
 }
 
-/* Apply gradients to a layer, given specific neurons*/
-void fc_apply_specific_gradients(Model *model, int layer, int layer_size, int n_weights, int offset, PartialGradients *gradients)
+/* Apply gradients to a layer, given specific neurons. Their weights are consecutive rows of the layer, one pass updates them
+    @param optimizer: update rule, NULL for sgd with LEARNING_RATE and BATCH_SIZE
+*/
+void fc_apply_specific_gradients(Model *model, int layer, int layer_size, int n_weights, int offset, PartialGradients *gradients,
+                                 Optimizer *optimizer)
 {
-    for (int i = 0; i < layer_size; i++)
+    OptimizerStep step;
+    if (optimizer_begin_step(optimizer, model, &step) != 0)
     {
-        model->layers_biases[layer][i] -= LEARNING_RATE * (gradients->biases[i] / BATCH_SIZE);
-        for (int j = 0; j < n_weights; j++)
-        {
-            // indexing for correct weight
-            model->layers_weights[layer][i + (j + offset) * layer_size] -= LEARNING_RATE * (gradients->weights[i + j * layer_size] / BATCH_SIZE);
-        }
+        return;
     }
+    optimizer_update(optimizer, &step, model->layers_biases[layer], gradients->biases, optimizer_biases_offset(optimizer, layer), layer_size);
+    // indexing for correct weight, the rows of the neurons start at offset
+    optimizer_update(optimizer, &step, model->layers_weights[layer] + offset * layer_size, gradients->weights,
+                     optimizer_weights_offset(optimizer, layer) + (size_t)offset * layer_size, n_weights * layer_size);
+    repackModelWeights(model, layer, offset, n_weights);
 }
 
-/* train a part of a layer - stated by target layer, the number of weights and the offset
-    this will result in each given neurons incomming weight being trained
-    etc. n_weights = 1 and offset =1, will result in each neurons second weight being trained
- */
-void fc_model_train_partial_layer(Model *model, float (*samples_x)[model->output_size], float (*samples_y)[model->output_size],
-                                  int target_layer, int n_weights, int offset)
+/* number of incoming weights per neuron of a layer */
+static int fc_layer_n_weights(Model *model, int layer)
 {
-    if ((target_layer == 0 && n_weights != 1 && offset != 0) || target_layer < 0 || offset < 0 || n_weights < 1)
+    return (layer == 0) ? model->input_size : model->layers_size[layer - 1];
+}
+
+/* train a part of a layer using the buffers of a training context, see fc_model_train_partial_layer */
+void fc_model_train_partial_layer_with_context(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                               int target_layer, int n_weights, int offset, TrainContext *context)
+{
+    fc_model_train_partial_layer_cached(model, samples_x, samples_y, 0, target_layer, n_weights, offset, context, NULL);
+}
+
+/* target input of a sample from the cache, computed by the frozen layers and stored on a miss */
+static float *partial_cached_target_input(Model *model, float *input, int sample, int target_layer, PartialGradients *gradients,
+                                          ActivationCache *cache)
+{
+    float *target_input = activation_cache_lookup(cache, sample);
+    if (target_input != NULL)
+    {
+        return target_input;
+    }
+    MEMORY_PHASE_BEGIN("forward");
+    target_input = partial_forward_frozen(input, model, target_layer, gradients);
+    MEMORY_PHASE_END();
+    float *stored = activation_cache_store(cache, sample, target_input);
+    return (stored != NULL) ? stored : target_input;
+}
+
+/* train a part of a layer like fc_model_train_partial_layer_with_context, reading the output of the frozen layers
+    below the target from a cache. The first step over a sample fills its entry, later steps start at the target layer.
+    @param first_sample: index of samples_x[0] in the dataset, the key of the sample in the cache
+    @param cache: activation cache for target_layer, NULL to compute every sample from the input
+*/
+void fc_model_train_partial_layer_cached(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                         int first_sample, int target_layer, int n_weights, int offset, TrainContext *context,
+                                         ActivationCache *cache)
+{
+    if (target_layer < 0 || target_layer >= model->n_layers || offset < 0 || n_weights < 1)
     {
         printf("Invalid arguments for partial layer training! \n");
         return;
     }
-    else if (n_weights + offset > model->layers_size[target_layer - 1])
+    else if (n_weights + offset > fc_layer_n_weights(model, target_layer))
     {
         printf("Invalid arguments for partial layer training! \n");
         return;
     }
 
-    PartialGradients *gradients = (PartialGradients *)allocate_partial_gradients(model, target_layer, n_weights);
+    // a compressed model trains the layer on an fp32 master copy, the other layers are only read in 16 bits
+    if (createMasterWeights(model, target_layer) != 0)
+    {
+        return;
+    }
+    if (cache != NULL && (cache->target_layer != target_layer || first_sample < 0 || first_sample + BATCH_SIZE > cache->n_samples))
+    {
+        printf("Activation cache does not match the target layer or samples! \n");
+        return;
+    }
+
+    MEMORY_PHASE_BEGIN("setup");
+    PartialGradients *gradients = train_context_partial_gradients(context, model, target_layer, n_weights);
+    zero_partial_gradients(gradients, model, target_layer, n_weights);
+    MEMORY_PHASE_END();
 
     for (int i = 0; i < BATCH_SIZE; i++)
     {
-        partial_calc_gradients(samples_x[i], model, target_layer, n_weights, offset, samples_y[i], gradients);
+        if (cache == NULL)
+        {
+            partial_calc_gradients(samples_x[i], model, target_layer, n_weights, offset, samples_y[i], gradients);
+            continue;
+        }
+        float *target_input = partial_cached_target_input(model, samples_x[i], first_sample + i, target_layer, gradients, cache);
+        partial_calc_gradients_from_target(target_input, model, target_layer, n_weights, offset, samples_y[i], gradients);
     }
 
     // apply the calculated gradient to the specific layer
-    fc_apply_specific_gradients(model, target_layer, model->layers_size[target_layer], n_weights, offset, gradients);
-    free_partial_gradients(gradients, model, target_layer);
+    MEMORY_PHASE_BEGIN("apply");
+    PROFILE_START(apply_time);
+    fc_apply_specific_gradients(model, target_layer, model->layers_size[target_layer], n_weights, offset, gradients, context->optimizer);
+    PROFILE_STOP(apply_time, PROFILE_APPLY, target_layer, 3 * (uint64_t)(n_weights + 1) * model->layers_size[target_layer],
+                 optimizer_batch_size(context->optimizer));
+    MEMORY_PHASE_END();
 }
 
-/* train a specific layer*/
-void fc_model_train_layer(Model *model, float (*samples_x)[model->output_size], float (*samples_y)[model->output_size],
-                          int target_layer)
+/* train a part of a layer - stated by target layer, the number of weights and the offset
+    this will result in each given neurons incomming weight being trained
+    etc. n_weights = 1 and offset =1, will result in each neurons second weight being trained
+ */
+void fc_model_train_partial_layer(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                  int target_layer, int n_weights, int offset)
 {
+    TrainContext *context = create_train_context();
+    fc_model_train_partial_layer_with_context(model, samples_x, samples_y, target_layer, n_weights, offset, context);
+    free_train_context(context, model);
+}
 
-    int offset = 0;
-    int n_weights;
-    if (target_layer == 0)
-    {
-        n_weights = 1;
-    }
-    else
-    {
-        n_weights = model->layers_size[target_layer - 1];
-    }
+/* train a specific layer using the buffers of a training context */
+void fc_model_train_layer_with_context(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                       int target_layer, TrainContext *context)
+{
+    fc_model_train_partial_layer_with_context(model, samples_x, samples_y, target_layer,
+                                              fc_layer_n_weights(model, target_layer), 0, context);
+}
 
-    PartialGradients *gradients = (PartialGradients *)allocate_partial_gradients(model, target_layer, n_weights);
-    for (int i = 0; i < BATCH_SIZE; i++)
-    {
-        partial_calc_gradients(samples_x[i], model, target_layer, n_weights, offset, samples_y[i], gradients);
-    }
-    fc_apply_specific_gradients(model, target_layer, model->layers_size[target_layer], n_weights, offset, gradients);
-    free_partial_gradients(gradients, model, target_layer);
-}
\ No newline at end of file
+/* train a specific layer reading the output of the frozen layers below it from a cache,
+    see fc_model_train_partial_layer_cached */
+void fc_model_train_layer_cached(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                 int first_sample, int target_layer, TrainContext *context, ActivationCache *cache)
+{
+    fc_model_train_partial_layer_cached(model, samples_x, samples_y, first_sample, target_layer,
+                                        fc_layer_n_weights(model, target_layer), 0, context, cache);
+}
+
+/* train a specific layer*/
+void fc_model_train_layer(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                          int target_layer)
+{
+    TrainContext *context = create_train_context();
+    fc_model_train_layer_with_context(model, samples_x, samples_y, target_layer, context);
+    free_train_context(context, model);
+}
@@ -2,13 +2,30 @@
 #define PARTIAL_MODEL_FC_H
 #include "../util/model_binding.h"
 #include "../util/model_gradients.h"
+#include "../util/activation_cache.h"
 
 void partial_calc_gradients(float *input, Model *model, int target_layer, int n_weights, int offset, float *actual, PartialGradients *gradients);
 
-void fc_model_train_partial_layer(Model *model, float (*samples_x)[model->output_size], float (*samples_y)[model->output_size],
+void partial_calc_gradients_from_target(float *target_input, Model *model, int target_layer, int n_weights, int offset, float *actual,
+                                        PartialGradients *gradients);
+
+void fc_model_train_partial_layer(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
                                   int target_layer, int n_neurons, int offset);
 
-void fc_model_train_layer(Model *model, float (*samples_x)[model->output_size], float (*samples_y)[model->output_size],
+void fc_model_train_layer(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
                           int target_layer);
 
+void fc_model_train_partial_layer_with_context(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                               int target_layer, int n_neurons, int offset, TrainContext *context);
+
+void fc_model_train_layer_with_context(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                       int target_layer, TrainContext *context);
+
+void fc_model_train_partial_layer_cached(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                         int first_sample, int target_layer, int n_neurons, int offset, TrainContext *context,
+                                         ActivationCache *cache);
+
+void fc_model_train_layer_cached(Model *model, float (*samples_x)[model->input_size], float (*samples_y)[model->output_size],
+                                 int first_sample, int target_layer, TrainContext *context, ActivationCache *cache);
+
 #endif
@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "score_engine.h"
+#ifdef ENABLE_THREADS
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "model_fc.h"
+#include "../util/config.h"
+
+typedef struct
+{
+    ScoreEngine *engine;
+    const float *X;
+    float *Y;
+    int n;
+} ScoreRunArgs;
+
+static double now_seconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+/* owner takes chunks from the front of its own deque */
+static int pop_chunk(ChunkDeque *deque)
+{
+    int chunk = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail)
+    {
+        chunk = deque->head++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return chunk;
+}
+
+/* thieves take chunks from the back, away from the owner */
+static int steal_chunk(ScoreEngine *engine, int thief, int n_threads)
+{
+    for (int i = 1; i < n_threads; i++)
+    {
+        ChunkDeque *deque = &engine->deques[(thief + i) % n_threads];
+        int chunk = -1;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail)
+        {
+            chunk = --deque->tail;
+        }
+        pthread_mutex_unlock(&deque->lock);
+        if (chunk >= 0)
+        {
+            return chunk;
+        }
+    }
+    return -1;
+}
+
+static void score_chunks(void *args, int thread_id, int n_threads)
+{
+    ScoreRunArgs *run = (ScoreRunArgs *)args;
+    ScoreEngine *engine = run->engine;
+    Model *model = engine->model;
+    int stolen = 0;
+
+    while (1)
+    {
+        int chunk = pop_chunk(&engine->deques[thread_id]);
+        if (chunk < 0)
+        {
+            // no new chunks are ever queued, so once every deque is empty we are done
+            chunk = steal_chunk(engine, thread_id, n_threads);
+            if (chunk < 0)
+            {
+                break;
+            }
+            stolen++;
+        }
+
+        int row = chunk * engine->chunk_rows;
+        int rows = (run->n - row < engine->chunk_rows) ? run->n - row : engine->chunk_rows;
+        double start = now_seconds();
+        fc_model_predict_batch_scratch(model, run->X + row * model->input_size, rows,
+                                       run->Y + row * model->output_size, engine->scratch[thread_id]);
+        engine->chunk_latency[chunk] = now_seconds() - start;
+    }
+
+    engine->deques[thread_id].stolen = stolen;
+}
+
+/* Creates an engine scoring chunks of chunk_rows rows on the threads of pool */
+ScoreEngine *create_score_engine(Model *model, ThreadPool *pool, int chunk_rows)
+{
+    if (chunk_rows < 1)
+    {
+        printf("Invalid chunk size for score engine! \n");
+        return NULL;
+    }
+    ScoreEngine *engine = (ScoreEngine *)malloc(sizeof(ScoreEngine));
+    engine->model = model;
+    engine->pool = pool;
+    engine->chunk_rows = chunk_rows;
+    engine->chunk_latency = NULL;
+    engine->latency_capacity = 0;
+    engine->scratch = (float **)malloc(pool->n_threads * sizeof(float *));
+    engine->deques = (ChunkDeque *)malloc(pool->n_threads * sizeof(ChunkDeque));
+
+    int scratch_size = fc_model_batch_scratch_size(model);
+    for (int t = 0; t < pool->n_threads; t++)
+    {
+        // a single layer model needs no scratch, keep a valid allocation anyway
+        engine->scratch[t] = (float *)malloc((scratch_size > 0 ? scratch_size : 1) * sizeof(float));
+        pthread_mutex_init(&engine->deques[t].lock, NULL);
+    }
+    return engine;
+}
+
+/* Scores n rows of X into Y and fills stats with throughput and per-chunk latency */
+void score_engine_run(ScoreEngine *engine, const float *X, int n, float *Y, ScoreStats *stats)
+{
+    int n_threads = engine->pool->n_threads;
+    int n_chunks = (n + engine->chunk_rows - 1) / engine->chunk_rows;
+
+    if (n_chunks > engine->latency_capacity)
+    {
+        if (engine->chunk_latency != NULL)
+        {
+            free(engine->chunk_latency);
+        }
+        engine->chunk_latency = (double *)malloc(n_chunks * sizeof(double));
+        engine->latency_capacity = n_chunks;
+    }
+
+    // deal contiguous ranges of chunks to the threads
+    for (int t = 0; t < n_threads; t++)
+    {
+        engine->deques[t].head = n_chunks * t / n_threads;
+        engine->deques[t].tail = n_chunks * (t + 1) / n_threads;
+        engine->deques[t].stolen = 0;
+    }
+
+    ScoreRunArgs run = {engine, X, Y, n};
+    double start = now_seconds();
+    thread_pool_run(engine->pool, score_chunks, &run);
+    double seconds = now_seconds() - start;
+
+    stats->n_rows = n;
+    stats->n_chunks = n_chunks;
+    stats->seconds = seconds;
+    stats->rows_per_sec = (seconds > 0) ? n / seconds : 0;
+    stats->chunk_latency = engine->chunk_latency;
+    stats->stolen_chunks = 0;
+    for (int t = 0; t < n_threads; t++)
+    {
+        stats->stolen_chunks += engine->deques[t].stolen;
+    }
+
+    stats->min_chunk_latency = 0;
+    stats->mean_chunk_latency = 0;
+    stats->max_chunk_latency = 0;
+    for (int c = 0; c < n_chunks; c++)
+    {
+        double latency = engine->chunk_latency[c];
+        if (c == 0 || latency < stats->min_chunk_latency)
+        {
+            stats->min_chunk_latency = latency;
+        }
+        if (latency > stats->max_chunk_latency)
+        {
+            stats->max_chunk_latency = latency;
+        }
+        stats->mean_chunk_latency += latency;
+    }
+    if (n_chunks > 0)
+    {
+        stats->mean_chunk_latency /= n_chunks;
+    }
+}
+
+void print_score_stats(ScoreStats *stats)
+{
+    printf("Scored rows: %d in %d chunks (%d stolen)\n", stats->n_rows, stats->n_chunks, stats->stolen_chunks);
+    printf("Throughput: %.0f rows/sec\n", stats->rows_per_sec);
+    printf("Chunk latency: min %.3f us, mean %.3f us, max %.3f us\n", stats->min_chunk_latency * 1e6,
+           stats->mean_chunk_latency * 1e6, stats->max_chunk_latency * 1e6);
+}
+
+void free_score_engine(ScoreEngine *engine)
+{
+    for (int t = 0; t < engine->pool->n_threads; t++)
+    {
+        free(engine->scratch[t]);
+        pthread_mutex_destroy(&engine->deques[t].lock);
+    }
+    if (engine->chunk_latency != NULL)
+    {
+        free(engine->chunk_latency);
+    }
+    free(engine->scratch);
+    free(engine->deques);
+    free(engine);
+}
+#endif
@@ -0,0 +1,48 @@
+#ifndef SCORE_ENGINE_H
+#define SCORE_ENGINE_H
+#include "../util/model_binding.h"
+#include "../util/thread_pool.h"
+
+#ifdef ENABLE_THREADS
+/* Parallel batched inference for offline scoring of large inputs.
+    The rows are split into chunks that are dealt out to per-thread deques, threads that run out
+    of work steal chunks from the back of the other deques. The model weights are shared read-only. */
+typedef struct
+{
+    pthread_mutex_t lock;
+    int head;   // next chunk for the owner
+    int tail;   // one past the last chunk, thieves take from here
+    int stolen; // chunks the owner stole from other deques during the last run
+} ChunkDeque;
+
+typedef struct
+{
+    int n_rows;
+    int n_chunks;
+    double seconds;
+    double rows_per_sec;
+    double *chunk_latency; // seconds per chunk, valid until the next run
+    double min_chunk_latency;
+    double mean_chunk_latency;
+    double max_chunk_latency;
+    int stolen_chunks;
+} ScoreStats;
+
+typedef struct
+{
+    Model *model;
+    ThreadPool *pool;
+    int chunk_rows;
+    float **scratch;      // per thread, fc_model_batch_scratch_size(model) floats
+    ChunkDeque *deques;   // per thread
+    double *chunk_latency;
+    int latency_capacity; // chunks chunk_latency has room for
+} ScoreEngine;
+
+ScoreEngine *create_score_engine(Model *model, ThreadPool *pool, int chunk_rows);
+void score_engine_run(ScoreEngine *engine, const float *X, int n, float *Y, ScoreStats *stats);
+void print_score_stats(ScoreStats *stats);
+void free_score_engine(ScoreEngine *engine);
+#endif
+
+#endif
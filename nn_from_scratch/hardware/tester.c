@@ -3,11 +3,23 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "include/nn_from_scratch.h"
+#include "util/kernels.h"
+#include "util/forward_prop.h"
+#include "util/loss_functions.h"
+#include "util/model_file.h"
+#include "src/score_engine.h"
 #include "model/simple_model.h"
 #include "data/eqcheck_data.h"
 #include "data/ft_data.h"
 #include "data/true_data.h"
+#ifdef ENABLE_SPECIALIZED_MODEL
+#include "model/model_specialized.h"
+#endif
+#ifdef ENABLE_QUANTIZED_MODEL
+#include "model/model_q.h"
+#endif
 void compare_true(Model *model)
 {
 
@@ -28,27 +40,1522 @@ void compare_true(Model *model)
     printf("MSE error: %f \n", sum / FT_N_SAMPLES);
 }
 
+#ifdef ENABLE_THREADS
+/* Same as compare_true, but scoring all samples at once on a thread pool */
+void compare_true_parallel(Model *model, int n_threads)
+{
+    ThreadPool *pool = create_thread_pool(n_threads);
+    ScoreEngine *engine = create_score_engine(model, pool, 64);
+    float *outputs = (float *)malloc(FT_N_SAMPLES * OUTPUT_SIZE * sizeof(float));
+    ScoreStats stats;
+    score_engine_run(engine, &ft_samples_x[0][0], FT_N_SAMPLES, outputs, &stats);
+
+    float sum = 0;
+    for (int i = 0; i < FT_N_SAMPLES; i++)
+    {
+        for (int j = 0; j < OUTPUT_SIZE; j++)
+        {
+            float t = (outputs[i * OUTPUT_SIZE + j] - ft_samples_y[i][j]);
+            t *= t;
+            sum += t;
+        }
+    }
+    printf("MSE error: %f \n", sum / FT_N_SAMPLES);
+    print_score_stats(&stats);
+
+    free(outputs);
+    free_score_engine(engine);
+    free_thread_pool(pool);
+}
+#endif
+
+/* compares a prediction to the expected output of an eqcheck sample
+    @return 0 if every output is within tolerance, -1 otherwise */
+int eqcheck_sample(const char *name, int sample, const float *output, float tolerance)
+{
+    for (int j = 0; j < OUTPUT_SIZE; j++)
+    {
+        if (fabs(output[j] - eqcheck_samples_y[sample][j]) > tolerance)
+        {
+            printf("FAILED: %s for sample, expected: %f but predicted: %f\n", name, eqcheck_samples_y[sample][j], output[j]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Copy of a model with its own flat parameters, which can be trained without changing the model */
+Model *copy_tester_model(Model *model)
+{
+    Model *copy = createAndSetModel(model->n_layers, model->input_size, model->output_size, model->layers_size,
+                                    model->layers_weights, model->layers_biases, model->layers_activation);
+    flattenModel(copy);
+    return copy;
+}
+
+/* Copy of a model with separate layers, whose weights and biases are copied into memory of modelParamsSize floats
+    @param layers_weights, layers_biases: pointer arrays of n_layers entries for the copy, they must outlive it */
+Model *copy_tester_layers(Model *model, float *memory, float **layers_weights, float **layers_biases)
+{
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        layers_weights[i] = memory;
+        memcpy(memory, model->layers_weights[i], size * model->layers_size[i] * sizeof(float));
+        memory += size * model->layers_size[i];
+        layers_biases[i] = memory;
+        memcpy(memory, model->layers_biases[i], model->layers_size[i] * sizeof(float));
+        memory += model->layers_size[i];
+        size = model->layers_size[i];
+    }
+    return createAndSetModel(model->n_layers, model->input_size, model->output_size, model->layers_size, layers_weights,
+                             layers_biases, model->layers_activation);
+}
+
+/* compares the predictions of a model on the eqcheck inputs to the ones of a reference model
+    @param name: check reported on a mismatch
+    @param stage: what was done to both models before, e.g. "after training"
+    @return 0 if every output is within tolerance, -1 otherwise */
+int eqcheck_models(const char *name, const char *stage, Model *reference, Model *model, float tolerance)
+{
+    float outputs[2][EQCHECK_N_SAMPLES * OUTPUT_SIZE];
+    fc_model_predict_batch(reference, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[0]);
+    fc_model_predict_batch(model, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[1]);
+    for (int i = 0; i < EQCHECK_N_SAMPLES * OUTPUT_SIZE; i++)
+    {
+        if (fabs(outputs[0][i] - outputs[1][i]) > tolerance)
+        {
+            printf("FAILED: %s eqcheck %s, expected: %f but predicted: %f\n", name, stage, outputs[0][i], outputs[1][i]);
+            return -1;
+        }
+    }
+    return 0;
+}
 void eqcheck(Model *model)
 {
-    printf("start eqcheck..\n");
+    printf("start eqcheck..\n");
+
+    for (int i = 0; i < EQCHECK_N_SAMPLES; i++)
+    {
+        float *input = eqcheck_samples_x[i];
+        float *output = fc_model_predict(model, input);
+        eqcheck_sample("eqcheck", i, output, 0.0001);
+        free(output);
+    }
+    printf("eqcheck completed! \n");
+}
+/* Checks the int8 model, calibrated on the eqcheck inputs, against the float model it was quantized from
+    within QUANT_EQCHECK_TOLERANCE */
+void eqcheck_quantized(Model *model)
+{
+    printf("start quantized eqcheck..\n");
+    QuantizedModel *quantized = quantizeModel(model, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES);
+    if (quantized == NULL)
+    {
+        printf("FAILED: could not quantize the model\n");
+        return;
+    }
+    float output[OUTPUT_SIZE];
+    float max_error = 0;
+    int n_failed = 0;
+    for (int i = 0; i < EQCHECK_N_SAMPLES; i++)
+    {
+        float *expected = fc_model_predict(model, eqcheck_samples_x[i]);
+        fc_model_predict_quantized(quantized, eqcheck_samples_x[i], output);
+        int failed = 0;
+        for (int j = 0; j < OUTPUT_SIZE; j++)
+        {
+            float error = fabs(output[j] - expected[j]);
+            max_error = (error > max_error) ? error : max_error;
+            if (error > QUANT_EQCHECK_TOLERANCE && !failed)
+            {
+                printf("FAILED: quantized eqcheck for sample, expected: %f but predicted: %f\n", expected[j], output[j]);
+                failed = 1;
+            }
+        }
+        n_failed += failed;
+        free(expected);
+    }
+    printf("quantized max error: %f, %d of %d samples out of tolerance, parameters: %zu bytes instead of %zu \n", max_error,
+           n_failed, EQCHECK_N_SAMPLES, quantizedModelParamsBytes(quantized), modelParamsSize(model) * sizeof(float));
+    freeQuantizedModel(quantized);
+    printf("quantized eqcheck completed! \n");
+}
+#ifdef ENABLE_QUANTIZED_MODEL
+/* Checks the int8 arrays generated by model_converter.py --quantize, calibrated on the eqcheck data, against
+    quantizeModel. The weights and their scales are computed alike and must match exactly. The input scales come from
+    the float model run in numpy, whose sums may round differently, so they and the biases derived from them may
+    differ in the last bit. */
+void eqcheck_generated_quantized(Model *model)
+{
+    printf("start generated quantized eqcheck..\n");
+    QuantizedModel *generated = createAndSetQuantizedModel(N_LAYERS, INPUT_SIZE, OUTPUT_SIZE, layers_size, q_layers_weights,
+                                                           q_layers_weight_scales, q_layers_biases, q_layers_input_scale,
+                                                           layers_activation);
+    QuantizedModel *quantized = quantizeModel(model, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES);
+    if (generated == NULL || quantized == NULL)
+    {
+        printf("FAILED: could not create the quantized models\n");
+        if (generated != NULL)
+        {
+            freeQuantizedModel(generated);
+        }
+        if (quantized != NULL)
+        {
+            freeQuantizedModel(quantized);
+        }
+        return;
+    }
+    int input_size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        float input_scale = quantized->layers_input_scale[i];
+        if (fabs(generated->layers_input_scale[i] - input_scale) > 0.00001 * input_scale)
+        {
+            printf("FAILED: generated input scale of layer %d, expected: %g but got: %g\n", i, input_scale,
+                   generated->layers_input_scale[i]);
+        }
+        for (int o = 0; o < model->layers_size[i]; o++)
+        {
+            int32_t bias_error = generated->layers_biases[i][o] - quantized->layers_biases[i][o];
+            if (generated->layers_weight_scales[i][o] != quantized->layers_weight_scales[i][o] || bias_error > 1 || bias_error < -1 ||
+                memcmp(generated->layers_weights[i] + o * input_size, quantized->layers_weights[i] + o * input_size, input_size) != 0)
+            {
+                printf("FAILED: generated quantized layer %d, output %d differs from quantizeModel\n", i, o);
+            }
+        }
+        input_size = model->layers_size[i];
+    }
+
+    float output[OUTPUT_SIZE];
+    float expected[OUTPUT_SIZE];
+    for (int i = 0; i < EQCHECK_N_SAMPLES; i++)
+    {
+        fc_model_predict_quantized(quantized, eqcheck_samples_x[i], expected);
+        fc_model_predict_quantized(generated, eqcheck_samples_x[i], output);
+        for (int j = 0; j < OUTPUT_SIZE; j++)
+        {
+            // biases off by one move the outputs far less than the tolerance
+            if (fabs(output[j] - expected[j]) > QUANT_EQCHECK_TOLERANCE)
+            {
+                printf("FAILED: generated quantized eqcheck, expected: %f but predicted: %f\n", expected[j], output[j]);
+                break;
+            }
+        }
+        eqcheck_sample("generated quantized eqcheck", i, output, QUANT_EQCHECK_TOLERANCE);
+    }
+    freeQuantizedModel(generated);
+    freeQuantizedModel(quantized);
+    printf("generated quantized eqcheck completed! \n");
+}
+#endif
+/* Checks that batched prediction agrees with per-sample prediction on the eqcheck data */
+void eqcheck_batch(Model *model)
+{
+    printf("start batch eqcheck..\n");
+    float *outputs = (float *)malloc(EQCHECK_N_SAMPLES * OUTPUT_SIZE * sizeof(float));
+    fc_model_predict_batch(model, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs);
+
+    for (int i = 0; i < EQCHECK_N_SAMPLES; i++)
+    {
+        float *output = fc_model_predict(model, eqcheck_samples_x[i]);
+        float tolerance = 0.0001;
+        for (int j = 0; j < OUTPUT_SIZE; j++)
+        {
+            if (fabs(output[j] - outputs[i * OUTPUT_SIZE + j]) > tolerance)
+            {
+                printf("FAILED: batch eqcheck for sample, expected: %f but predicted: %f\n", output[j], outputs[i * OUTPUT_SIZE + j]);
+                break;
+            }
+        }
+        free(output);
+    }
+    free(outputs);
+    printf("batch eqcheck completed! \n");
+}
+/* Checks that prediction through a preplanned arena agrees with per-sample prediction */
+void eqcheck_plan(Model *model)
+{
+    printf("start plan eqcheck..\n");
+    InferencePlan *plan = createInferencePlan(model);
+    printf("Inference plan footprint: %zu bytes\n", inferencePlanBytes(plan));
+    float outputs[OUTPUT_SIZE];
+
+    for (int i = 0; i < EQCHECK_N_SAMPLES; i++)
+    {
+        float *output = fc_model_predict(model, eqcheck_samples_x[i]);
+        fc_model_predict_plan(plan, eqcheck_samples_x[i], outputs);
+        float tolerance = 0.0001;
+        for (int j = 0; j < OUTPUT_SIZE; j++)
+        {
+            if (fabs(output[j] - outputs[j]) > tolerance)
+            {
+                printf("FAILED: plan eqcheck for sample, expected: %f but predicted: %f\n", output[j], outputs[j]);
+                break;
+            }
+        }
+        free(output);
+    }
+    freeInferencePlan(plan);
+    printf("plan eqcheck completed! \n");
+}
+/* Checks that a flattened copy of the model predicts and trains like a copy with separate layers */
+void eqcheck_flat(Model *model)
+{
+    printf("start flat eqcheck..\n");
+    float *layers_memory = (float *)malloc(modelParamsSize(model) * sizeof(float));
+    float *layers_weights[model->n_layers];
+    float *layers_biases[model->n_layers];
+    Model *layers = copy_tester_layers(model, layers_memory, layers_weights, layers_biases);
+    Model *flat = copy_tester_model(model);
+    printf("Flat parameter buffer: %d floats\n", flat->n_params);
+    eqcheck_models("flat", "before training", layers, flat, 0);
+    fc_model_train(layers, ft_samples_x, ft_samples_y);
+    fc_model_train(flat, ft_samples_x, ft_samples_y);
+    eqcheck_models("flat", "after training", layers, flat, 0);
+    freeModel(layers);
+    freeModel(flat);
+    free(layers_memory);
+    printf("flat eqcheck completed! \n");
+}
+/* compares a packed model to an unpacked copy, before and after training keeps the panels in sync */
+void eqcheck_packed(Model *model)
+{
+    printf("start packed eqcheck..\n");
+    Model *copies[2] = {copy_tester_model(model), copy_tester_model(model)};
+    Model *plain = copies[0];
+    Model *packed = copies[1];
+    packModel(packed);
+
+    for (int round = 0; round < 2; round++)
+    {
+        if (round == 1)
+        {
+            for (int m = 0; m < 2; m++)
+            {
+                fc_model_train(copies[m], ft_samples_x, ft_samples_y);
+                fc_model_train_layer(copies[m], ft_samples_x, ft_samples_y, 0);
+                fc_model_train_partial_layer(copies[m], ft_samples_x, ft_samples_y, 1, 2, 2);
+            }
+        }
+        eqcheck_models("packed", round ? "after training" : "before training", plain, packed, 0.0001);
+    }
+    freeModel(plain);
+    freeModel(packed);
+    printf("packed eqcheck completed! \n");
+}
+
+/* Checks a model with 16-bit weights against a float model holding the same rounded weights, before and after
+    training a layer on an fp32 master copy, and after the master copy is rounded back to 16 bits */
+void eqcheck_half(Model *model)
+{
+    printf("start 16-bit weights eqcheck..\n");
+    const char *names[N_HALF_FORMATS] = {"bf16", "fp16"};
+    float rounding_tolerance[N_HALF_FORMATS] = {0.05, 0.005};
+    for (int format = 0; format < N_HALF_FORMATS; format++)
+    {
+        Model *reference = copy_tester_model(model);
+        // only a model with separate weights can be compressed, compressing copies them out of the model
+        Model *half = createAndSetModel(model->n_layers, model->input_size, model->output_size, model->layers_size,
+                                        model->layers_weights, model->layers_biases, model->layers_activation);
+        size_t float_bytes = modelWeightsBytes(reference);
+        compressModelWeights(half, (enum HalfFormat)format);
+        int size = model->input_size;
+        for (int i = 0; i < model->n_layers; i++)
+        {
+            // the reference holds the rounded weights in float
+            convert_from_half(reference->layers_weights[i], half->layers_weights_half[i], size * model->layers_size[i],
+                              (enum HalfFormat)format);
+            size = model->layers_size[i];
+        }
+        printf("%s weights: %zu bytes instead of %zu\n", names[format], modelWeightsBytes(half), float_bytes);
+
+        for (int round = 0; round < 3; round++)
+        {
+            if (round == 1)
+            {
+                fc_model_train_layer(reference, ft_samples_x, ft_samples_y, 0);
+                fc_model_train_layer(half, ft_samples_x, ft_samples_y, 0);
+                fc_model_train_partial_layer(reference, ft_samples_x, ft_samples_y, 1, 2, 2);
+                fc_model_train_partial_layer(half, ft_samples_x, ft_samples_y, 1, 2, 2);
+            }
+            else if (round == 2)
+            {
+                // the 16-bit weights of the trained layers follow their master copies
+                uint16_t rounded[1];
+                int size = model->input_size;
+                for (int i = 0; i < 2; i++)
+                {
+                    for (int j = 0; j < size * model->layers_size[i]; j++)
+                    {
+                        convert_to_half(rounded, half->layers_weights[i] + j, 1, (enum HalfFormat)format);
+                        if (rounded[0] != half->layers_weights_half[i][j])
+                        {
+                            printf("FAILED: %s weights of layer %d are out of sync with the master copy\n", names[format], i);
+                            break;
+                        }
+                    }
+                    size = model->layers_size[i];
+                }
+                freeMasterWeights(half);
+                // an uncompressed model keeps its weights, they are not master copies
+                freeMasterWeights(reference);
+                if (reference->layers_weights[0] == NULL)
+                {
+                    printf("FAILED: %s eqcheck, the weights of an uncompressed model were freed\n", names[format]);
+                }
+            }
+            const char *stage[3] = {"before training", "after training", "after rounding the master weights"};
+            eqcheck_models(names[format], stage[round], reference, half, (round == 2) ? rounding_tolerance[format] : 0.0001);
+        }
+        freeModel(reference);
+        freeModel(half);
+    }
+    printf("16-bit weights eqcheck completed! \n");
+}
+
+#define DEEP_N_LAYERS 7
+/* A deeper model than the test model, with its input and output size and fixed weights, for checkpointing and
+    layer sizes the test model does not have. layers_size and layers_activation must outlive it */
+Model *create_deep_model(Model *model, int *layers_size, enum ActivationType *layers_activation)
+{
+    int widths[DEEP_N_LAYERS - 1] = {6, 5, 7, 6, 5, 4};
+    float *layers_weights[DEEP_N_LAYERS];
+    float *layers_biases[DEEP_N_LAYERS];
+    int n_floats = 0;
+    int size = model->input_size;
+    for (int i = 0; i < DEEP_N_LAYERS; i++)
+    {
+        layers_size[i] = (i < DEEP_N_LAYERS - 1) ? widths[i] : model->output_size;
+        layers_activation[i] = (i < DEEP_N_LAYERS - 1) ? RELU : model->layers_activation[model->n_layers - 1];
+        n_floats += (size + 1) * layers_size[i];
+        size = layers_size[i];
+    }
+    float *memory = (float *)malloc(n_floats * sizeof(float));
+    float *next = memory;
+    size = model->input_size;
+    for (int i = 0; i < DEEP_N_LAYERS; i++)
+    {
+        layers_weights[i] = next;
+        layers_biases[i] = next + size * layers_size[i];
+        for (int j = 0; j < (size + 1) * layers_size[i]; j++)
+        {
+            next[j] = 0.8f * sinf(1.3f * j + i) / sqrtf((float)size);
+        }
+        next += (size + 1) * layers_size[i];
+        size = layers_size[i];
+    }
+    Model *deep = createAndSetModel(DEEP_N_LAYERS, model->input_size, model->output_size, layers_size, layers_weights,
+                                    layers_biases, layers_activation);
+    flattenModel(deep);
+    free(memory);
+    return deep;
+}
+
+/* zeroes 3 of every 4 weights of a model
+    @return a density that makes every pruned layer sparse, halfway between the weights the densest layer keeps
+    and one more, since a layer whose size is not a multiple of 4 keeps more than a quarter */
+float prune_tester_weights(Model *model)
+{
+    float max_density = 0;
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        int n = size * model->layers_size[i];
+        for (int j = 0; j < n; j++)
+        {
+            if (j % 4 != 0)
+            {
+                model->layers_weights[i][j] = 0;
+            }
+        }
+        float density = ((n + 3) / 4 + 0.5f) / n;
+        max_density = (density > max_density) ? density : max_density;
+        size = model->layers_size[i];
+    }
+    return max_density;
+}
+
+/* Prunes 3 of every 4 weights of a copy of a model and checks that its sparse layers predict and train like the
+    dense pruned copy, and that the pruned weights stay zero */
+static void eqcheck_sparse_model(Model *model, const char *name)
+{
+    Model *dense = copy_tester_model(model);
+    Model *sparse = copy_tester_model(model);
+    prune_tester_weights(dense);
+    float max_density = prune_tester_weights(sparse);
+    if (sparsifyModelLayer(model, 0, SPARSE_MAX_DENSITY) != 0)
+    {
+        printf("FAILED: %s, a dense layer was made sparse\n", name);
+    }
+    densifyModel(model);
+    if (sparsifyModel(sparse, max_density) != model->n_layers)
+    {
+        printf("FAILED: %s, pruned layers were not made sparse\n", name);
+    }
+
+    for (int round = 0; round < 3; round++)
+    {
+        // the dense model also trains its pruned weights, pruning it again after each step gives the sparse update
+        if (round == 1)
+        {
+            fc_model_train(dense, ft_samples_x, ft_samples_y);
+            fc_model_train(sparse, ft_samples_x, ft_samples_y);
+            prune_tester_weights(dense);
+        }
+        else if (round == 2)
+        {
+            fc_model_train_layer(dense, ft_samples_x, ft_samples_y, 0);
+            fc_model_train_layer(sparse, ft_samples_x, ft_samples_y, 0);
+            prune_tester_weights(dense);
+            fc_model_train_partial_layer(dense, ft_samples_x, ft_samples_y, 1, 2, 2);
+            fc_model_train_partial_layer(sparse, ft_samples_x, ft_samples_y, 1, 2, 2);
+            prune_tester_weights(dense);
+        }
+        const char *stage[3] = {"before training", "after training", "after partial training"};
+        eqcheck_models(name, stage[round], dense, sparse, 0.0001);
+    }
+    float *expected = fc_model_predict(dense, eqcheck_samples_x[0]);
+    float *output = fc_model_predict(sparse, eqcheck_samples_x[0]);
+    for (int j = 0; j < OUTPUT_SIZE; j++)
+    {
+        if (fabs(output[j] - expected[j]) > 0.0001)
+        {
+            printf("FAILED: %s single sample, expected: %f but predicted: %f\n", name, expected[j], output[j]);
+            break;
+        }
+    }
+    free(expected);
+    free(output);
+
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        const SparseWeights *weights = modelSparseWeights(sparse, i);
+        for (int j = 0; j < size * model->layers_size[i]; j++)
+        {
+            if (j % 4 != 0 && sparse->layers_weights[i][j] != 0)
+            {
+                printf("FAILED: %s, pruned weight %d of layer %d was trained\n", name, j, i);
+                break;
+            }
+        }
+        int in_sync = 1;
+        for (int k = 0; weights != NULL && k < size; k++)
+        {
+            for (int n = weights->row_start[k]; n < weights->row_start[k + 1]; n++)
+            {
+                in_sync &= (weights->values[n] == sparse->layers_weights[i][k * model->layers_size[i] + weights->columns[n]]);
+            }
+        }
+        if (!in_sync)
+        {
+            printf("FAILED: %s, sparse weights of layer %d are out of sync\n", name, i);
+        }
+        size = model->layers_size[i];
+    }
+    freeModel(dense);
+    freeModel(sparse);
+}
+
+/* Checks sparse layers on the test model, and on the deeper model whose layer sizes are not all multiples of 4 */
+void eqcheck_sparse(Model *model)
+{
+    printf("start sparse eqcheck..\n");
+    eqcheck_sparse_model(model, "sparse");
+    int layers_size[DEEP_N_LAYERS];
+    enum ActivationType layers_activation[DEEP_N_LAYERS];
+    Model *deep = create_deep_model(model, layers_size, layers_activation);
+    eqcheck_sparse_model(deep, "deep sparse");
+    freeModel(deep);
+    printf("sparse eqcheck completed! \n");
+}
+
+/* Checks the update rules of the optimizers, and that every optimizer trains a flat model like one with separate layers */
+void eqcheck_optimizer(Model *model)
+{
+    printf("start optimizer eqcheck..\n");
+    // the first adam step moves every parameter by the learning rate against the sign of its gradient,
+    // two momentum steps with the same gradient by (2 + momentum) plain steps
+    float g[4] = {1, -3, 0.5f, -0.01f};
+    float p[2][4] = {{0, 0, 0, 0}, {0, 0, 0, 0}};
+    Optimizer *adam = create_optimizer(OPTIMIZER_ADAM, 0.01f, 2);
+    Optimizer *momentum = create_optimizer(OPTIMIZER_SGD_MOMENTUM, 0.01f, 2);
+    OptimizerStep step;
+    optimizer_begin_step(adam, model, &step);
+    optimizer_update(adam, &step, p[0], g, 0, 4);
+    for (int s = 0; s < 2; s++)
+    {
+        optimizer_begin_step(momentum, model, &step);
+        optimizer_update(momentum, &step, p[1], g, 0, 4);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        float expected[2] = {(g[i] > 0) ? -0.01f : 0.01f, -0.01f * (2 + SGD_MOMENTUM) * g[i] / 2};
+        for (int o = 0; o < 2; o++)
+        {
+            if (fabs(p[o][i] - expected[o]) > 0.00001)
+            {
+                printf("FAILED: %s step, expected: %f but got: %f\n", (o == 0) ? "adam" : "momentum", expected[o], p[o][i]);
+            }
+        }
+    }
+    Model *other = createAndSetModel(model->n_layers, model->input_size, model->output_size, model->layers_size,
+                                     model->layers_weights, model->layers_biases, model->layers_activation);
+    if (optimizer_begin_step(adam, other, &step) == 0)
+    {
+        printf("FAILED: optimizer state was used for another model\n");
+    }
+    freeModel(other);
+    free_optimizer(adam);
+    free_optimizer(momentum);
+
+    // sgd with the compile-time settings, then every optimizer on a flat and a separate model, which trains copies of the layers
+    float *layers_memory = (float *)malloc(modelParamsSize(model) * sizeof(float));
+    float *layers_weights[model->n_layers];
+    float *layers_biases[model->n_layers];
+    for (int type = -1; type <= OPTIMIZER_ADAMW; type++)
+    {
+        Model *models[2] = {copy_tester_model(model), copy_tester_layers(model, layers_memory, layers_weights, layers_biases)};
+        TrainContext *contexts[2];
+        contexts[0] = create_train_context();
+        contexts[1] = create_train_context();
+        if (type < 0)
+        {
+            flattenModel(models[1]);
+            contexts[1]->optimizer = create_optimizer(OPTIMIZER_SGD, LEARNING_RATE, BATCH_SIZE);
+        }
+        else
+        {
+            contexts[0]->optimizer = create_optimizer((enum OptimizerType)type, 0.01f, BATCH_SIZE);
+            contexts[1]->optimizer = create_optimizer((enum OptimizerType)type, 0.01f, BATCH_SIZE);
+        }
+        for (int s = 0; s < 3; s++)
+        {
+            for (int c = 0; c < 2; c++)
+            {
+                fc_model_train_with_context(models[c], ft_samples_x, ft_samples_y, contexts[c]);
+                fc_model_train_partial_layer_with_context(models[c], ft_samples_x, ft_samples_y, 1, 2, 2, contexts[c]);
+            }
+        }
+
+        float outputs[2][EQCHECK_N_SAMPLES * OUTPUT_SIZE];
+        fc_model_predict_batch(models[0], &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[0]);
+        fc_model_predict_batch(models[1], &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[1]);
+        for (int i = 0; i < EQCHECK_N_SAMPLES * OUTPUT_SIZE; i++)
+        {
+            // the update of a parameter does not depend on the pass it is in, the layouts train alike up to fma contraction
+            if (fabs(outputs[0][i] - outputs[1][i]) > 0.000001)
+            {
+                printf("FAILED: optimizer %d eqcheck, expected: %f but predicted: %f\n", type, outputs[0][i], outputs[1][i]);
+                break;
+            }
+        }
+        for (int c = 0; c < 2; c++)
+        {
+            if (contexts[c]->optimizer != NULL)
+            {
+                free_optimizer(contexts[c]->optimizer);
+            }
+            free_train_context(contexts[c], models[c]);
+            freeModel(models[c]);
+        }
+    }
+    free(layers_memory);
+    printf("optimizer eqcheck completed! \n");
+}
+
+/* Checks the learning rate schedules, that fitting with the default config trains like stepping through the batches,
+    that a shuffle seed gives the same run every time and that early stopping and max_steps end the run */
+void eqcheck_fit(Model *model)
+{
+    printf("start fit eqcheck..\n");
+    TrainConfig config = default_train_config();
+    config.learning_rate = 0.1f;
+    config.warmup_steps = 2;
+    config.schedule = LR_STEP_DECAY;
+    config.decay_rate = 0.5f;
+    config.decay_steps = 3;
+    float step_decay[2] = {train_config_learning_rate(&config, 0, 10), train_config_learning_rate(&config, 8, 10)};
+    config.schedule = LR_COSINE;
+    config.min_learning_rate = 0.02f;
+    float cosine[2] = {train_config_learning_rate(&config, 2, 10), train_config_learning_rate(&config, 9, 10)};
+    float expected[4] = {0.05f, 0.025f, 0.1f, 0.02f};
+    float rates[4] = {step_decay[0], step_decay[1], cosine[0], cosine[1]};
+    for (int i = 0; i < 4; i++)
+    {
+        if (fabs(rates[i] - expected[i]) > 0.000001)
+        {
+            printf("FAILED: learning rate schedule, expected: %f but got: %f\n", expected[i], rates[i]);
+        }
+    }
+
+    // 0: stepped through the batches, 1: fitted with the default config, 2 and 3: shuffled with the same seed,
+    // 4: shuffled with a cosine schedule and 5: stepped through the batches of the same order with the same learning rates
+    int n_samples = FT_N_SAMPLES / BATCH_SIZE * BATCH_SIZE;
+    Model *models[6];
+    TrainContext *context = create_train_context();
+    for (int m = 0; m < 6; m++)
+    {
+        models[m] = copy_tester_model(model);
+    }
+    for (int e = 0; e < 2; e++)
+    {
+        for (int i = 0; i < n_samples; i += BATCH_SIZE)
+        {
+            fc_model_train_with_context(models[0], ft_samples_x + i, ft_samples_y + i, context);
+        }
+    }
+    config = default_train_config();
+    config.n_epochs = 2;
+    FitStats stats;
+    int steps = fc_model_fit(models[1], ft_samples_x, ft_samples_y, n_samples, &config, context, &stats);
+    if (steps != 2 * n_samples / BATCH_SIZE || stats.epochs != 2)
+    {
+        printf("FAILED: fit took %d steps in %d epochs\n", steps, stats.epochs);
+    }
+    config.shuffle_seed = 42;
+    config.schedule = LR_COSINE;
+    config.min_learning_rate = LEARNING_RATE / 10;
+    fc_model_fit(models[4], ft_samples_x, ft_samples_y, n_samples, &config, context, NULL);
+    config.batch_size = 16;
+    fc_model_fit(models[2], ft_samples_x, ft_samples_y, FT_N_SAMPLES, &config, context, NULL);
+    fc_model_fit(models[3], ft_samples_x, ft_samples_y, FT_N_SAMPLES, &config, context, NULL);
+
+    config.batch_size = BATCH_SIZE;
+    int order[FT_N_SAMPLES];
+    float (*shuffled_x)[INPUT_SIZE] = (float (*)[INPUT_SIZE])malloc(n_samples * INPUT_SIZE * sizeof(float));
+    float (*shuffled_y)[OUTPUT_SIZE] = (float (*)[OUTPUT_SIZE])malloc(n_samples * OUTPUT_SIZE * sizeof(float));
+    uint32_t seed = config.shuffle_seed;
+    context->optimizer = create_optimizer(OPTIMIZER_SGD, LEARNING_RATE, BATCH_SIZE);
+    for (int i = 0; i < n_samples; i++)
+    {
+        order[i] = i;
+    }
+    for (int e = 0, step = 0; e < 2; e++)
+    {
+        shuffle_samples(order, n_samples, &seed);
+        for (int i = 0; i < n_samples; i++)
+        {
+            memcpy(shuffled_x[i], ft_samples_x[order[i]], sizeof(shuffled_x[i]));
+            memcpy(shuffled_y[i], ft_samples_y[order[i]], sizeof(shuffled_y[i]));
+        }
+        for (int i = 0; i < n_samples; i += BATCH_SIZE, step++)
+        {
+            context->optimizer->learning_rate = train_config_learning_rate(&config, step, 2 * n_samples / BATCH_SIZE);
+            fc_model_train_with_context(models[5], shuffled_x + i, shuffled_y + i, context);
+        }
+    }
+    free_optimizer(context->optimizer);
+    context->optimizer = NULL;
+    free(shuffled_x);
+    free(shuffled_y);
+
+    // compared bitwise, so runs that diverge to nan alike still match
+    float outputs[6][EQCHECK_N_SAMPLES * OUTPUT_SIZE];
+    for (int m = 0; m < 6; m++)
+    {
+        fc_model_predict_batch(models[m], &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[m]);
+    }
+    for (int m = 0; m < 6; m += 2)
+    {
+        if (memcmp(outputs[m], outputs[m + 1], sizeof(outputs[m])) != 0)
+        {
+            printf("FAILED: fit eqcheck of models %d and %d\n", m, m + 1);
+        }
+    }
+
+    // no epoch improves on the first by min_delta, so the run stops after patience more
+    config = default_train_config();
+    config.n_epochs = 10;
+    config.patience = 2;
+    config.min_delta = 1000000;
+    fc_model_fit(models[1], ft_samples_x, ft_samples_y, FT_N_SAMPLES, &config, context, &stats);
+    if (stats.epochs != 3 || stats.best_epoch != 1)
+    {
+        printf("FAILED: early stopping after %d epochs, best epoch %d\n", stats.epochs, stats.best_epoch);
+    }
+    config.patience = 0;
+    config.max_steps = 3;
+    steps = fc_model_fit(models[1], ft_samples_x, ft_samples_y, FT_N_SAMPLES, &config, context, &stats);
+    if (steps != 3 || stats.steps != 3)
+    {
+        printf("FAILED: max_steps, took %d steps\n", steps);
+    }
+    // the models share their shape, so one context serves them all
+    free_train_context(context, models[0]);
+    for (int m = 0; m < 6; m++)
+    {
+        freeModel(models[m]);
+    }
+    printf("fit eqcheck completed! \n");
+}
+
+#ifdef ENABLE_THREADS
+/* Checks that data-parallel training on 1 to 4 threads matches sequential training. One thread sums the gradients in the
+    same order and must match exactly, more threads within rounding of the reduction, and a second run on the same
+    number of threads exactly. */
+void eqcheck_parallel(Model *model)
+{
+    printf("start parallel eqcheck..\n");
+    float outputs[3][EQCHECK_N_SAMPLES * OUTPUT_SIZE];
+    Model *sequential = copy_tester_model(model);
+    for (int s = 0; s < 2; s++)
+    {
+        fc_model_train(sequential, ft_samples_x, ft_samples_y);
+    }
+    fc_model_predict_batch(sequential, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[0]);
+    freeModel(sequential);
+
+    for (int n_threads = 1; n_threads <= 4; n_threads++)
+    {
+        ThreadPool *pool = create_thread_pool(n_threads);
+        for (int run = 0; run < 2; run++)
+        {
+            Model *parallel = copy_tester_model(model);
+            // the first run allocates per step, the second reuses a context
+            TrainContext *context = (run == 0) ? NULL : create_train_context();
+            for (int s = 0; s < 2; s++)
+            {
+                if (context == NULL)
+                {
+                    fc_model_train_parallel(parallel, ft_samples_x, ft_samples_y, pool);
+                }
+                else
+                {
+                    fc_model_train_parallel_with_context(parallel, ft_samples_x, ft_samples_y, pool, context);
+                }
+            }
+            fc_model_predict_batch(parallel, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[1 + run]);
+            if (context != NULL)
+            {
+                free_train_context(context, parallel);
+            }
+            freeModel(parallel);
+        }
+        float tolerance = (n_threads == 1) ? 0 : 0.00001;
+        for (int i = 0; i < EQCHECK_N_SAMPLES * OUTPUT_SIZE; i++)
+        {
+            if (fabs(outputs[1][i] - outputs[0][i]) > tolerance)
+            {
+                printf("FAILED: parallel eqcheck on %d threads, expected: %f but predicted: %f\n", n_threads, outputs[0][i],
+                       outputs[1][i]);
+                break;
+            }
+        }
+        if (memcmp(outputs[1], outputs[2], sizeof(outputs[1])) != 0)
+        {
+            printf("FAILED: parallel training on %d threads is not reproducible\n", n_threads);
+        }
+        free_thread_pool(pool);
+    }
+    printf("parallel eqcheck completed! \n");
+}
+#endif
+
+/* Checks the net inputs checkpointed gradients hold, the interval picked for a budget and that training with every
+    interval matches keeping the net inputs of every layer */
+void eqcheck_checkpoint(Model *model)
+{
+    printf("start checkpoint eqcheck..\n");
+    int layers_size[DEEP_N_LAYERS];
+    enum ActivationType layers_activation[DEEP_N_LAYERS];
+    Model *reference = create_deep_model(model, layers_size, layers_activation);
+    size_t all_size = gradients_activations_size(reference, 0);
+    size_t expected_size = 0;
+    for (int i = 0; i < DEEP_N_LAYERS; i++)
+    {
+        expected_size += layers_size[i] * sizeof(float);
+    }
+    // every third layer: checkpoints 2 and 5, and the widest of layers {0, 3, 6} and of {1, 4} for the segments
+    int widest = (layers_size[6] > layers_size[0]) ? layers_size[6] : layers_size[0];
+    size_t third_size = (layers_size[2] + layers_size[5] + widest + layers_size[1]) * sizeof(float);
+    if (all_size != expected_size || gradients_activations_size(reference, 1) != all_size ||
+        gradients_activations_size(reference, 3) != third_size)
+    {
+        printf("FAILED: checkpointed net inputs take %zu and %zu bytes\n", all_size, gradients_activations_size(reference, 3));
+    }
+    int interval = checkpoint_interval_for_budget(reference, third_size);
+    if (checkpoint_interval_for_budget(reference, all_size) != 0 || interval < 1 ||
+        gradients_activations_size(reference, interval) > third_size || checkpoint_interval_for_budget(reference, 4) != -1)
+    {
+        printf("FAILED: checkpoint interval for a budget, got: %d\n", interval);
+    }
+
+    TrainContext *context = create_train_context();
+    float outputs[2][EQCHECK_N_SAMPLES * OUTPUT_SIZE];
+    for (int i = 0; i < 2; i++)
+    {
+        fc_model_train_with_context(reference, ft_samples_x, ft_samples_y, context);
+    }
+    fc_model_predict_batch(reference, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[0]);
+    for (interval = 1; interval <= DEEP_N_LAYERS; interval++)
+    {
+        // the context reallocates its gradients for every interval
+        Model *checkpointed = create_deep_model(model, layers_size, layers_activation);
+        context->checkpoint_interval = interval;
+        for (int i = 0; i < 2; i++)
+        {
+            fc_model_train_with_context(checkpointed, ft_samples_x, ft_samples_y, context);
+        }
+        fc_model_predict_batch(checkpointed, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[1]);
+        for (int i = 0; i < EQCHECK_N_SAMPLES * OUTPUT_SIZE; i++)
+        {
+            // recomputing runs the same kernels on the same inputs, so the gradients are the same
+            if (outputs[0][i] != outputs[1][i])
+            {
+                printf("FAILED: checkpoint interval %d eqcheck, expected: %f but predicted: %f\n", interval, outputs[0][i], outputs[1][i]);
+                break;
+            }
+        }
+        freeModel(checkpointed);
+    }
+    free_train_context(context, reference);
+
+#ifdef ENABLE_THREADS
+    // the same with 4 threads, the per-thread gradients follow the interval of the context
+    ThreadPool *pool = create_thread_pool(4);
+    context = create_train_context();
+    for (interval = 0; interval <= DEEP_N_LAYERS; interval++)
+    {
+        Model *checkpointed = create_deep_model(model, layers_size, layers_activation);
+        context->checkpoint_interval = interval;
+        for (int i = 0; i < 2; i++)
+        {
+            fc_model_train_parallel_with_context(checkpointed, ft_samples_x, ft_samples_y, pool, context);
+        }
+        fc_model_predict_batch(checkpointed, &eqcheck_samples_x[0][0], EQCHECK_N_SAMPLES, outputs[interval > 0]);
+        int expected_interval = (interval < DEEP_N_LAYERS) ? interval : 0;
+        if (context->thread_gradients[0]->checkpoint_interval != expected_interval)
+        {
+            printf("FAILED: thread gradients kept checkpoint interval %d instead of %d\n",
+                   context->thread_gradients[0]->checkpoint_interval, expected_interval);
+        }
+        for (int i = 0; interval > 0 && i < EQCHECK_N_SAMPLES * OUTPUT_SIZE; i++)
+        {
+            if (outputs[0][i] != outputs[1][i])
+            {
+                printf("FAILED: parallel checkpoint interval %d eqcheck, expected: %f but predicted: %f\n", interval, outputs[0][i],
+                       outputs[1][i]);
+                break;
+            }
+        }
+        freeModel(checkpointed);
+    }
+    free_train_context(context, reference);
+    free_thread_pool(pool);
+#endif
+    freeModel(reference);
+    printf("checkpoint eqcheck completed! \n");
+}
+
+/* Checks that partial training reading the frozen layers from an activation cache, in RAM and spilled to a file,
+    trains like computing them from the input every step */
+void eqcheck_activation_cache(Model *model)
+{
+    printf("start activation cache eqcheck..\n");
+    const char *paths[2] = {NULL, "activation_cache.bin"};
+    for (int c = 0; c < 2; c++)
+    {
+        Model *reference = copy_tester_model(model);
+        Model *cached = copy_tester_model(model);
+        ActivationCache *cache = create_activation_cache(cached, 1, BATCH_SIZE, paths[c]);
+        if (cache == NULL)
+        {
+            printf("FAILED: could not create activation cache\n");
+            freeModel(reference);
+            freeModel(cached);
+            continue;
+        }
+        TrainContext *context = create_train_context();
+        for (int step = 0; step < 4; step++)
+        {
+            // layer 0 changes after the second step, the cache must be invalidated for its new outputs
+            if (step == 2)
+            {
+                fc_model_train_layer(reference, ft_samples_x, ft_samples_y, 0);
+                fc_model_train_layer(cached, ft_samples_x, ft_samples_y, 0);
+                activation_cache_invalidate(cache);
+            }
+            fc_model_train_partial_layer(reference, ft_samples_x, ft_samples_y, 1, 2, 2);
+            fc_model_train_partial_layer_cached(cached, ft_samples_x, ft_samples_y, 0, 1, 2, 2, context, cache);
+            fc_model_train_layer(reference, ft_samples_x, ft_samples_y, 1);
+            fc_model_train_layer_cached(cached, ft_samples_x, ft_samples_y, 0, 1, context, cache);
+        }
+        if (activation_cache_lookup(cache, 0) == NULL)
+        {
+            printf("FAILED: activation cache did not store a sample\n");
+        }
+
+        // the cached values are the ones the frozen layers compute, so training matches exactly
+        eqcheck_models("activation cache", (paths[c] == NULL) ? "in RAM" : "in a file", reference, cached, 0);
+        free_train_context(context, cached);
+        free_activation_cache(cache);
+        freeModel(reference);
+        freeModel(cached);
+    }
+    remove(paths[1]);
+    printf("activation cache eqcheck completed! \n");
+}
 
+#ifdef ENABLE_SPECIALIZED_MODEL
+/* Checks the functions generated by model_converter.py --specialize against the generic runtime.
+    The specialized training step updates the model's arrays, they are restored afterwards. */
+void eqcheck_specialized(Model *model)
+{
+    printf("start specialized eqcheck..\n");
+    float tolerance = 0.0001;
+    float output[OUTPUT_SIZE];
     for (int i = 0; i < EQCHECK_N_SAMPLES; i++)
     {
-        float *input = eqcheck_samples_x[i];
-        float *output = fc_model_predict(model, input);
-        float tolerance = 0.0001;
+        float *expected = fc_model_predict(model, eqcheck_samples_x[i]);
+        model_specialized_predict(eqcheck_samples_x[i], output);
+        for (int j = 0; j < OUTPUT_SIZE; j++)
+        {
+            if (fabs(output[j] - expected[j]) > tolerance)
+            {
+                printf("FAILED: specialized eqcheck for sample, expected: %f but predicted: %f\n", expected[j], output[j]);
+                break;
+            }
+        }
+        free(expected);
+    }
+#ifdef MODEL_SPECIALIZED_TRAIN
+    Model *runtime = copy_tester_model(model);
+    Model *backup = copy_tester_model(model);
+    fc_model_train(runtime, ft_samples_x, ft_samples_y);
+    model_specialized_train(&ft_samples_x[0][0], &ft_samples_y[0][0], BATCH_SIZE, LEARNING_RATE);
+    eqcheck_models("specialized", "after training", runtime, model, tolerance);
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        memcpy(model->layers_weights[i], backup->layers_weights[i], size * model->layers_size[i] * sizeof(float));
+        memcpy(model->layers_biases[i], backup->layers_biases[i], model->layers_size[i] * sizeof(float));
+        size = model->layers_size[i];
+    }
+    freeModel(runtime);
+    freeModel(backup);
+#endif
+    printf("specialized eqcheck completed! \n");
+}
+#endif
+
+/* Writes the fine-tuning samples to a sample file and checks that training a copy of the model from the stream
+    matches training another copy from the arrays */
+void stream_tester(Model *model)
+{
+    printf("start sample stream check..\n");
+    const char *path = "stream_samples.bin";
+    if (write_sample_file(path, &ft_samples_x[0][0], &ft_samples_y[0][0], FT_N_SAMPLES, INPUT_SIZE, OUTPUT_SIZE) != 0)
+    {
+        printf("FAILED: could not write sample file\n");
+        return;
+    }
+    SampleStream *stream = open_sample_stream(path, BATCH_SIZE);
+    Model *copy = copy_tester_model(model);
+    Model *reference = copy_tester_model(model);
+
+    TrainContext *stream_context = create_train_context();
+    TrainContext *context = create_train_context();
+    int steps = fc_model_train_stream(copy, stream, stream_context);
+    for (int i = 0; i + BATCH_SIZE <= FT_N_SAMPLES; i += BATCH_SIZE)
+    {
+        fc_model_train_with_context(reference, &ft_samples_x[i], &ft_samples_y[i], context);
+    }
+    printf("Trained %d steps from the stream\n", steps);
+    eqcheck_models("stream", "after training", reference, copy, 0);
+
+    free_train_context(stream_context, copy);
+    free_train_context(context, reference);
+    close_sample_stream(stream);
+    freeModel(copy);
+    freeModel(reference);
+    remove(path);
+    printf("sample stream check completed! \n");
+}
+/* Saves the model as a binary model file and checks that the mapped model predicts the same */
+void eqcheck_model_file(Model *model)
+{
+    printf("start model file eqcheck..\n");
+    const char *path = "eqcheck_model.bin";
+    if (writeModelFile(model, path) != 0)
+    {
+        printf("FAILED: could not write model file\n");
+        return;
+    }
+    ModelFile *file = openModelFile(path);
+    if (file == NULL)
+    {
+        printf("FAILED: could not open model file\n");
+        return;
+    }
+
+    for (int i = 0; i < EQCHECK_N_SAMPLES; i++)
+    {
+        float *output = fc_model_predict(model, eqcheck_samples_x[i]);
+        float *output_file = fc_model_predict(file->model, eqcheck_samples_x[i]);
         for (int j = 0; j < OUTPUT_SIZE; j++)
         {
-            if (fabs(output[j] - eqcheck_samples_y[i][j]) > tolerance)
+            if (output[j] != output_file[j])
             {
-                printf("FAILED: eqcheck for sample, expected: %f but predicted: %f\n", eqcheck_samples_y[i][j], output[j]);
+                printf("FAILED: model file eqcheck for sample, expected: %f but predicted: %f\n", output[j], output_file[j]);
                 break;
             }
         }
         free(output);
+        free(output_file);
+    }
+    closeModelFile(file);
+    remove(path);
+    printf("model file eqcheck completed! \n");
+}
+/* Checks every kernel variant supported by this cpu against the scalar kernels,
+    both on the primitives and through fc_forward_prop of the first layer */
+void kernel_tester(Model *model)
+{
+    printf("start kernel check..\n");
+    const Kernels *selected = get_kernels();
+    const Kernels *scalar = get_kernel_variant(KERNEL_SCALAR);
+    int sizes[] = {1, 3, 8, 17, 64, 100};
+    float x[100], y[100], y_ref[100], w[100];
+    float tolerance = 0.0001;
+
+    set_kernel_variant(KERNEL_SCALAR);
+    float *expected = fc_forward_prop(eqcheck_samples_x[0], model->layers_weights[0], model->layers_biases[0],
+                                      INPUT_SIZE, model->layers_size[0], linear);
+
+    for (int variant = 0; variant < N_KERNEL_VARIANTS; variant++)
+    {
+        const Kernels *kernels = get_kernel_variant((enum KernelVariant)variant);
+        if (kernels == NULL)
+        {
+            continue;
+        }
+        for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            int n = sizes[s];
+            for (int i = 0; i < n; i++)
+            {
+                x[i] = (float)((i * 7) % 13) / 13 - 0.5f;
+                y[i] = y_ref[i] = (float)((i * 5) % 11) / 11 - 0.5f;
+                w[i] = (float)((i * 3) % 7) / 7 - 0.5f;
+            }
+            float dot = kernels->dot(x, y, n);
+            float dot_ref = scalar->dot(x, y, n);
+            kernels->axpy(y, x, 0.75f, n);
+            scalar->axpy(y_ref, x, 0.75f, n);
+            if (fabs(dot - dot_ref) > tolerance)
+            {
+                printf("FAILED: %s dot for size %d, expected: %f but got: %f\n", kernels->name, n, dot_ref, dot);
+            }
+            // fused kernel, on top of the axpy above
+            float fused = kernels->axpy_dot(y, x, -0.25f, w, n);
+            float fused_ref = scalar->axpy_dot(y_ref, x, -0.25f, w, n);
+            if (fabs(fused - fused_ref) > tolerance || fabs(fused_ref - scalar->dot(w, x, n)) > tolerance)
+            {
+                printf("FAILED: %s axpy_dot for size %d, expected: %f but got: %f\n", kernels->name, n, fused_ref, fused);
+            }
+            for (int i = 0; i < n; i++)
+            {
+                if (fabs(y[i] - y_ref[i]) > tolerance)
+                {
+                    printf("FAILED: %s axpy for size %d, expected: %f but got: %f\n", kernels->name, n, y_ref[i], y[i]);
+                    break;
+                }
+            }
+            // 16-bit weights, on top of the axpy above
+            uint16_t w_half[100];
+            for (int format = 0; format < N_HALF_FORMATS; format++)
+            {
+                convert_to_half(w_half, w, n, (enum HalfFormat)format);
+                float dot_half = kernels->dot_half[format](w_half, x, n);
+                float dot_half_ref = scalar->dot_half[format](w_half, x, n);
+                kernels->axpy_half[format](y, w_half, 0.5f, n);
+                scalar->axpy_half[format](y_ref, w_half, 0.5f, n);
+                if (fabs(dot_half - dot_half_ref) > tolerance || fabs(dot_half_ref - scalar->dot(w, x, n)) > 0.01)
+                {
+                    printf("FAILED: %s dot_half %d for size %d, expected: %f but got: %f\n", kernels->name, format, n, dot_half_ref, dot_half);
+                }
+            }
+            for (int i = 0; i < n; i++)
+            {
+                if (fabs(y[i] - y_ref[i]) > tolerance)
+                {
+                    printf("FAILED: %s axpy_half for size %d, expected: %f but got: %f\n", kernels->name, n, y_ref[i], y[i]);
+                    break;
+                }
+            }
+            // int8 operands over the full range, rows and sums are exact
+            int8_t rows_i8[5 * 100], x_i8[100];
+            int32_t dot_i8[5], dot_i8_ref[5];
+            for (int i = 0; i < 5 * n; i++)
+            {
+                rows_i8[i] = (int8_t)((i * 37) % 255 - 127);
+            }
+            for (int i = 0; i < n; i++)
+            {
+                x_i8[i] = (int8_t)(127 - (i * 53) % 255);
+            }
+            kernels->dot_i8(dot_i8, rows_i8, x_i8, 5, n);
+            scalar->dot_i8(dot_i8_ref, rows_i8, x_i8, 5, n);
+            for (int r = 0; r < 5; r++)
+            {
+                if (dot_i8[r] != dot_i8_ref[r])
+                {
+                    printf("FAILED: %s dot_i8 for size %d, expected: %d but got: %d\n", kernels->name, n, dot_i8_ref[r], dot_i8[r]);
+                    break;
+                }
+            }
+            // sparse rows, the indices are a permutation as every size is coprime to 7
+            int index[100];
+            for (int i = 0; i < n; i++)
+            {
+                index[i] = (i * 7) % n;
+            }
+            float sparse_dot = kernels->sparse_dot(w, index, x, n);
+            float sparse_dot_ref = scalar->sparse_dot(w, index, x, n);
+            kernels->sparse_axpy(y, index, w, -0.5f, n);
+            scalar->sparse_axpy(y_ref, index, w, -0.5f, n);
+            if (fabs(sparse_dot - sparse_dot_ref) > tolerance)
+            {
+                printf("FAILED: %s sparse_dot for size %d, expected: %f but got: %f\n", kernels->name, n, sparse_dot_ref, sparse_dot);
+            }
+            for (int i = 0; i < n; i++)
+            {
+                if (fabs(y[i] - y_ref[i]) > tolerance)
+                {
+                    printf("FAILED: %s sparse_axpy for size %d, expected: %f but got: %f\n", kernels->name, n, y_ref[i], y[i]);
+                    break;
+                }
+            }
+            // derivative masks of x, which holds positive and negative values, then applied on top of the axpy above
+            uint32_t mask[KERNEL_MASK_WORDS(100)], mask_ref[KERNEL_MASK_WORDS(100)];
+            kernels->mask_pack(mask, x, n);
+            scalar->mask_pack(mask_ref, x, n);
+            for (int i = 0; i < KERNEL_MASK_WORDS(n) * KERNEL_MASK_BITS; i++)
+            {
+                int bit = (mask[i / KERNEL_MASK_BITS] >> (i % KERNEL_MASK_BITS)) & 1;
+                if (bit != (i < n && x[i] > 0))
+                {
+                    printf("FAILED: %s mask_pack for size %d, bit %d is %d\n", kernels->name, n, i, bit);
+                    break;
+                }
+            }
+            kernels->mask_apply(y, mask, n);
+            scalar->mask_apply(y_ref, mask_ref, n);
+            for (int i = 0; i < n; i++)
+            {
+                if (fabs(y[i] - y_ref[i]) > tolerance || (x[i] <= 0 && y[i] != 0))
+                {
+                    printf("FAILED: %s mask_apply for size %d, expected: %f but got: %f\n", kernels->name, n, y_ref[i], y[i]);
+                    break;
+                }
+            }
+            // optimizer updates of y, with x and w as gradients and state
+            OptimizerStep step = {0.01f, 0.5f, 0.9f, 0.8f, 0.99f, 1.5f, 1e-8f, 0.99f};
+            float m[100], m_ref[100], v[100], v_ref[100];
+            for (int i = 0; i < n; i++)
+            {
+                m[i] = m_ref[i] = w[i];
+                v[i] = v_ref[i] = x[i] * x[i];
+            }
+            kernels->sgd(y, x, &step, n);
+            scalar->sgd(y_ref, x, &step, n);
+            kernels->momentum(y, w, m, &step, n);
+            scalar->momentum(y_ref, w, m_ref, &step, n);
+            kernels->adam(y, x, m, v, &step, n);
+            scalar->adam(y_ref, x, m_ref, v_ref, &step, n);
+            for (int i = 0; i < n; i++)
+            {
+                if (fabs(y[i] - y_ref[i]) > tolerance || fabs(m[i] - m_ref[i]) > tolerance || fabs(v[i] - v_ref[i]) > tolerance)
+                {
+                    printf("FAILED: %s optimizer kernels for size %d, expected: %f but got: %f\n", kernels->name, n, y_ref[i], y[i]);
+                    break;
+                }
+            }
+        }
+
+        set_kernel_variant((enum KernelVariant)variant);
+        float *output = fc_forward_prop(eqcheck_samples_x[0], model->layers_weights[0], model->layers_biases[0],
+                                        INPUT_SIZE, model->layers_size[0], linear);
+        for (int i = 0; i < model->layers_size[0]; i++)
+        {
+            if (fabs(output[i] - expected[i]) > tolerance)
+            {
+                printf("FAILED: %s forward prop, expected: %f but got: %f\n", kernels->name, expected[i], output[i]);
+                break;
+            }
+        }
+        free(output);
+        printf("kernel variant %s checked\n", kernels->name);
+    }
+    free(expected);
+
+    // 16-bit encodings: one, the largest fp16, fp16 overflow, the smallest fp16 subnormal and a bf16 tie
+    float values[5] = {1.0f, 65504.0f, 100000.0f, 5.9604644775390625e-8f, 1.00390625f};
+    uint16_t expected_half[N_HALF_FORMATS][5] = {{0x3f80, 0x4780, 0x47c3, 0x3380, 0x3f80}, {0x3c00, 0x7bff, 0x7c00, 0x0001, 0x3c04}};
+    for (int format = 0; format < N_HALF_FORMATS; format++)
+    {
+        uint16_t half[5];
+        convert_to_half(half, values, 5, (enum HalfFormat)format);
+        for (int i = 0; i < 5; i++)
+        {
+            if (half[i] != expected_half[format][i])
+            {
+                printf("FAILED: 16-bit format %d conversion of %g, expected: 0x%04x but got: 0x%04x\n", format, values[i],
+                       expected_half[format][i], half[i]);
+            }
+        }
+    }
+    set_kernel_variant(selected->variant);
+    printf("kernel check completed, using %s! \n", selected->name);
+}
+
+/* Scalar back-prop of one sample as the layer loops were written before the kernels, gradients are accumulated into
+    weights and biases laid out like the model's, weights[i][j * layers_size[i] + o] for input j and output o */
+static void reference_gradients(Model *model, float *input, float *actual, float **weights, float **biases)
+{
+    float *net_inputs[model->n_layers];
+    float *deltas[2];
+    int widest = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        net_inputs[i] = (float *)malloc(model->layers_size[i] * sizeof(float));
+        widest = (model->layers_size[i] > widest) ? model->layers_size[i] : widest;
+    }
+    deltas[0] = (float *)malloc(widest * sizeof(float));
+    deltas[1] = (float *)malloc(widest * sizeof(float));
+
+    // forward, the activation of the layer below is applied to its net inputs as they are read
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        ActivationFunc func = (i == 0) ? linear : get_activation_func(model->layers_activation[i - 1]);
+        const float *in = (i == 0) ? input : net_inputs[i - 1];
+        for (int o = 0; o < model->layers_size[i]; o++)
+        {
+            float sum = model->layers_biases[i][o];
+            for (int j = 0; j < size; j++)
+            {
+                sum += func(in[j]) * model->layers_weights[i][j * model->layers_size[i] + o];
+            }
+            net_inputs[i][o] = sum;
+        }
+        size = model->layers_size[i];
+    }
+    int last = model->n_layers - 1;
+    ActivationFunc func = get_activation_func(model->layers_activation[last]);
+    ActivationFunc func_deriv = get_activation_func_deriv(model->layers_activation[last]);
+    float output[model->output_size];
+    for (int o = 0; o < model->output_size; o++)
+    {
+        output[o] = func(net_inputs[last][o]);
+    }
+    float loss_deriv = MSE_derivative(output, actual, model->output_size);
+    float *delta = deltas[0];
+    for (int o = 0; o < model->output_size; o++)
+    {
+        delta[o] = loss_deriv * func_deriv(net_inputs[last][o]);
+    }
+
+    // backward, from the gradients of the net inputs of layer i to its parameters and the layer below
+    for (int i = last; i >= 0; i--)
+    {
+        int n_in = (i == 0) ? model->input_size : model->layers_size[i - 1];
+        int n_out = model->layers_size[i];
+        ActivationFunc in_func = (i == 0) ? linear : get_activation_func(model->layers_activation[i - 1]);
+        const float *in = (i == 0) ? input : net_inputs[i - 1];
+        float *next = (delta == deltas[0]) ? deltas[1] : deltas[0];
+        for (int j = 0; j < n_in; j++)
+        {
+            next[j] = 0.0f;
+        }
+        for (int o = 0; o < n_out; o++)
+        {
+            biases[i][o] += delta[o];
+            for (int j = 0; j < n_in; j++)
+            {
+                weights[i][j * n_out + o] += delta[o] * in_func(in[j]);
+                next[j] += model->layers_weights[i][j * n_out + o] * delta[o];
+            }
+        }
+        if (i > 0)
+        {
+            ActivationFunc in_deriv = get_activation_func_deriv(model->layers_activation[i - 1]);
+            for (int j = 0; j < n_in; j++)
+            {
+                next[j] *= in_deriv(in[j]);
+            }
+        }
+        delta = next;
+    }
+
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        free(net_inputs[i]);
+    }
+    free(deltas[0]);
+    free(deltas[1]);
+}
+
+/* Checks the gradients fc_calc_gradients accumulates over the fine-tuning samples against the scalar back-prop,
+    for every kernel variant supported by this cpu */
+static void eqcheck_model_gradients(Model *model, const char *name)
+{
+    float *weights[model->n_layers];
+    float *biases[model->n_layers];
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        weights[i] = (float *)calloc(size * model->layers_size[i], sizeof(float));
+        biases[i] = (float *)calloc(model->layers_size[i], sizeof(float));
+        size = model->layers_size[i];
+    }
+    for (int s = 0; s < FT_N_SAMPLES; s++)
+    {
+        reference_gradients(model, ft_samples_x[s], ft_samples_y[s], weights, biases);
+    }
+
+    const Kernels *selected = get_kernels();
+    for (int variant = 0; variant < N_KERNEL_VARIANTS; variant++)
+    {
+        const Kernels *kernels = get_kernel_variant((enum KernelVariant)variant);
+        if (kernels == NULL)
+        {
+            continue;
+        }
+        set_kernel_variant((enum KernelVariant)variant);
+        Gradients *gradients = allocate_gradients(model);
+        for (int s = 0; s < FT_N_SAMPLES; s++)
+        {
+            fc_calc_gradients(model, ft_samples_x[s], ft_samples_y[s], gradients);
+        }
+        int failed = 0;
+        size = model->input_size;
+        for (int i = 0; i < model->n_layers && !failed; i++)
+        {
+            for (int k = 0; k < model->layers_size[i] + size * model->layers_size[i]; k++)
+            {
+                // biases first, then the weights
+                int is_bias = k < model->layers_size[i];
+                float expected = is_bias ? biases[i][k] : weights[i][k - model->layers_size[i]];
+                float got = is_bias ? gradients->biases[i][k] : gradients->weights[i][k - model->layers_size[i]];
+                // the kernels reassociate the sums over a layer
+                if (fabs(got - expected) > 1e-4 * (1 + fabs(expected)))
+                {
+                    printf("FAILED: %s %s gradient eqcheck of layer %d %s %d, expected: %f but got: %f\n", name, kernels->name,
+                           i, is_bias ? "bias" : "weight", is_bias ? k : k - model->layers_size[i], expected, got);
+                    failed = 1;
+                    break;
+                }
+            }
+            size = model->layers_size[i];
+        }
+        free_gradients(gradients, model);
+    }
+    set_kernel_variant(selected->variant);
+
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        free(weights[i]);
+        free(biases[i]);
+    }
+}
+
+/* Checks the gradients of the test model and of a deeper relu model against the scalar back-prop */
+void eqcheck_gradients(Model *model)
+{
+    printf("start gradient eqcheck..\n");
+    eqcheck_model_gradients(model, "test model");
+    int layers_size[DEEP_N_LAYERS];
+    enum ActivationType layers_activation[DEEP_N_LAYERS];
+    Model *deep = create_deep_model(model, layers_size, layers_activation);
+    eqcheck_model_gradients(deep, "deep model");
+    freeModel(deep);
+    printf("gradient eqcheck completed! \n");
+}
+#ifdef ENABLE_TRACK_MEMORY
+/* peak of a phase in the summaries of the last timeline, 0 if it was not recorded */
+static size_t memory_phase_peak(const char *name)
+{
+    int n_phases;
+    const MemoryPhase *phases = memory_phases(&n_phases);
+    for (int i = 0; i < n_phases; i++)
+    {
+        if (strcmp(phases[i].name, name) == 0)
+        {
+            return phases[i].peak;
+        }
+    }
+    return 0;
+}
+
+/* Reads an exported timeline back and checks it against the phase summaries: every entry parses, the phases nest,
+    a phase peaks at no less than the bytes live when a run of it began, and the backward pass was recorded */
+static void check_memory_timeline(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        printf("FAILED: could not read the memory timeline back\n");
+        return;
+    }
+    char line[256];
+    char event[16];
+    char marker[64];
+    char open[TRACK_MAX_PHASE_DEPTH][64];
+    double time;
+    int depth;
+    size_t live;
+    size_t high_water;
+    int n_begins = 0;
+    int n_failed = (fgets(line, sizeof(line), file) == NULL);
+    int open_depth = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        // the phase column is skipped, it is empty outside of any phase
+        char *depth_column = line;
+        for (int column = 0; column < 4 && depth_column != NULL; column++)
+        {
+            depth_column = strchr(depth_column, ',');
+            depth_column = (depth_column != NULL) ? depth_column + 1 : NULL;
+        }
+        if (depth_column == NULL || sscanf(line, "%lf,%15[^,],%63[^,]", &time, event, marker) != 3 ||
+            sscanf(depth_column, "%d,%zu,%zu", &depth, &live, &high_water) != 3 || high_water < live || depth != open_depth)
+        {
+            n_failed++;
+            continue;
+        }
+        if (strcmp(event, "end") == 0)
+        {
+            // the end entry is recorded while the phase is still open, so with the depth of its begin entry + 1
+            if (open_depth == 0 || (open_depth <= TRACK_MAX_PHASE_DEPTH && strcmp(open[open_depth - 1], marker) != 0))
+            {
+                n_failed++;
+            }
+            open_depth -= (open_depth > 0);
+            continue;
+        }
+        if (open_depth < TRACK_MAX_PHASE_DEPTH)
+        {
+            strcpy(open[open_depth], marker);
+        }
+        open_depth++;
+        n_begins++;
+        if (memory_phase_peak(marker) < live)
+        {
+            printf("FAILED: memory phase %s peaks below the %zu bytes live when it began\n", marker, live);
+            n_failed++;
+        }
+    }
+    fclose(file);
+    if (n_failed > 0 || open_depth != 0 || n_begins == 0 || memory_phase_peak("backward") == 0)
+    {
+        printf("FAILED: memory timeline, %d bad entries, %d phases begun, %d left open\n", n_failed, n_begins, open_depth);
     }
-    printf("eqcheck completed! \n");
 }
+#endif
+
 void memory_tester(Model *model)
 {
 
@@ -56,6 +1563,7 @@ void memory_tester(Model *model)
     printf("Memory stats for training for the whole network \n");
     fc_model_train(model, ft_samples_x, ft_samples_y);
     print_memory();
+    print_memory_sites();
     reset_memory_tracking();
     printf("\n \n");
 
@@ -83,10 +1591,91 @@ void memory_tester(Model *model)
     reset_memory_tracking();
     printf("\n \n");
 
+    // with a reused context only the first step allocates, the totals match a single step
+    printf("Memory stats for 5 steps of training the whole network and layer 1 with a reused context \n");
+    TrainContext *context = create_train_context();
+    for (int i = 0; i < 5; i++)
+    {
+        fc_model_train_with_context(model, ft_samples_x, ft_samples_y, context);
+        fc_model_train_layer_with_context(model, ft_samples_x, ft_samples_y, 1, context);
+    }
+    free_train_context(context, model);
+    print_memory();
+    reset_memory_tracking();
+    printf("\n \n");
+
+    // a deeper model keeping the net inputs of every layer, then of every second layer only
+    int deep_layers_size[DEEP_N_LAYERS];
+    enum ActivationType deep_layers_activation[DEEP_N_LAYERS];
+    Model *deep = create_deep_model(model, deep_layers_size, deep_layers_activation);
+    for (int interval = 0; interval <= 2; interval += 2)
+    {
+        reset_memory_tracking();
+        printf("Memory stats for training a %d layer network, checkpoint interval %d \n", DEEP_N_LAYERS, interval);
+        context = create_train_context();
+        context->checkpoint_interval = interval;
+        fc_model_train_with_context(deep, ft_samples_x, ft_samples_y, context);
+        free_train_context(context, deep);
+        print_memory();
+        printf("\n \n");
+    }
+    freeModel(deep);
+    reset_memory_tracking();
+
+    // the same training steps as above, recorded as one timeline of nested phases
+    printf("Memory timeline per training phase \n");
+    memory_timeline_start(0);
+    MEMORY_PHASE_BEGIN("full_model");
+    fc_model_train(model, ft_samples_x, ft_samples_y);
+    MEMORY_PHASE_END();
+    MEMORY_PHASE_BEGIN("layer_0");
+    fc_model_train_layer(model, ft_samples_x, ft_samples_y, 0);
+    MEMORY_PHASE_END();
+    MEMORY_PHASE_BEGIN("layer_last");
+    fc_model_train_layer(model, ft_samples_x, ft_samples_y, model->n_layers - 1);
+    MEMORY_PHASE_END();
+    MEMORY_PHASE_BEGIN("partial_0");
+    fc_model_train_partial_layer(model, ft_samples_x, ft_samples_y, 0, 1, 0);
+    MEMORY_PHASE_END();
+    MEMORY_PHASE_BEGIN("partial_1");
+    fc_model_train_partial_layer(model, ft_samples_x, ft_samples_y, 1, 2, 2);
+    MEMORY_PHASE_END();
+    memory_timeline_stop();
+    print_memory_phases();
+    if (export_memory_timeline_csv("memory_timeline.csv") != 0 || export_memory_timeline_json("memory_timeline.json") != 0)
+    {
+        printf("FAILED: could not export the memory timeline \n");
+    }
+#ifdef ENABLE_TRACK_MEMORY
+    check_memory_timeline("memory_timeline.csv");
+#endif
+    remove("memory_timeline.csv");
+    remove("memory_timeline.json");
+    reset_memory_tracking();
+    printf("\n \n");
+
     printf("\n Completed memory test \n");
     return;
 }
 
+#ifdef ENABLE_PROFILING
+/* profiles a few training steps of each kind, the counters are cleared afterwards so the report at exit
+    only covers the tests that follow */
+void profile_tester(Model *model)
+{
+    reset_profile();
+    for (int i = 0; i < 5; i++)
+    {
+        fc_model_train(model, ft_samples_x, ft_samples_y);
+        fc_model_train_layer(model, ft_samples_x, ft_samples_y, 0);
+        fc_model_train_partial_layer(model, ft_samples_x, ft_samples_y, 1, 2, 2);
+    }
+    print_profile();
+    reset_profile();
+    printf("\n Completed profile test \n");
+}
+#endif
+
 // testing on simple data
 /*void test_simple(Model *model)
 {
@@ -100,9 +1689,39 @@ int main()
     printf("starting.. \n");
     Model *model = createAndSetModel(N_LAYERS, INPUT_SIZE, OUTPUT_SIZE, layers_size, layers_weights, layers_biases, layers_activation);
     printf("Set model \n");
+    kernel_tester(model);
+    eqcheck_gradients(model);
     eqcheck(model);
+    eqcheck_batch(model);
+    eqcheck_plan(model);
+#ifdef ENABLE_QUANTIZED_MODEL
+    eqcheck_generated_quantized(model);
+#endif
+    eqcheck_flat(model);
+    eqcheck_packed(model);
+    eqcheck_quantized(model);
+    eqcheck_half(model);
+    eqcheck_sparse(model);
+    eqcheck_activation_cache(model);
+    eqcheck_optimizer(model);
+    eqcheck_fit(model);
+#ifdef ENABLE_THREADS
+    eqcheck_parallel(model);
+#endif
+    eqcheck_checkpoint(model);
+#ifdef ENABLE_SPECIALIZED_MODEL
+    eqcheck_specialized(model);
+#endif
+    eqcheck_model_file(model);
+    stream_tester(model);
     compare_true(model);
+#ifdef ENABLE_THREADS
+    compare_true_parallel(model, 4);
+#endif
     memory_tester(model);
+#ifdef ENABLE_PROFILING
+    profile_tester(model);
+#endif
     compare_true(model);
     return 0;
 }
\ No newline at end of file
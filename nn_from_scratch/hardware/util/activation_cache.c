@@ -0,0 +1,176 @@
+#define _POSIX_C_SOURCE 200809L // fileno, ftruncate
+#include "activation_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ACTIVATION_CACHE_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* sizes the spill file and maps it shared, so the values live in the page cache instead of the heap.
+    @return 0 on success */
+static int map_cache_file(ActivationCache *cache)
+{
+#ifdef ACTIVATION_CACHE_MMAP
+    if (ftruncate(fileno(cache->file), (off_t)cache->n_bytes) != 0)
+    {
+        return -1;
+    }
+    void *data = mmap(NULL, cache->n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(cache->file), 0);
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+    cache->values = (float *)data;
+    cache->mapped = 1;
+    return 0;
+#else
+    (void)cache;
+    return -1;
+#endif
+}
+
+/* Creates an empty cache for the inputs of target_layer, which must be above the input layer.
+    @param n_samples: number of samples of the dataset, the keys run from 0 to n_samples - 1
+    @param path: file to spill the values to, NULL to keep them in RAM. The file is overwritten.
+    @return the cache, NULL on failure */
+ActivationCache *create_activation_cache(Model *model, int target_layer, int n_samples, const char *path)
+{
+    if (target_layer < 1 || target_layer >= model->n_layers || n_samples < 1)
+    {
+        printf("Invalid arguments for the activation cache! \n");
+        return NULL;
+    }
+    ActivationCache *cache = (ActivationCache *)calloc(1, sizeof(ActivationCache));
+    if (cache == NULL)
+    {
+        printf("Error: could not allocate activation cache! \n");
+        return NULL;
+    }
+    cache->target_layer = target_layer;
+    cache->width = model->layers_size[target_layer - 1];
+    cache->n_samples = n_samples;
+    cache->n_bytes = (size_t)n_samples * cache->width * sizeof(float);
+    cache->cached = (uint8_t *)calloc(n_samples, sizeof(uint8_t));
+    if (cache->cached == NULL)
+    {
+        printf("Error: could not allocate activation cache! \n");
+        free_activation_cache(cache);
+        return NULL;
+    }
+
+    if (path == NULL)
+    {
+        cache->values = (float *)malloc(cache->n_bytes);
+        if (cache->values == NULL)
+        {
+            printf("Error: could not allocate activation cache! \n");
+            free_activation_cache(cache);
+            return NULL;
+        }
+        return cache;
+    }
+
+    cache->file = fopen(path, "w+b");
+    if (cache->file == NULL)
+    {
+        printf("Error: could not create activation cache file %s! \n", path);
+        free_activation_cache(cache);
+        return NULL;
+    }
+    if (map_cache_file(cache) != 0)
+    {
+        cache->row = (float *)malloc(cache->width * sizeof(float));
+        if (cache->row == NULL)
+        {
+            printf("Error: could not allocate activation cache! \n");
+            free_activation_cache(cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+/* Values of a sample, NULL if they are not cached yet. When the spill file is not mapped, the values are
+    read into a buffer of the cache that the next lookup or store overwrites. */
+float *activation_cache_lookup(ActivationCache *cache, int sample)
+{
+    if (sample < 0 || sample >= cache->n_samples || !cache->cached[sample])
+    {
+        return NULL;
+    }
+    if (cache->values != NULL)
+    {
+        return cache->values + (size_t)sample * cache->width;
+    }
+    if (fseek(cache->file, (long)((size_t)sample * cache->width * sizeof(float)), SEEK_SET) != 0 ||
+        fread(cache->row, sizeof(float), cache->width, cache->file) != (size_t)cache->width)
+    {
+        printf("Error: could not read activation cache file! \n");
+        return NULL;
+    }
+    return cache->row;
+}
+
+/* Stores the values of a sample, width floats.
+    @return the stored values like activation_cache_lookup, NULL if the sample is out of range or could not be written */
+float *activation_cache_store(ActivationCache *cache, int sample, const float *values)
+{
+    if (sample < 0 || sample >= cache->n_samples)
+    {
+        return NULL;
+    }
+    if (cache->values != NULL)
+    {
+        float *stored = cache->values + (size_t)sample * cache->width;
+        memcpy(stored, values, cache->width * sizeof(float));
+        cache->cached[sample] = 1;
+        return stored;
+    }
+    if (fseek(cache->file, (long)((size_t)sample * cache->width * sizeof(float)), SEEK_SET) != 0 ||
+        fwrite(values, sizeof(float), cache->width, cache->file) != (size_t)cache->width)
+    {
+        printf("Error: could not write activation cache file! \n");
+        return NULL;
+    }
+    memcpy(cache->row, values, cache->width * sizeof(float));
+    cache->cached[sample] = 1;
+    return cache->row;
+}
+
+/* Forgets every stored sample, they are computed again on their next use */
+void activation_cache_invalidate(ActivationCache *cache)
+{
+    memset(cache->cached, 0, cache->n_samples * sizeof(uint8_t));
+}
+
+/* Frees a cache, a spill file is left on disk */
+void free_activation_cache(ActivationCache *cache)
+{
+#ifdef ACTIVATION_CACHE_MMAP
+    if (cache->mapped)
+    {
+        munmap(cache->values, cache->n_bytes);
+        cache->values = NULL;
+    }
+#endif
+    if (cache->file != NULL)
+    {
+        fclose(cache->file);
+    }
+    else if (cache->values != NULL)
+    {
+        free(cache->values);
+    }
+    if (cache->row != NULL)
+    {
+        free(cache->row);
+    }
+    if (cache->cached != NULL)
+    {
+        free(cache->cached);
+    }
+    free(cache);
+}
@@ -0,0 +1,33 @@
+#ifndef ACTIVATION_CACHE_H
+#define ACTIVATION_CACHE_H
+#include "config.h"
+#include "model_binding.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/* Inputs of the target layer of partial training for every sample of a dataset, keyed by sample index.
+    The layers below the target are frozen while it is trained, so the input of a sample is computed by them
+    once and read back on every later step, see fc_model_train_partial_layer_cached.
+    The values are held in RAM, or spilled to a file: mapped where mmap is available, read and written
+    one sample at a time otherwise. After changing any layer below the target, e.g. by training it,
+    activation_cache_invalidate must be called. */
+typedef struct
+{
+    int target_layer;
+    int width;          // floats per sample, the input size of the target layer
+    int n_samples;
+    uint8_t *cached;    // per sample, whether its values are stored
+    float *values;      // n_samples x width, NULL when spilled without mmap
+    size_t n_bytes;     // bytes of values
+    FILE *file;         // spill file, NULL when the values are in RAM
+    int mapped;         // values map the spill file
+    float *row;         // one sample read from the spill file when it is not mapped
+} ActivationCache;
+
+ActivationCache *create_activation_cache(Model *model, int target_layer, int n_samples, const char *path);
+float *activation_cache_lookup(ActivationCache *cache, int sample);
+float *activation_cache_store(ActivationCache *cache, int sample, const float *values);
+void activation_cache_invalidate(ActivationCache *cache);
+void free_activation_cache(ActivationCache *cache);
+
+#endif
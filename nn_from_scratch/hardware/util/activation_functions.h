@@ -14,4 +14,14 @@ float relu_deriv(float x);
 float linear_deriv(float x);
 ActivationFunc get_activation_func(enum ActivationType activationType);
 ActivationFunc get_activation_func_deriv(enum ActivationType activationType);
+
+/* inlinable versions, used by kernels that are specialized per activation type */
+static inline float relu_inline(float x)
+{
+    return (x > 0) ? x : 0;
+}
+static inline float linear_inline(float x)
+{
+    return x;
+}
 #endif
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "config.h"
+#include "kernels.h"
 /* Back propagation function for one layer, updates the output neurons with gradients
     @param input_gradient: pointer to input gradients (going backwards)
     @param net_inputs: pointer to stored input neruon values, which gradients will be stored in
@@ -18,63 +19,144 @@ void fc_back_prop(float *input_gradient, float *net_inputs, float *weights,
                   int input_size, int net_inputs_size, ActivationFunc activation_func, ActivationFunc activation_func_deriv,
                   float *gradient_weights, float *gradient_biases)
 {
-    float *temp = calloc(net_inputs_size, sizeof(float));
+    const Kernels *kernels = get_kernels();
 
-    for (int i = 0; i < input_size; i++)
+    // add gradient to bias array
+    kernels->axpy(gradient_biases, input_gradient, 1, input_size);
+
+    /* Row j of the weights connects net input j to every gradient. Each row is walked once, in memory order,
+        accumulating the weight gradients and the gradient for net input j in the same sweep.
+        The activation and its derivative are evaluated once per row, a zero skips the half of the work it cancels,
+        which for relu layers is every inactive neuron. */
+    for (int j = 0; j < net_inputs_size; j++)
     {
-        float gradient = input_gradient[i];
-        // add gradient to bias array
-        gradient_biases[i] += gradient;
+        float activation = activation_func(net_inputs[j]);
+        float deriv = activation_func_deriv(net_inputs[j]);
+        float *gradient_row = gradient_weights + j * input_size;
+        const float *weights_row = weights + j * input_size;
 
-        // weight gradients
-        for (int j = 0; j < net_inputs_size; j++)
+        if (deriv == 0)
         {
-            // adding gradient weights
-            gradient_weights[i + j * input_size] += gradient * activation_func(net_inputs[j]);
-            // gradient neuron
-
-            temp[j] += weights[i + j * input_size] * gradient;
+            if (activation != 0)
+            {
+                kernels->axpy(gradient_row, input_gradient, activation, input_size);
+            }
+            net_inputs[j] = 0;
+        }
+        else if (activation == 0)
+        {
+            net_inputs[j] = kernels->dot(weights_row, input_gradient, input_size) * deriv;
+        }
+        else
+        {
+            // row j is only needed for net input j so it can be overwritten right away
+            net_inputs[j] = kernels->axpy_dot(gradient_row, input_gradient, activation, weights_row, input_size) * deriv;
         }
     }
+}
 
-    // gradients for next layer
-    for (int j = 0; j < net_inputs_size; j++)
+/* Packs the derivative of an activation at the net inputs of a layer into a mask, see KERNEL_MASK_BITS.
+    Relu and linear are the only activations, their derivative is 1 where the mask bit is set and 0 elsewhere.
+    @param mask: KERNEL_MASK_WORDS(n) words
+*/
+void pack_deriv_mask(uint32_t *mask, const float *net_inputs, int n, enum ActivationType activation)
+{
+    if (activation == RELU)
     {
-        net_inputs[j] = temp[j] * activation_func_deriv(net_inputs[j]);
+        get_kernels()->mask_pack(mask, net_inputs, n);
+        return;
+    }
+    memset(mask, 0xff, KERNEL_MASK_WORDS(n) * sizeof(uint32_t));
+    if (n % KERNEL_MASK_BITS != 0)
+    {
+        mask[n / KERNEL_MASK_BITS] = ((uint32_t)1 << (n % KERNEL_MASK_BITS)) - 1;
     }
-
-    free(temp);
 }
 
+/* Calls row_expr for each neuron j with a set bit in deriv_mask, visiting the set bits of a word by their index.
+    The rows of inactive neurons are not read, mask_apply then zeroes whatever their outputs held. */
+#define FOR_EACH_ACTIVE_ROW(deriv_mask, n, j, row_expr)                              \
+    for (int word = 0; word < KERNEL_MASK_WORDS(n); word++)                         \
+    {                                                                               \
+        for (uint32_t bits = (deriv_mask)[word]; bits != 0; bits &= bits - 1)       \
+        {                                                                           \
+            int j = word * KERNEL_MASK_BITS + __builtin_ctz(bits);                  \
+            row_expr;                                                               \
+        }                                                                           \
+    }
+
 /* Will backpropagate under the partial training conditions. Meaning it uses the derivative values.
-    @return gradients when backpropagating to the output layer
+    @return output, filled with the gradients when backpropagating to the output layer
+    @param deriv_mask: derivative mask of the output layer, see pack_deriv_mask
+    @param output: output_layer_size floats, must not overlap input_gradient
 */
 float *light_fc_back_prop(float *input_gradient, float *weights,
-                          int input_size, int output_layer_size, uint8_t *deriv_activation_val)
+                          int input_size, int output_layer_size, const uint32_t *deriv_mask, float *output)
+{
+    const Kernels *kernels = get_kernels();
+
+    // gradients for next layer, scaled by the derivative value
+    FOR_EACH_ACTIVE_ROW(deriv_mask, output_layer_size, j, output[j] = kernels->dot(weights + j * input_size, input_gradient, input_size));
+    kernels->mask_apply(output, deriv_mask, output_layer_size);
+
+    return output;
+}
+
+/* light_fc_back_prop with 16-bit weights, see compressModelWeights */
+float *light_fc_back_prop_half(float *input_gradient, const uint16_t *weights, enum HalfFormat format,
+                               int input_size, int output_layer_size, const uint32_t *deriv_mask, float *output)
+{
+    const Kernels *kernels = get_kernels();
+    DotHalfKernel dot = kernels->dot_half[format];
+
+    FOR_EACH_ACTIVE_ROW(deriv_mask, output_layer_size, j, output[j] = dot(weights + j * input_size, input_gradient, input_size));
+    kernels->mask_apply(output, deriv_mask, output_layer_size);
+
+    return output;
+}
+
+/* fc_back_prop with sparse weights, see sparsifyModelLayer. Only the gradients of the nonzero weights are accumulated,
+    the others stay zero so training keeps the pruned weights at zero.
+    @param weights: sparse weights between input/output, one row per net input
+*/
+void fc_back_prop_sparse(float *input_gradient, float *net_inputs, const SparseWeights *weights,
+                         int input_size, int net_inputs_size, ActivationFunc activation_func, ActivationFunc activation_func_deriv,
+                         float *gradient_weights, float *gradient_biases)
 {
-    float *output = calloc(output_layer_size, sizeof(float));
+    const Kernels *kernels = get_kernels();
+
+    kernels->axpy(gradient_biases, input_gradient, 1, input_size);
 
-    for (int i = 0; i < input_size; i++)
+    for (int j = 0; j < net_inputs_size; j++)
     {
-        float gradient = input_gradient[i];
-        // add gradient to bias array
+        float activation = activation_func(net_inputs[j]);
+        float deriv = activation_func_deriv(net_inputs[j]);
+        float *gradient_row = gradient_weights + j * input_size;
+        const int *columns = weights->columns + weights->row_start[j];
+        int n = weights->row_start[j + 1] - weights->row_start[j];
 
-        // weight gradients
-        for (int j = 0; j < output_layer_size; j++)
+        if (activation != 0)
         {
-            // adding gradient weights
-            // gradient_weights[i + j * input_size] += gradient * activation_func(output[j], 0);
-            // gradient neuron
-
-            output[j] += weights[i + j * input_size] * gradient;
+            for (int i = 0; i < n; i++)
+            {
+                gradient_row[columns[i]] += activation * input_gradient[columns[i]];
+            }
         }
+        net_inputs[j] = (deriv == 0) ? 0 : kernels->sparse_dot(weights->values + weights->row_start[j], columns, input_gradient, n) * deriv;
     }
+}
 
-    // gradients for next layer
-    for (int j = 0; j < output_layer_size; j++)
-    {
-        output[j] *= deriv_activation_val[j]; // derivative value
-    }
+/* light_fc_back_prop with sparse weights, see sparsifyModelLayer */
+float *light_fc_back_prop_sparse(float *input_gradient, const SparseWeights *weights,
+                                 int output_layer_size, const uint32_t *deriv_mask, float *output)
+{
+    const Kernels *kernels = get_kernels();
+    const int *row_start = weights->row_start;
+
+    FOR_EACH_ACTIVE_ROW(deriv_mask, output_layer_size, j,
+                        output[j] = kernels->sparse_dot(weights->values + row_start[j], weights->columns + row_start[j],
+                                                        input_gradient, row_start[j + 1] - row_start[j]));
+    kernels->mask_apply(output, deriv_mask, output_layer_size);
 
     return output;
 }
@@ -86,18 +168,40 @@ void specific_fc_back_prop(float *input_gradient, float *net_input,
                            int layer_size, ActivationFunc activation_func,
                            float *gradient_weights, float *gradient_biases, int n_neurons)
 {
-    for (int i = 0; i < layer_size; i++)
+    AxpyKernel axpy = get_kernels()->axpy;
+
+    // add gradient to bias array
+    axpy(gradient_biases, input_gradient, 1, layer_size);
+
+    // weight gradients, one contiguous row per chosen neuron
+    for (int j = 0; j < n_neurons; j++)
     {
-        float gradient = input_gradient[i];
-        // add gradient to bias array
-        gradient_biases[i] += gradient;
+        axpy(gradient_weights + j * layer_size, input_gradient, activation_func(net_input[j]), layer_size);
+    }
+}
+
+/* specific_fc_back_prop with sparse weights, only the gradients of the nonzero weights of the chosen neurons are accumulated
+    @param weights: sparse weights of the layer
+    @param offset: row of the weights of the first chosen neuron
+ */
+void specific_fc_back_prop_sparse(float *input_gradient, float *net_input,
+                                  int layer_size, ActivationFunc activation_func,
+                                  float *gradient_weights, float *gradient_biases, int n_neurons,
+                                  const SparseWeights *weights, int offset)
+{
+    get_kernels()->axpy(gradient_biases, input_gradient, 1, layer_size);
 
-        // weight gradients
-        for (int j = 0; j < n_neurons; j++)
+    for (int j = 0; j < n_neurons; j++)
+    {
+        float activation = activation_func(net_input[j]);
+        if (activation == 0)
         {
-            // adding gradient weights
-            gradient_weights[i + j * layer_size] += gradient * activation_func(net_input[j]);
-            // gradient biases for prev
+            continue;
+        }
+        float *gradient_row = gradient_weights + j * layer_size;
+        for (int i = weights->row_start[offset + j]; i < weights->row_start[offset + j + 1]; i++)
+        {
+            gradient_row[weights->columns[i]] += activation * input_gradient[weights->columns[i]];
         }
     }
-}
\ No newline at end of file
+}
@@ -2,15 +2,33 @@
 #define BACK_PROP_H
 #include <stdint.h>
 #include "activation_functions.h"
+#include "kernels.h"
 
 void fc_back_prop(float *input_gradient, float *net_inputs, float *weights,
                   int input_size, int net_inputs_size, ActivationFunc activation_func, ActivationFunc activation_func_deriv,
                   float *gradient_weights, float *gradient_biases);
 
+void pack_deriv_mask(uint32_t *mask, const float *net_inputs, int n, enum ActivationType activation);
+
 float *light_fc_back_prop(float *input_gradient, float *weights,
-                          int input_size, int output_layer_size, uint8_t *deriv_activation_val);
+                          int input_size, int output_layer_size, const uint32_t *deriv_mask, float *output);
+
+float *light_fc_back_prop_half(float *input_gradient, const uint16_t *weights, enum HalfFormat format,
+                               int input_size, int output_layer_size, const uint32_t *deriv_mask, float *output);
 
 void specific_fc_back_prop(float *input_gradient, float *net_input,
                            int input_size, ActivationFunc activation_func,
                            float *gradient_weights, float *gradient_biases, int n_neurons);
+
+void fc_back_prop_sparse(float *input_gradient, float *net_inputs, const SparseWeights *weights,
+                         int input_size, int net_inputs_size, ActivationFunc activation_func, ActivationFunc activation_func_deriv,
+                         float *gradient_weights, float *gradient_biases);
+
+float *light_fc_back_prop_sparse(float *input_gradient, const SparseWeights *weights,
+                                 int output_layer_size, const uint32_t *deriv_mask, float *output);
+
+void specific_fc_back_prop_sparse(float *input_gradient, float *net_input,
+                                  int layer_size, ActivationFunc activation_func,
+                                  float *gradient_weights, float *gradient_biases, int n_neurons,
+                                  const SparseWeights *weights, int offset);
 #endif
\ No newline at end of file
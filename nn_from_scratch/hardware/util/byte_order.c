@@ -0,0 +1,59 @@
+#include "byte_order.h"
+#include <string.h>
+
+int host_is_little_endian(void)
+{
+    uint16_t x = 1;
+    return *(uint8_t *)&x == 1;
+}
+
+/* reads a little-endian uint32 */
+uint32_t read_u32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+/* stores a uint32 in little-endian order */
+void put_u32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+}
+
+/* converts n floats between little-endian and host order, in place */
+void swap_floats(float *values, size_t n)
+{
+    if (host_is_little_endian())
+    {
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t value = read_u32((const uint8_t *)(values + i));
+        memcpy(values + i, &value, sizeof(float));
+    }
+}
+
+/* writes n floats in little-endian order
+    @return 0 on success */
+int write_floats(const float *values, int n, FILE *file)
+{
+    if (host_is_little_endian())
+    {
+        return fwrite(values, sizeof(float), n, file) == (size_t)n ? 0 : -1;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t value;
+        uint8_t bytes[4];
+        memcpy(&value, values + i, sizeof(float));
+        put_u32(bytes, value);
+        if (fwrite(bytes, 1, 4, file) != 4)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef BYTE_ORDER_H
+#define BYTE_ORDER_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Little-endian fields of the binary model and sample files, read and written the same on any host */
+int host_is_little_endian(void);
+uint32_t read_u32(const uint8_t *bytes);
+void put_u32(uint8_t *bytes, uint32_t value);
+void swap_floats(float *values, size_t n);
+int write_floats(const float *values, int n, FILE *file);
+
+#endif
@@ -1,12 +1,47 @@
 #include "../settings/user_settings.h"
 #ifdef ENABLE_TRACK_MEMORY
 #include "track_memory.h"
+#else
+// phase markers for the memory timeline compile away without memory tracking
+#define MEMORY_PHASE_BEGIN(name)
+#define MEMORY_PHASE_END()
+#endif
+#ifdef ENABLE_PROFILING
+#include "profiler.h"
+#else
+// hot-path timers compile away without profiling
+#define PROFILE_START(stamp)
+#define PROFILE_STOP(stamp, op, layer, flops, samples)
 #endif
 
 #ifndef MAX_BLOCKS
 #define MAX_BLOCKS 2500
 #endif
 
+#ifndef TRACK_MAX_SITES
+#define TRACK_MAX_SITES 256 // power of two, allocation sites beyond this are counted under one overflow site
+#endif
+
+#ifndef TRACK_TIMELINE_CAPACITY
+#define TRACK_TIMELINE_CAPACITY 4096 // timeline entries kept, later events are only counted
+#endif
+
+#ifndef TRACK_MAX_PHASES
+#define TRACK_MAX_PHASES 32 // distinct phase names summarized
+#endif
+
+#ifndef TRACK_MAX_PHASE_DEPTH
+#define TRACK_MAX_PHASE_DEPTH 8
+#endif
+
+#ifndef PROFILE_MAX_LAYERS
+#define PROFILE_MAX_LAYERS 16 // layers profiled separately, deeper layers are counted with the last one
+#endif
+
+#ifndef QUANT_EQCHECK_TOLERANCE
+#define QUANT_EQCHECK_TOLERANCE 0.05 // largest absolute error of the int8 model accepted by the quantized eqcheck
+#endif
+
 #ifndef BATCH_SIZE
 #define BATCH_SIZE 64
 #endif
@@ -18,3 +53,39 @@
 #ifndef LEARNING_RATE
 #define LEARNING_RATE 0.001
 #endif
+
+#ifndef SGD_MOMENTUM
+#define SGD_MOMENTUM 0.9f // defaults of the optimizers, see create_optimizer
+#endif
+
+#ifndef ADAM_BETA1
+#define ADAM_BETA1 0.9f
+#endif
+
+#ifndef ADAM_BETA2
+#define ADAM_BETA2 0.999f
+#endif
+
+#ifndef ADAM_EPSILON
+#define ADAM_EPSILON 1e-8f
+#endif
+
+#ifndef ADAMW_WEIGHT_DECAY
+#define ADAMW_WEIGHT_DECAY 0.01f
+#endif
+
+#ifndef FIT_EVAL_ROWS
+#define FIT_EVAL_ROWS 256 // rows predicted at once when fc_model_fit evaluates the loss for early stopping
+#endif
+
+#ifndef FC_BATCH_BLOCK_ROWS
+#define FC_BATCH_BLOCK_ROWS 32
+#endif
+
+#ifndef FC_BATCH_BLOCK_K
+#define FC_BATCH_BLOCK_K 64
+#endif
+
+#ifndef FC_Q8_BLOCK_ROWS
+#define FC_Q8_BLOCK_ROWS 64 // outputs of a quantized layer accumulated per kernel call
+#endif
@@ -4,6 +4,134 @@
 #include <string.h>
 #include <stdio.h>
 #include "config.h"
+#include "kernels.h"
+
+/* Generates the kernels for one activation type. The matmul accumulates one contiguous row of weights
+    per input on top of the biases, and the activation is applied as the epilogue of each output row
+    while it is still in cache, so the loops contain no indirect activation calls.
+*/
+#define FC_FORWARD_PROP_VARIANT(activation)                                                                   \
+    void fc_forward_prop_batch_##activation(const float *input, int n_samples, int input_size, float *output, \
+                                            int output_size, const float *weights, const float *biases)      \
+    {                                                                                                         \
+        AxpyKernel axpy = get_kernels()->axpy;                                                                \
+        for (int s = 0; s < n_samples; s++)                                                                   \
+        {                                                                                                     \
+            memcpy(output + s * output_size, biases, output_size * sizeof(float));                            \
+        }                                                                                                     \
+        for (int k = 0; k < input_size; k += FC_BATCH_BLOCK_K)                                                \
+        {                                                                                                     \
+            int k_end = (k + FC_BATCH_BLOCK_K < input_size) ? k + FC_BATCH_BLOCK_K : input_size;              \
+            for (int s = 0; s < n_samples; s++)                                                               \
+            {                                                                                                 \
+                const float *in_row = input + s * input_size;                                                 \
+                float *out_row = output + s * output_size;                                                    \
+                for (int j = k; j < k_end; j++)                                                               \
+                {                                                                                             \
+                    axpy(out_row, weights + j * output_size, in_row[j], output_size);                         \
+                }                                                                                             \
+                if (k_end == input_size)                                                                      \
+                {                                                                                             \
+                    for (int i = 0; i < output_size; i++)                                                     \
+                    {                                                                                         \
+                        out_row[i] = activation##_inline(out_row[i]);                                         \
+                    }                                                                                         \
+                }                                                                                             \
+            }                                                                                                 \
+        }                                                                                                     \
+    }                                                                                                         \
+                                                                                                              \
+    void fc_forward_prop_t_##activation(const float *input, int input_size, float *output, int output_size,  \
+                                        const float *weights, const float *biases)                           \
+    {                                                                                                         \
+        AxpyKernel axpy = get_kernels()->axpy;                                                                \
+        memcpy(output, biases, output_size * sizeof(float));                                                  \
+        for (int j = 0; j < input_size; j++)                                                                  \
+        {                                                                                                     \
+            float x = activation##_inline(input[j]);                                                          \
+            /* inputs cut off by the activation contribute nothing */                                         \
+            if (x != 0)                                                                                       \
+            {                                                                                                 \
+                axpy(output, weights + j * output_size, x, output_size);                                      \
+            }                                                                                                 \
+        }                                                                                                     \
+    }                                                                                                         \
+                                                                                                              \
+    void fc_forward_prop_packed_##activation(const float *input, int n_samples, int input_size, float *output, \
+                                             int output_size, const float *panels, const float *biases)       \
+    {                                                                                                         \
+        PanelKernel panel = get_kernels()->panel;                                                             \
+        int panel_stride = input_size * KERNEL_PANEL_WIDTH;                                                   \
+        int group_width = KERNEL_PANEL_GROUP * KERNEL_PANEL_WIDTH;                                            \
+        float tile[KERNEL_PANEL_GROUP * KERNEL_PANEL_WIDTH];                                                  \
+        /* a group of panels is reused for every sample before moving on to the next outputs */               \
+        for (int c = 0; c < output_size; c += group_width)                                                    \
+        {                                                                                                     \
+            int width = (output_size - c < group_width) ? output_size - c : group_width;                      \
+            int n_panels = (width + KERNEL_PANEL_WIDTH - 1) / KERNEL_PANEL_WIDTH;                             \
+            const float *group = panels + (c / KERNEL_PANEL_WIDTH) * panel_stride;                            \
+            for (int s = 0; s < n_samples; s++)                                                               \
+            {                                                                                                 \
+                memcpy(tile, biases + c, width * sizeof(float));                                              \
+                memset(tile + width, 0, (group_width - width) * sizeof(float));                               \
+                panel(tile, input + s * input_size, group, panel_stride, n_panels, input_size);               \
+                float *out_row = output + s * output_size + c;                                                \
+                for (int i = 0; i < width; i++)                                                               \
+                {                                                                                             \
+                    out_row[i] = activation##_inline(tile[i]);                                                \
+                }                                                                                             \
+            }                                                                                                 \
+        }                                                                                                     \
+    }
+
+FC_FORWARD_PROP_VARIANT(relu)
+FC_FORWARD_PROP_VARIANT(linear)
+
+ForwardPropBatchFunc get_forward_prop_batch_func(enum ActivationType activationType)
+{
+    switch (activationType)
+    {
+    case RELU:
+        return fc_forward_prop_batch_relu;
+
+    case LINEAR:
+        return fc_forward_prop_batch_linear;
+    default:
+        printf("Error unknown activation type: defaulting to LINEAR\n");
+        return fc_forward_prop_batch_linear;
+    }
+}
+
+ForwardPropPackedFunc get_forward_prop_packed_func(enum ActivationType activationType)
+{
+    switch (activationType)
+    {
+    case RELU:
+        return fc_forward_prop_packed_relu;
+
+    case LINEAR:
+        return fc_forward_prop_packed_linear;
+    default:
+        printf("Error unknown activation type: defaulting to LINEAR\n");
+        return fc_forward_prop_packed_linear;
+    }
+}
+
+ForwardPropTFunc get_forward_prop_t_func(enum ActivationType activationType)
+{
+    switch (activationType)
+    {
+    case RELU:
+        return fc_forward_prop_t_relu;
+
+    case LINEAR:
+        return fc_forward_prop_t_linear;
+    default:
+        printf("Error unknown activation type: defaulting to LINEAR\n");
+        return fc_forward_prop_t_linear;
+    }
+}
+
 /* forward propagation allocates output memory
     @result returns activation result for output for layer, and allocate memory from each layer
 
@@ -18,18 +146,7 @@ float *fc_forward_prop(float *input, float *weights, float *biases,
                        int input_size, int output_size, ActivationFunc activation_func)
 {
     float *output = (float *)malloc(output_size * sizeof(float));
-    for (int i = 0; i < output_size; i++)
-    {
-        float sum = 0;
-        for (int j = 0; j < input_size; j++)
-        {
-            // indexing for correct weight
-            sum += input[j] * weights[i + j * output_size];
-        }
-        // add bias
-        sum += biases[i];
-        output[i] = activation_func(sum);
-    }
+    fc_forward_prop_batch(input, 1, input_size, output, output_size, weights, biases, activation_func);
     return output;
 }
 
@@ -46,18 +163,187 @@ float *fc_forward_prop(float *input, float *weights, float *biases,
 */
 float *fc_forward_prop_t(float *input, int input_size, float *output, int output_size, float *weights, float *biases, ActivationFunc activation_func)
 {
-    for (int i = 0; i < output_size; i++)
+    // known activations go through their specialized kernels
+    if (activation_func == relu || activation_func == linear)
+    {
+        ForwardPropTFunc forward = (activation_func == relu) ? fc_forward_prop_t_relu : fc_forward_prop_t_linear;
+        forward(input, input_size, output, output_size, weights, biases);
+        return output;
+    }
+
+    AxpyKernel axpy = get_kernels()->axpy;
+
+    // add bias, then accumulate one contiguous row of weights per input
+    memcpy(output, biases, output_size * sizeof(float));
+    for (int j = 0; j < input_size; j++)
+    {
+        axpy(output, weights + j * output_size, activation_func(input[j]), output_size);
+    }
+    return output;
+}
+
+/* forward propagation for a batch of samples, computed as a blocked matrix-matrix product.
+    Each block of FC_BATCH_BLOCK_K weight rows is reused for every sample before moving on,
+    so the weights are streamed from memory once per call instead of once per sample.
+    @result output is filled with the activated outputs, row-major (n_samples x output_size)
+
+    @param input: input rows for the layer, row-major (n_samples x input_size)
+    @param n_samples: number of rows in input and output
+    @param input_size: size of the input for the layer
+    @param output: pointer to where output will be stored, must not overlap input
+    @param output_size: size of the output for the layer
+    @param weights: weights pointer for the layer
+    @param biases: biases pointer for the layer
+    @param activation_func: activation function for the output layer
+*/
+void fc_forward_prop_batch(const float *input, int n_samples, int input_size, float *output, int output_size,
+                           const float *weights, const float *biases, ActivationFunc activation_func)
+{
+    // known activations go through their specialized kernels
+    if (activation_func == relu || activation_func == linear)
+    {
+        ForwardPropBatchFunc forward = (activation_func == relu) ? fc_forward_prop_batch_relu : fc_forward_prop_batch_linear;
+        forward(input, n_samples, input_size, output, output_size, weights, biases);
+        return;
+    }
+
+    // otherwise compute the linear part and apply the activation afterwards
+    fc_forward_prop_batch_linear(input, n_samples, input_size, output, output_size, weights, biases);
+    for (int i = 0; i < n_samples * output_size; i++)
+    {
+        output[i] = activation_func(output[i]);
+    }
+}
+
+/* forward propagation for a batch of samples with 16-bit weights, see compressModelWeights.
+    Same blocking as fc_forward_prop_batch, the weights are expanded to float inside the kernel.
+    @param weights: weights of the layer in format
+    @param format: 16-bit format of the weights
+*/
+void fc_forward_prop_batch_half(const float *input, int n_samples, int input_size, float *output, int output_size,
+                                const uint16_t *weights, enum HalfFormat format, const float *biases, ActivationFunc activation_func)
+{
+    AxpyHalfKernel axpy = get_kernels()->axpy_half[format];
+    for (int s = 0; s < n_samples; s++)
+    {
+        memcpy(output + s * output_size, biases, output_size * sizeof(float));
+    }
+    for (int k = 0; k < input_size; k += FC_BATCH_BLOCK_K)
+    {
+        int k_end = (k + FC_BATCH_BLOCK_K < input_size) ? k + FC_BATCH_BLOCK_K : input_size;
+        for (int s = 0; s < n_samples; s++)
+        {
+            for (int j = k; j < k_end; j++)
+            {
+                axpy(output + s * output_size, weights + j * output_size, input[s * input_size + j], output_size);
+            }
+        }
+    }
+    if (activation_func != linear)
+    {
+        for (int i = 0; i < n_samples * output_size; i++)
+        {
+            output[i] = activation_func(output[i]);
+        }
+    }
+}
+
+/* forward propagation used when training, with 16-bit weights, see fc_forward_prop_t
+    @param weights: weights of the layer in format
+    @param format: 16-bit format of the weights
+    @param activation_func: activation function for the input layer
+*/
+void fc_forward_prop_t_half(const float *input, int input_size, float *output, int output_size,
+                            const uint16_t *weights, enum HalfFormat format, const float *biases, ActivationFunc activation_func)
+{
+    AxpyHalfKernel axpy = get_kernels()->axpy_half[format];
+    memcpy(output, biases, output_size * sizeof(float));
+    for (int j = 0; j < input_size; j++)
+    {
+        float x = activation_func(input[j]);
+        if (x != 0)
+        {
+            axpy(output, weights + j * output_size, x, output_size);
+        }
+    }
+}
+
+/* forward propagation for a batch of samples with sparse weights, see sparsifyModelLayer. Every nonzero input
+    scatters its row of nonzero weights into the outputs, so the work scales with the nonzeros of the layer.
+    @param weights: sparse weights of the layer, one row per input
+*/
+void fc_forward_prop_batch_sparse(const float *input, int n_samples, int input_size, float *output, int output_size,
+                                  const SparseWeights *weights, const float *biases, ActivationFunc activation_func)
+{
+    SparseAxpyKernel sparse_axpy = get_kernels()->sparse_axpy;
+    for (int s = 0; s < n_samples; s++)
     {
-        // get sum
-        float sum = 0;
+        const float *in_row = input + s * input_size;
+        float *out_row = output + s * output_size;
+        memcpy(out_row, biases, output_size * sizeof(float));
         for (int j = 0; j < input_size; j++)
         {
-            // indexing for correct weight
-            sum += activation_func(input[j]) * weights[i + j * output_size];
+            int start = weights->row_start[j];
+            if (in_row[j] != 0)
+            {
+                sparse_axpy(out_row, weights->columns + start, weights->values + start, in_row[j], weights->row_start[j + 1] - start);
+            }
         }
-        // add bias
-        sum += biases[i];
-        output[i] = sum;
     }
-    return output;
-}
\ No newline at end of file
+    if (activation_func != linear)
+    {
+        for (int i = 0; i < n_samples * output_size; i++)
+        {
+            output[i] = activation_func(output[i]);
+        }
+    }
+}
+
+/* forward propagation used when training, with sparse weights, see fc_forward_prop_t
+    @param weights: sparse weights of the layer, one row per input
+    @param activation_func: activation function for the input layer
+*/
+void fc_forward_prop_t_sparse(const float *input, int input_size, float *output, int output_size,
+                              const SparseWeights *weights, const float *biases, ActivationFunc activation_func)
+{
+    SparseAxpyKernel sparse_axpy = get_kernels()->sparse_axpy;
+    memcpy(output, biases, output_size * sizeof(float));
+    for (int j = 0; j < input_size; j++)
+    {
+        float x = activation_func(input[j]);
+        int start = weights->row_start[j];
+        if (x != 0)
+        {
+            sparse_axpy(output, weights->columns + start, weights->values + start, x, weights->row_start[j + 1] - start);
+        }
+    }
+}
+
+/* forward propagation of an int8 quantized layer, see QuantizedModel. The products of int8 inputs and weights
+    are accumulated in int32 on top of the pre-scaled biases, then dequantized per output channel.
+    @result output is filled with the net inputs of the layer, the activation is left to the caller
+    @param input: quantized input of the layer, input_scale per unit
+    @param input_size: size of the input for the layer
+    @param input_scale: scale of the input
+    @param output: pointer to where the net inputs will be stored
+    @param output_size: size of the output for the layer
+    @param weights: quantized weights, output-major (output_size x input_size)
+    @param weight_scales: scale of the weights of each output
+    @param biases: biases in units of input_scale * weight_scales[i]
+*/
+void fc_forward_prop_q8(const int8_t *input, int input_size, float input_scale, float *output, int output_size,
+                        const int8_t *weights, const float *weight_scales, const int32_t *biases)
+{
+    DotI8Kernel dot_i8 = get_kernels()->dot_i8;
+    int32_t acc[FC_Q8_BLOCK_ROWS];
+    for (int c = 0; c < output_size; c += FC_Q8_BLOCK_ROWS)
+    {
+        int n_rows = (output_size - c < FC_Q8_BLOCK_ROWS) ? output_size - c : FC_Q8_BLOCK_ROWS;
+        dot_i8(acc, weights + c * input_size, input, n_rows, input_size);
+        for (int i = 0; i < n_rows; i++)
+        {
+            // the bias may be saturated to +-INT32_MAX, so it is added to the dot product in 64 bits
+            output[c + i] = (float)((int64_t)acc[i] + biases[c + i]) * (input_scale * weight_scales[c + i]);
+        }
+    }
+}
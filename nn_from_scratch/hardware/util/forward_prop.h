@@ -1,28 +1,57 @@
-
+#ifndef FORWARD_PROP_H
+#define FORWARD_PROP_H
 #include "activation_functions.h"
+#include "kernels.h"
 #include <stdint.h>
 extern float *fc_forward_prop(float *input, float *layer_weights, float *layer_biases, int input_size,
                               int output_size, ActivationFunc activation_func);
 
 extern float *fc_forward_prop_t(float *input, int input_size, float *output, int output_size, float *weights, float *biases, ActivationFunc activation_func);
-/*
-#define FC_FORWARD_PROP_VARIANT(activation_function)               \
-    fc_forward_prop_##activation_function(input, weights, biases,  \
-                                          input_size, output_size) \
-    {                                                              \
-        output = malloc(output_size * sizeof(float));              \
-        for (int i = 0; i < output_size; i++)                      \
-        {                                                          \
-            sum = 0;                                               \
-            for (int j = 0; j < input_size; j++)                   \
-            {                                                      \
-                sum += input[j] * weights[i + j * output_size];    \
-            }                                                      \
-            sum += biases[i];                                      \
-            output[i] = activation_func(sum);                      \
-        }                                                          \
-        return output;                                             \
-    }
-
-
-FC_FORWARD_PROP_VARIANT(relu)*/
\ No newline at end of file
+
+extern void fc_forward_prop_batch(const float *input, int n_samples, int input_size, float *output, int output_size,
+                                  const float *weights, const float *biases, ActivationFunc activation_func);
+
+extern void fc_forward_prop_batch_half(const float *input, int n_samples, int input_size, float *output, int output_size,
+                                       const uint16_t *weights, enum HalfFormat format, const float *biases,
+                                       ActivationFunc activation_func);
+
+extern void fc_forward_prop_t_half(const float *input, int input_size, float *output, int output_size,
+                                   const uint16_t *weights, enum HalfFormat format, const float *biases,
+                                   ActivationFunc activation_func);
+
+extern void fc_forward_prop_batch_sparse(const float *input, int n_samples, int input_size, float *output, int output_size,
+                                         const SparseWeights *weights, const float *biases, ActivationFunc activation_func);
+
+extern void fc_forward_prop_t_sparse(const float *input, int input_size, float *output, int output_size,
+                                     const SparseWeights *weights, const float *biases, ActivationFunc activation_func);
+
+extern void fc_forward_prop_q8(const int8_t *input, int input_size, float input_scale, float *output, int output_size,
+                               const int8_t *weights, const float *weight_scales, const int32_t *biases);
+
+/* Kernels specialized per activation type, the activation is inlined into the loops instead of called through a pointer.
+    fc_forward_prop_batch_<activation> applies the activation to the layer's output,
+    fc_forward_prop_t_<activation> applies it to the layer's input (the net inputs of the previous layer).
+    fc_forward_prop_packed_<activation> is the batch kernel for the packed panels of a layer, see packModel. */
+typedef void (*ForwardPropBatchFunc)(const float *input, int n_samples, int input_size, float *output, int output_size,
+                                     const float *weights, const float *biases);
+typedef void (*ForwardPropTFunc)(const float *input, int input_size, float *output, int output_size,
+                                 const float *weights, const float *biases);
+typedef void (*ForwardPropPackedFunc)(const float *input, int n_samples, int input_size, float *output, int output_size,
+                                      const float *panels, const float *biases);
+
+#define FC_FORWARD_PROP_VARIANT_DECLARE(activation)                                                                   \
+    extern void fc_forward_prop_batch_##activation(const float *input, int n_samples, int input_size, float *output,  \
+                                                   int output_size, const float *weights, const float *biases);       \
+    extern void fc_forward_prop_t_##activation(const float *input, int input_size, float *output, int output_size,    \
+                                               const float *weights, const float *biases);                            \
+    extern void fc_forward_prop_packed_##activation(const float *input, int n_samples, int input_size, float *output, \
+                                                    int output_size, const float *panels, const float *biases);
+
+FC_FORWARD_PROP_VARIANT_DECLARE(relu)
+FC_FORWARD_PROP_VARIANT_DECLARE(linear)
+
+ForwardPropBatchFunc get_forward_prop_batch_func(enum ActivationType activationType);
+ForwardPropTFunc get_forward_prop_t_func(enum ActivationType activationType);
+ForwardPropPackedFunc get_forward_prop_packed_func(enum ActivationType activationType);
+
+#endif
@@ -0,0 +1,1150 @@
+#include "kernels.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+/* 16-bit float conversions. bf16 is the upper half of an fp32, fp16 has 5 exponent and 10 mantissa bits.
+    Both round to nearest even, fp16 overflows to infinity and keeps subnormals. */
+static inline float bf16_to_float(uint16_t h)
+{
+    uint32_t u = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline uint16_t float_to_bf16(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    if ((u & 0x7fffffff) > 0x7f800000)
+    {
+        return (uint16_t)((u >> 16) | 0x40); // keep nans quiet
+    }
+    u += 0x7fff + ((u >> 16) & 1);
+    return (uint16_t)(u >> 16);
+}
+
+static inline float fp16_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t u;
+    float f;
+    if (exponent == 0x1f)
+    {
+        u = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    else
+    {
+        // zero or subnormal, mantissa * 2^-24
+        f = (float)mantissa * 5.9604644775390625e-8f;
+        memcpy(&u, &f, sizeof(u));
+        u |= sign;
+    }
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline uint16_t float_to_fp16(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    uint16_t sign = (uint16_t)((u >> 16) & 0x8000);
+    uint32_t magnitude = u & 0x7fffffff;
+    if (magnitude > 0x7f800000)
+    {
+        return sign | 0x7e00;
+    }
+    if (magnitude >= 0x477ff000) // 65520 and above round to infinity
+    {
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000) // below 2^-14 the result is subnormal, round |f| * 2^24 to an integer
+    {
+        float scaled;
+        memcpy(&scaled, &magnitude, sizeof(scaled));
+        scaled = (scaled * 16777216.0f + 12582912.0f) - 12582912.0f;
+        return sign | (uint16_t)scaled;
+    }
+    magnitude -= 112u << 23;
+    magnitude += 0xfff + ((magnitude >> 13) & 1);
+    return sign | (uint16_t)(magnitude >> 13);
+}
+
+/* Converts n floats to a 16-bit format */
+void convert_to_half(uint16_t *dst, const float *src, int n, enum HalfFormat format)
+{
+    for (int i = 0; i < n; i++)
+    {
+        dst[i] = (format == HALF_BF16) ? float_to_bf16(src[i]) : float_to_fp16(src[i]);
+    }
+}
+
+/* Converts n values of a 16-bit format to floats */
+void convert_from_half(float *dst, const uint16_t *src, int n, enum HalfFormat format)
+{
+    for (int i = 0; i < n; i++)
+    {
+        dst[i] = (format == HALF_BF16) ? bf16_to_float(src[i]) : fp16_to_float(src[i]);
+    }
+}
+
+/* Scalar reference kernels */
+static void axpy_scalar(float *y, const float *x, float a, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        y[i] += a * x[i];
+    }
+}
+
+static float dot_scalar(const float *x, const float *y, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+static float axpy_dot_scalar(float *y, const float *x, float a, const float *w, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        y[i] += a * x[i];
+        sum += w[i] * x[i];
+    }
+    return sum;
+}
+
+static void dot_i8_scalar(int32_t *y, const int8_t *rows, const int8_t *x, int n_rows, int n)
+{
+    for (int r = 0; r < n_rows; r++)
+    {
+        int32_t sum = 0;
+        for (int i = 0; i < n; i++)
+        {
+            sum += (int32_t)rows[r * n + i] * x[i];
+        }
+        y[r] = sum;
+    }
+}
+
+static void sparse_axpy_scalar(float *y, const int *index, const float *x, float a, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        y[index[i]] += a * x[i];
+    }
+}
+
+static float sparse_dot_scalar(const float *x, const int *index, const float *y, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sum += x[i] * y[index[i]];
+    }
+    return sum;
+}
+
+/* mask kernels are shared by the scalar and generic variants, the bits of a word are built independently */
+static void mask_pack_generic(uint32_t *mask, const float *x, int n)
+{
+    for (int w = 0; w < KERNEL_MASK_WORDS(n); w++)
+    {
+        int base = w * KERNEL_MASK_BITS;
+        int end = (n - base < KERNEL_MASK_BITS) ? n - base : KERNEL_MASK_BITS;
+        uint32_t bits = 0;
+        for (int b = 0; b < end; b++)
+        {
+            bits |= (uint32_t)(x[base + b] > 0) << b;
+        }
+        mask[w] = bits;
+    }
+}
+
+static void mask_apply_generic(float *y, const uint32_t *mask, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        y[i] = ((mask[i / KERNEL_MASK_BITS] >> (i % KERNEL_MASK_BITS)) & 1) ? y[i] : 0;
+    }
+}
+
+/* optimizer updates are shared by the scalar and generic variants, every element is independent */
+static void sgd_generic(float *p, const float *g, const OptimizerStep *step, int n)
+{
+    float rate = step->learning_rate * step->grad_scale;
+    for (int i = 0; i < n; i++)
+    {
+        p[i] -= rate * g[i];
+    }
+}
+
+static void momentum_generic(float *p, const float *g, float *m, const OptimizerStep *step, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        m[i] = step->momentum * m[i] + step->grad_scale * g[i];
+        p[i] -= step->learning_rate * m[i];
+    }
+}
+
+static void adam_generic(float *p, const float *g, float *m, float *v, const OptimizerStep *step, int n)
+{
+    float one_minus_beta1 = 1 - step->beta1;
+    float one_minus_beta2 = 1 - step->beta2;
+    for (int i = 0; i < n; i++)
+    {
+        float grad = step->grad_scale * g[i];
+        m[i] = step->beta1 * m[i] + one_minus_beta1 * grad;
+        v[i] = step->beta2 * v[i] + one_minus_beta2 * grad * grad;
+        p[i] = step->decay * p[i] - (step->learning_rate * m[i]) / (sqrtf(step->v_correction * v[i]) + step->epsilon);
+    }
+}
+
+/* kernels on 16-bit weights, converted to float as they are loaded */
+#define HALF_KERNELS_SCALAR(format)                                                 \
+    static void axpy_##format##_scalar(float *y, const uint16_t *x, float a, int n) \
+    {                                                                               \
+        for (int i = 0; i < n; i++)                                                 \
+        {                                                                           \
+            y[i] += a * format##_to_float(x[i]);                                    \
+        }                                                                           \
+    }                                                                               \
+                                                                                    \
+    static float dot_##format##_scalar(const uint16_t *x, const float *y, int n)    \
+    {                                                                               \
+        float sum = 0;                                                              \
+        for (int i = 0; i < n; i++)                                                 \
+        {                                                                           \
+            sum += format##_to_float(x[i]) * y[i];                                  \
+        }                                                                           \
+        return sum;                                                                 \
+    }
+
+HALF_KERNELS_SCALAR(bf16)
+HALF_KERNELS_SCALAR(fp16)
+
+/* Generic kernels, four independent lanes the compiler can map onto any 128 bit vector unit */
+static void axpy_generic(float *y, const float *x, float a, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        y[i] += a * x[i];
+        y[i + 1] += a * x[i + 1];
+        y[i + 2] += a * x[i + 2];
+        y[i + 3] += a * x[i + 3];
+    }
+    for (; i < n; i++)
+    {
+        y[i] += a * x[i];
+    }
+}
+
+static float dot_generic(const float *x, const float *y, int n)
+{
+    float sum[4] = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        sum[0] += x[i] * y[i];
+        sum[1] += x[i + 1] * y[i + 1];
+        sum[2] += x[i + 2] * y[i + 2];
+        sum[3] += x[i + 3] * y[i + 3];
+    }
+    for (; i < n; i++)
+    {
+        sum[0] += x[i] * y[i];
+    }
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+static float axpy_dot_generic(float *y, const float *x, float a, const float *w, int n)
+{
+    float sum[4] = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        y[i] += a * x[i];
+        y[i + 1] += a * x[i + 1];
+        y[i + 2] += a * x[i + 2];
+        y[i + 3] += a * x[i + 3];
+        sum[0] += w[i] * x[i];
+        sum[1] += w[i + 1] * x[i + 1];
+        sum[2] += w[i + 2] * x[i + 2];
+        sum[3] += w[i + 3] * x[i + 3];
+    }
+    for (; i < n; i++)
+    {
+        y[i] += a * x[i];
+        sum[0] += w[i] * x[i];
+    }
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+/* Panel kernel shared by the variants without a dedicated one, the 16 lanes of a panel row map onto any vector unit */
+static void panel_generic(float *y, const float *x, const float *panels, int panel_stride, int n_panels, int n)
+{
+    for (int p = 0; p < n_panels; p++)
+    {
+        const float *panel = panels + p * panel_stride;
+        float acc[KERNEL_PANEL_WIDTH];
+        memcpy(acc, y + p * KERNEL_PANEL_WIDTH, sizeof(acc));
+        for (int k = 0; k < n; k++)
+        {
+            for (int c = 0; c < KERNEL_PANEL_WIDTH; c++)
+            {
+                acc[c] += x[k] * panel[k * KERNEL_PANEL_WIDTH + c];
+            }
+        }
+        memcpy(y + p * KERNEL_PANEL_WIDTH, acc, sizeof(acc));
+    }
+}
+
+static void dot_i8_generic(int32_t *y, const int8_t *rows, const int8_t *x, int n_rows, int n)
+{
+    for (int r = 0; r < n_rows; r++)
+    {
+        const int8_t *row = rows + r * n;
+        int32_t sum[4] = {0, 0, 0, 0};
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            sum[0] += (int32_t)row[i] * x[i];
+            sum[1] += (int32_t)row[i + 1] * x[i + 1];
+            sum[2] += (int32_t)row[i + 2] * x[i + 2];
+            sum[3] += (int32_t)row[i + 3] * x[i + 3];
+        }
+        for (; i < n; i++)
+        {
+            sum[0] += (int32_t)row[i] * x[i];
+        }
+        y[r] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    }
+}
+
+/* the scattered stores are independent because a row never repeats an index */
+static void sparse_axpy_generic(float *y, const int *index, const float *x, float a, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        y[index[i]] += a * x[i];
+        y[index[i + 1]] += a * x[i + 1];
+        y[index[i + 2]] += a * x[i + 2];
+        y[index[i + 3]] += a * x[i + 3];
+    }
+    for (; i < n; i++)
+    {
+        y[index[i]] += a * x[i];
+    }
+}
+
+static float sparse_dot_generic(const float *x, const int *index, const float *y, int n)
+{
+    float sum[4] = {0, 0, 0, 0};
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        sum[0] += x[i] * y[index[i]];
+        sum[1] += x[i + 1] * y[index[i + 1]];
+        sum[2] += x[i + 2] * y[index[i + 2]];
+        sum[3] += x[i + 3] * y[index[i + 3]];
+    }
+    for (; i < n; i++)
+    {
+        sum[0] += x[i] * y[index[i]];
+    }
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#define HALF_KERNELS_GENERIC(format)                                                 \
+    static void axpy_##format##_generic(float *y, const uint16_t *x, float a, int n) \
+    {                                                                                \
+        int i = 0;                                                                   \
+        for (; i + 4 <= n; i += 4)                                                   \
+        {                                                                            \
+            y[i] += a * format##_to_float(x[i]);                                     \
+            y[i + 1] += a * format##_to_float(x[i + 1]);                             \
+            y[i + 2] += a * format##_to_float(x[i + 2]);                             \
+            y[i + 3] += a * format##_to_float(x[i + 3]);                             \
+        }                                                                            \
+        for (; i < n; i++)                                                           \
+        {                                                                            \
+            y[i] += a * format##_to_float(x[i]);                                     \
+        }                                                                            \
+    }                                                                                \
+                                                                                     \
+    static float dot_##format##_generic(const uint16_t *x, const float *y, int n)    \
+    {                                                                                \
+        float sum[4] = {0, 0, 0, 0};                                                 \
+        int i = 0;                                                                   \
+        for (; i + 4 <= n; i += 4)                                                   \
+        {                                                                            \
+            sum[0] += format##_to_float(x[i]) * y[i];                                \
+            sum[1] += format##_to_float(x[i + 1]) * y[i + 1];                        \
+            sum[2] += format##_to_float(x[i + 2]) * y[i + 2];                        \
+            sum[3] += format##_to_float(x[i + 3]) * y[i + 3];                        \
+        }                                                                            \
+        for (; i < n; i++)                                                           \
+        {                                                                            \
+            sum[0] += format##_to_float(x[i]) * y[i];                                \
+        }                                                                            \
+        return (sum[0] + sum[1]) + (sum[2] + sum[3]);                                \
+    }
+
+HALF_KERNELS_GENERIC(bf16)
+HALF_KERNELS_GENERIC(fp16)
+
+#ifdef KERNELS_X86
+__attribute__((target("sse"))) static void axpy_sse(float *y, const float *x, float a, int n)
+{
+    __m128 va = _mm_set1_ps(a);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    }
+    for (; i < n; i++)
+    {
+        y[i] += a * x[i];
+    }
+}
+
+__attribute__((target("sse"))) static float dot_sse(const float *x, const float *y, int n)
+{
+    __m128 acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++)
+    {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+__attribute__((target("sse"))) static float axpy_dot_sse(float *y, const float *x, float a, const float *w, int n)
+{
+    __m128 va = _mm_set1_ps(a);
+    __m128 acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i);
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, vx)));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(w + i), vx));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++)
+    {
+        y[i] += a * x[i];
+        sum += w[i] * x[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma"))) static void axpy_avx2(float *y, const float *x, float a, int n)
+{
+    __m256 va = _mm256_set1_ps(a);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    for (; i < n; i++)
+    {
+        y[i] += a * x[i];
+    }
+}
+
+__attribute__((target("avx2,fma"))) static float dot_avx2(const float *x, const float *y, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), acc0);
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, half);
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++)
+    {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma"))) static float axpy_dot_avx2(float *y, const float *x, float a, const float *w, int n)
+{
+    __m256 va = _mm256_set1_ps(a);
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 vx0 = _mm256_loadu_ps(x + i);
+        __m256 vx1 = _mm256_loadu_ps(x + i + 8);
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, vx0, _mm256_loadu_ps(y + i)));
+        _mm256_storeu_ps(y + i + 8, _mm256_fmadd_ps(va, vx1, _mm256_loadu_ps(y + i + 8)));
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + i), vx0, acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(w + i + 8), vx1, acc1);
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i);
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, vx, _mm256_loadu_ps(y + i)));
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + i), vx, acc0);
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, half);
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++)
+    {
+        y[i] += a * x[i];
+        sum += w[i] * x[i];
+    }
+    return sum;
+}
+
+/* four panels at once keep eight independent accumulators in flight, one panel at a time for the rest */
+__attribute__((target("avx2,fma"))) static void panel_avx2(float *y, const float *x, const float *panels, int panel_stride, int n_panels, int n)
+{
+    int p = 0;
+    for (; p + 4 <= n_panels; p += 4)
+    {
+        const float *p0 = panels + p * panel_stride;
+        const float *p1 = p0 + panel_stride;
+        const float *p2 = p1 + panel_stride;
+        const float *p3 = p2 + panel_stride;
+        float *out = y + p * KERNEL_PANEL_WIDTH;
+        __m256 a0 = _mm256_loadu_ps(out), a1 = _mm256_loadu_ps(out + 8);
+        __m256 a2 = _mm256_loadu_ps(out + 16), a3 = _mm256_loadu_ps(out + 24);
+        __m256 a4 = _mm256_loadu_ps(out + 32), a5 = _mm256_loadu_ps(out + 40);
+        __m256 a6 = _mm256_loadu_ps(out + 48), a7 = _mm256_loadu_ps(out + 56);
+        for (int k = 0; k < n; k++)
+        {
+            __m256 vx = _mm256_set1_ps(x[k]);
+            int row = k * KERNEL_PANEL_WIDTH;
+            a0 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(p0 + row), a0);
+            a1 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(p0 + row + 8), a1);
+            a2 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(p1 + row), a2);
+            a3 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(p1 + row + 8), a3);
+            a4 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(p2 + row), a4);
+            a5 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(p2 + row + 8), a5);
+            a6 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(p3 + row), a6);
+            a7 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(p3 + row + 8), a7);
+        }
+        _mm256_storeu_ps(out, a0);
+        _mm256_storeu_ps(out + 8, a1);
+        _mm256_storeu_ps(out + 16, a2);
+        _mm256_storeu_ps(out + 24, a3);
+        _mm256_storeu_ps(out + 32, a4);
+        _mm256_storeu_ps(out + 40, a5);
+        _mm256_storeu_ps(out + 48, a6);
+        _mm256_storeu_ps(out + 56, a7);
+    }
+    for (; p < n_panels; p++)
+    {
+        const float *panel = panels + p * panel_stride;
+        float *out = y + p * KERNEL_PANEL_WIDTH;
+        __m256 a0 = _mm256_loadu_ps(out), a1 = _mm256_loadu_ps(out + 8);
+        for (int k = 0; k < n; k++)
+        {
+            __m256 vx = _mm256_set1_ps(x[k]);
+            a0 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(panel + k * KERNEL_PANEL_WIDTH), a0);
+            a1 = _mm256_fmadd_ps(vx, _mm256_loadu_ps(panel + k * KERNEL_PANEL_WIDTH + 8), a1);
+        }
+        _mm256_storeu_ps(out, a0);
+        _mm256_storeu_ps(out + 8, a1);
+    }
+}
+
+/* Products are formed on int16 lanes and summed in pairs into int32 lanes. Four rows share each load
+    of x, and their accumulators are reduced together at the end. */
+__attribute__((target("avx2"))) static void dot_i8_avx2(int32_t *y, const int8_t *rows, const int8_t *x, int n_rows, int n)
+{
+    int r = 0;
+    for (; r + 4 <= n_rows; r += 4)
+    {
+        const int8_t *row = rows + r * n;
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        __m256i acc2 = _mm256_setzero_si256();
+        __m256i acc3 = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256i vx = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(x + i)));
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(row + i))), vx));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(row + n + i))), vx));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(row + 2 * n + i))), vx));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(row + 3 * n + i))), vx));
+        }
+        // lane k of the reduction holds row k
+        __m256i sums = _mm256_hadd_epi32(_mm256_hadd_epi32(acc0, acc1), _mm256_hadd_epi32(acc2, acc3));
+        _mm_storeu_si128((__m128i *)(y + r), _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1)));
+        for (; i < n; i++)
+        {
+            y[r] += (int32_t)row[i] * x[i];
+            y[r + 1] += (int32_t)row[n + i] * x[i];
+            y[r + 2] += (int32_t)row[2 * n + i] * x[i];
+            y[r + 3] += (int32_t)row[3 * n + i] * x[i];
+        }
+    }
+    dot_i8_generic(y + r, rows + r * n, x, n_rows - r, n);
+}
+
+/* avx2 can gather but not scatter, so only the dot has a dedicated kernel */
+__attribute__((target("avx2,fma"))) static float sparse_dot_avx2(const float *x, const int *index, const float *y, int n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 vy = _mm256_i32gather_ps(y, _mm256_loadu_si256((const __m256i *)(index + i)), 4);
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), vy, acc);
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, half);
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; i++)
+    {
+        sum += x[i] * y[index[i]];
+    }
+    return sum;
+}
+
+/* a compare and movemask builds 8 bits at once, a 32 bit word from 4 of them */
+__attribute__((target("avx2"))) static void mask_pack_avx2(uint32_t *mask, const float *x, int n)
+{
+    __m256 zero = _mm256_setzero_ps();
+    int w = 0;
+    for (; (w + 1) * KERNEL_MASK_BITS <= n; w++)
+    {
+        const float *in = x + w * KERNEL_MASK_BITS;
+        uint32_t bits = 0;
+        for (int k = 0; k < KERNEL_MASK_BITS / 8; k++)
+        {
+            bits |= (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(in + 8 * k), zero, _CMP_GT_OQ)) << (8 * k);
+        }
+        mask[w] = bits;
+    }
+    if (w * KERNEL_MASK_BITS < n)
+    {
+        mask_pack_generic(mask + w, x + w * KERNEL_MASK_BITS, n - w * KERNEL_MASK_BITS);
+    }
+}
+
+/* every lane tests its own bit of the broadcast mask byte and keeps y where it is set */
+__attribute__((target("avx2"))) static void mask_apply_avx2(float *y, const uint32_t *mask, int n)
+{
+    __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i bits = _mm256_set1_epi32((int)(mask[i / KERNEL_MASK_BITS] >> (i % KERNEL_MASK_BITS)));
+        __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(bits, lane_bits), lane_bits);
+        _mm256_storeu_ps(y + i, _mm256_and_ps(_mm256_loadu_ps(y + i), _mm256_castsi256_ps(keep)));
+    }
+    for (; i < n; i++)
+    {
+        y[i] = ((mask[i / KERNEL_MASK_BITS] >> (i % KERNEL_MASK_BITS)) & 1) ? y[i] : 0;
+    }
+}
+
+/* the updates round like the generic ones built as ISO C, which does not contract them to fma, so a parameter gets
+    the same value whichever part of a pass it falls in, e.g. in the flat pass over all params or the pass over its layer */
+__attribute__((target("avx2"))) static void sgd_avx2(float *p, const float *g, const OptimizerStep *step, int n)
+{
+    __m256 rate = _mm256_set1_ps(step->learning_rate * step->grad_scale);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(p + i, _mm256_sub_ps(_mm256_loadu_ps(p + i), _mm256_mul_ps(rate, _mm256_loadu_ps(g + i))));
+    }
+    sgd_generic(p + i, g + i, step, n - i);
+}
+
+__attribute__((target("avx2"))) static void momentum_avx2(float *p, const float *g, float *m, const OptimizerStep *step, int n)
+{
+    __m256 momentum = _mm256_set1_ps(step->momentum);
+    __m256 grad_scale = _mm256_set1_ps(step->grad_scale);
+    __m256 rate = _mm256_set1_ps(step->learning_rate);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 vm = _mm256_add_ps(_mm256_mul_ps(momentum, _mm256_loadu_ps(m + i)), _mm256_mul_ps(grad_scale, _mm256_loadu_ps(g + i)));
+        _mm256_storeu_ps(m + i, vm);
+        _mm256_storeu_ps(p + i, _mm256_sub_ps(_mm256_loadu_ps(p + i), _mm256_mul_ps(rate, vm)));
+    }
+    momentum_generic(p + i, g + i, m + i, step, n - i);
+}
+
+__attribute__((target("avx2"))) static void adam_avx2(float *p, const float *g, float *m, float *v, const OptimizerStep *step, int n)
+{
+    __m256 grad_scale = _mm256_set1_ps(step->grad_scale);
+    __m256 beta1 = _mm256_set1_ps(step->beta1);
+    __m256 beta2 = _mm256_set1_ps(step->beta2);
+    __m256 one_minus_beta1 = _mm256_set1_ps(1 - step->beta1);
+    __m256 one_minus_beta2 = _mm256_set1_ps(1 - step->beta2);
+    __m256 v_correction = _mm256_set1_ps(step->v_correction);
+    __m256 epsilon = _mm256_set1_ps(step->epsilon);
+    __m256 decay = _mm256_set1_ps(step->decay);
+    __m256 rate = _mm256_set1_ps(step->learning_rate);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 grad = _mm256_mul_ps(grad_scale, _mm256_loadu_ps(g + i));
+        __m256 vm = _mm256_add_ps(_mm256_mul_ps(beta1, _mm256_loadu_ps(m + i)), _mm256_mul_ps(one_minus_beta1, grad));
+        __m256 vv = _mm256_add_ps(_mm256_mul_ps(beta2, _mm256_loadu_ps(v + i)), _mm256_mul_ps(_mm256_mul_ps(one_minus_beta2, grad), grad));
+        __m256 denominator = _mm256_add_ps(_mm256_sqrt_ps(_mm256_mul_ps(v_correction, vv)), epsilon);
+        _mm256_storeu_ps(m + i, vm);
+        _mm256_storeu_ps(v + i, vv);
+        _mm256_storeu_ps(p + i, _mm256_sub_ps(_mm256_mul_ps(decay, _mm256_loadu_ps(p + i)), _mm256_div_ps(_mm256_mul_ps(rate, vm), denominator)));
+    }
+    adam_generic(p + i, g + i, m + i, v + i, step, n - i);
+}
+
+/* bf16 widens by a shift, fp16 through f16c which every avx2 cpu we select has, see kernel_variant_supported */
+__attribute__((target("avx2"))) static inline __m256 load_bf16_avx2(const uint16_t *x)
+{
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)x)), 16));
+}
+
+__attribute__((target("avx2,f16c"))) static inline __m256 load_fp16_avx2(const uint16_t *x)
+{
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)x));
+}
+
+#define HALF_KERNELS_AVX2(format)                                                                                   \
+    __attribute__((target("avx2,fma,f16c"))) static void axpy_##format##_avx2(float *y, const uint16_t *x, float a, \
+                                                                               int n)                               \
+    {                                                                                                               \
+        __m256 va = _mm256_set1_ps(a);                                                                              \
+        int i = 0;                                                                                                  \
+        for (; i + 8 <= n; i += 8)                                                                                  \
+        {                                                                                                           \
+            _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, load_##format##_avx2(x + i), _mm256_loadu_ps(y + i)));      \
+        }                                                                                                           \
+        for (; i < n; i++)                                                                                          \
+        {                                                                                                           \
+            y[i] += a * format##_to_float(x[i]);                                                                    \
+        }                                                                                                           \
+    }                                                                                                               \
+                                                                                                                    \
+    __attribute__((target("avx2,fma,f16c"))) static float dot_##format##_avx2(const uint16_t *x, const float *y,    \
+                                                                               int n)                               \
+    {                                                                                                               \
+        __m256 acc0 = _mm256_setzero_ps();                                                                          \
+        __m256 acc1 = _mm256_setzero_ps();                                                                          \
+        int i = 0;                                                                                                  \
+        for (; i + 16 <= n; i += 16)                                                                                \
+        {                                                                                                           \
+            acc0 = _mm256_fmadd_ps(load_##format##_avx2(x + i), _mm256_loadu_ps(y + i), acc0);                      \
+            acc1 = _mm256_fmadd_ps(load_##format##_avx2(x + i + 8), _mm256_loadu_ps(y + i + 8), acc1);              \
+        }                                                                                                           \
+        for (; i + 8 <= n; i += 8)                                                                                  \
+        {                                                                                                           \
+            acc0 = _mm256_fmadd_ps(load_##format##_avx2(x + i), _mm256_loadu_ps(y + i), acc0);                      \
+        }                                                                                                           \
+        acc0 = _mm256_add_ps(acc0, acc1);                                                                           \
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));                     \
+        float lanes[4];                                                                                             \
+        _mm_storeu_ps(lanes, half);                                                                                 \
+        float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);                                                  \
+        for (; i < n; i++)                                                                                          \
+        {                                                                                                           \
+            sum += format##_to_float(x[i]) * y[i];                                                                  \
+        }                                                                                                           \
+        return sum;                                                                                                 \
+    }
+
+HALF_KERNELS_AVX2(bf16)
+HALF_KERNELS_AVX2(fp16)
+
+__attribute__((target("avx512f"))) static void axpy_avx512(float *y, const float *x, float a, int n)
+{
+    __m512 va = _mm512_set1_ps(a);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+    }
+    if (i < n)
+    {
+        // masked tail instead of a scalar loop
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        __m512 vy = _mm512_maskz_loadu_ps(mask, y + i);
+        _mm512_mask_storeu_ps(y + i, mask, _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(mask, x + i), vy));
+    }
+}
+
+__attribute__((target("avx512f"))) static float dot_avx512(const float *x, const float *y, int n)
+{
+    __m512 acc = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), acc);
+    }
+    if (i < n)
+    {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i), acc);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f"))) static float axpy_dot_avx512(float *y, const float *x, float a, const float *w, int n)
+{
+    __m512 va = _mm512_set1_ps(a);
+    __m512 acc = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 vx = _mm512_loadu_ps(x + i);
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, vx, _mm512_loadu_ps(y + i)));
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(w + i), vx, acc);
+    }
+    if (i < n)
+    {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        __m512 vx = _mm512_maskz_loadu_ps(mask, x + i);
+        _mm512_mask_storeu_ps(y + i, mask, _mm512_fmadd_ps(va, vx, _mm512_maskz_loadu_ps(mask, y + i)));
+        acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, w + i), vx, acc);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+/* a panel row is one vector, four panels at once keep four accumulators in flight */
+__attribute__((target("avx512f"))) static void panel_avx512(float *y, const float *x, const float *panels, int panel_stride, int n_panels, int n)
+{
+    int p = 0;
+    for (; p + 4 <= n_panels; p += 4)
+    {
+        const float *p0 = panels + p * panel_stride;
+        const float *p1 = p0 + panel_stride;
+        const float *p2 = p1 + panel_stride;
+        const float *p3 = p2 + panel_stride;
+        float *out = y + p * KERNEL_PANEL_WIDTH;
+        __m512 a0 = _mm512_loadu_ps(out), a1 = _mm512_loadu_ps(out + 16);
+        __m512 a2 = _mm512_loadu_ps(out + 32), a3 = _mm512_loadu_ps(out + 48);
+        for (int k = 0; k < n; k++)
+        {
+            __m512 vx = _mm512_set1_ps(x[k]);
+            int row = k * KERNEL_PANEL_WIDTH;
+            a0 = _mm512_fmadd_ps(vx, _mm512_loadu_ps(p0 + row), a0);
+            a1 = _mm512_fmadd_ps(vx, _mm512_loadu_ps(p1 + row), a1);
+            a2 = _mm512_fmadd_ps(vx, _mm512_loadu_ps(p2 + row), a2);
+            a3 = _mm512_fmadd_ps(vx, _mm512_loadu_ps(p3 + row), a3);
+        }
+        _mm512_storeu_ps(out, a0);
+        _mm512_storeu_ps(out + 16, a1);
+        _mm512_storeu_ps(out + 32, a2);
+        _mm512_storeu_ps(out + 48, a3);
+    }
+    for (; p < n_panels; p++)
+    {
+        const float *panel = panels + p * panel_stride;
+        float *out = y + p * KERNEL_PANEL_WIDTH;
+        __m512 acc = _mm512_loadu_ps(out);
+        for (int k = 0; k < n; k++)
+        {
+            acc = _mm512_fmadd_ps(_mm512_set1_ps(x[k]), _mm512_loadu_ps(panel + k * KERNEL_PANEL_WIDTH), acc);
+        }
+        _mm512_storeu_ps(out, acc);
+    }
+}
+
+__attribute__((target("avx512f"))) static void sparse_axpy_avx512(float *y, const int *index, const float *x, float a, int n)
+{
+    __m512 va = _mm512_set1_ps(a);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i vi = _mm512_loadu_si512((const void *)(index + i));
+        __m512 vy = _mm512_i32gather_ps(vi, y, 4);
+        _mm512_i32scatter_ps(y, vi, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), vy), 4);
+    }
+    for (; i < n; i++)
+    {
+        y[index[i]] += a * x[i];
+    }
+}
+
+__attribute__((target("avx512f"))) static float sparse_dot_avx512(const float *x, const int *index, const float *y, int n)
+{
+    __m512 acc = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 vy = _mm512_i32gather_ps(_mm512_loadu_si512((const void *)(index + i)), y, 4);
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), vy, acc);
+    }
+    float sum = _mm512_reduce_add_ps(acc);
+    for (; i < n; i++)
+    {
+        sum += x[i] * y[index[i]];
+    }
+    return sum;
+}
+__attribute__((target("avx512f"))) static void sgd_avx512(float *p, const float *g, const OptimizerStep *step, int n)
+{
+    __m512 rate = _mm512_set1_ps(step->learning_rate * step->grad_scale);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(p + i, _mm512_sub_ps(_mm512_loadu_ps(p + i), _mm512_mul_ps(rate, _mm512_loadu_ps(g + i))));
+    }
+    sgd_generic(p + i, g + i, step, n - i);
+}
+
+__attribute__((target("avx512f"))) static void momentum_avx512(float *p, const float *g, float *m, const OptimizerStep *step, int n)
+{
+    __m512 momentum = _mm512_set1_ps(step->momentum);
+    __m512 grad_scale = _mm512_set1_ps(step->grad_scale);
+    __m512 rate = _mm512_set1_ps(step->learning_rate);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 vm = _mm512_add_ps(_mm512_mul_ps(momentum, _mm512_loadu_ps(m + i)), _mm512_mul_ps(grad_scale, _mm512_loadu_ps(g + i)));
+        _mm512_storeu_ps(m + i, vm);
+        _mm512_storeu_ps(p + i, _mm512_sub_ps(_mm512_loadu_ps(p + i), _mm512_mul_ps(rate, vm)));
+    }
+    momentum_generic(p + i, g + i, m + i, step, n - i);
+}
+
+__attribute__((target("avx512f"))) static void adam_avx512(float *p, const float *g, float *m, float *v, const OptimizerStep *step, int n)
+{
+    __m512 grad_scale = _mm512_set1_ps(step->grad_scale);
+    __m512 beta1 = _mm512_set1_ps(step->beta1);
+    __m512 beta2 = _mm512_set1_ps(step->beta2);
+    __m512 one_minus_beta1 = _mm512_set1_ps(1 - step->beta1);
+    __m512 one_minus_beta2 = _mm512_set1_ps(1 - step->beta2);
+    __m512 v_correction = _mm512_set1_ps(step->v_correction);
+    __m512 epsilon = _mm512_set1_ps(step->epsilon);
+    __m512 decay = _mm512_set1_ps(step->decay);
+    __m512 rate = _mm512_set1_ps(step->learning_rate);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 grad = _mm512_mul_ps(grad_scale, _mm512_loadu_ps(g + i));
+        __m512 vm = _mm512_add_ps(_mm512_mul_ps(beta1, _mm512_loadu_ps(m + i)), _mm512_mul_ps(one_minus_beta1, grad));
+        __m512 vv = _mm512_add_ps(_mm512_mul_ps(beta2, _mm512_loadu_ps(v + i)), _mm512_mul_ps(_mm512_mul_ps(one_minus_beta2, grad), grad));
+        __m512 denominator = _mm512_add_ps(_mm512_sqrt_ps(_mm512_mul_ps(v_correction, vv)), epsilon);
+        _mm512_storeu_ps(m + i, vm);
+        _mm512_storeu_ps(v + i, vv);
+        _mm512_storeu_ps(p + i, _mm512_sub_ps(_mm512_mul_ps(decay, _mm512_loadu_ps(p + i)), _mm512_div_ps(_mm512_mul_ps(rate, vm), denominator)));
+    }
+    adam_generic(p + i, g + i, m + i, v + i, step, n - i);
+}
+
+/* compares produce the mask registers directly, 16 bits each */
+__attribute__((target("avx512f"))) static void mask_pack_avx512(uint32_t *mask, const float *x, int n)
+{
+    __m512 zero = _mm512_setzero_ps();
+    int w = 0;
+    for (; (w + 1) * KERNEL_MASK_BITS <= n; w++)
+    {
+        const float *in = x + w * KERNEL_MASK_BITS;
+        uint32_t low = _mm512_cmp_ps_mask(_mm512_loadu_ps(in), zero, _CMP_GT_OQ);
+        uint32_t high = _mm512_cmp_ps_mask(_mm512_loadu_ps(in + 16), zero, _CMP_GT_OQ);
+        mask[w] = low | (high << 16);
+    }
+    if (w * KERNEL_MASK_BITS < n)
+    {
+        mask_pack_generic(mask + w, x + w * KERNEL_MASK_BITS, n - w * KERNEL_MASK_BITS);
+    }
+}
+
+__attribute__((target("avx512f"))) static void mask_apply_avx512(float *y, const uint32_t *mask, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __mmask16 keep = (__mmask16)(mask[i / KERNEL_MASK_BITS] >> (i % KERNEL_MASK_BITS));
+        _mm512_storeu_ps(y + i, _mm512_maskz_mov_ps(keep, _mm512_loadu_ps(y + i)));
+    }
+    for (; i < n; i++)
+    {
+        y[i] = ((mask[i / KERNEL_MASK_BITS] >> (i % KERNEL_MASK_BITS)) & 1) ? y[i] : 0;
+    }
+}
+#endif
+
+#ifdef KERNELS_NEON
+static void axpy_neon(float *y, const float *x, float a, int n)
+{
+    float32x4_t va = vdupq_n_f32(a);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        vst1q_f32(y + i, vmlaq_f32(vld1q_f32(y + i), va, vld1q_f32(x + i)));
+    }
+    for (; i < n; i++)
+    {
+        y[i] += a * x[i];
+    }
+}
+
+static float dot_neon(const float *x, const float *y, int n)
+{
+    float32x4_t acc = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        acc = vmlaq_f32(acc, vld1q_f32(x + i), vld1q_f32(y + i));
+    }
+    float32x2_t pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    float sum = vget_lane_f32(vpadd_f32(pair, pair), 0);
+    for (; i < n; i++)
+    {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+static float axpy_dot_neon(float *y, const float *x, float a, const float *w, int n)
+{
+    float32x4_t va = vdupq_n_f32(a);
+    float32x4_t acc = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t vx = vld1q_f32(x + i);
+        vst1q_f32(y + i, vmlaq_f32(vld1q_f32(y + i), va, vx));
+        acc = vmlaq_f32(acc, vld1q_f32(w + i), vx);
+    }
+    float32x2_t pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    float sum = vget_lane_f32(vpadd_f32(pair, pair), 0);
+    for (; i < n; i++)
+    {
+        y[i] += a * x[i];
+        sum += w[i] * x[i];
+    }
+    return sum;
+}
+#endif
+
+/* variants without their own panel, int8, 16-bit, sparse, mask or optimizer kernels share the generic ones, avx512 cpus run the avx2 int8 and 16-bit kernels */
+static const Kernels kernel_table[N_KERNEL_VARIANTS] = {
+    [KERNEL_SCALAR] = {KERNEL_SCALAR, "scalar", axpy_scalar, dot_scalar, axpy_dot_scalar, panel_generic, dot_i8_scalar, {axpy_bf16_scalar, axpy_fp16_scalar}, {dot_bf16_scalar, dot_fp16_scalar}, sparse_axpy_scalar, sparse_dot_scalar, mask_pack_generic, mask_apply_generic, sgd_generic, momentum_generic, adam_generic},
+    [KERNEL_GENERIC] = {KERNEL_GENERIC, "generic", axpy_generic, dot_generic, axpy_dot_generic, panel_generic, dot_i8_generic, {axpy_bf16_generic, axpy_fp16_generic}, {dot_bf16_generic, dot_fp16_generic}, sparse_axpy_generic, sparse_dot_generic, mask_pack_generic, mask_apply_generic, sgd_generic, momentum_generic, adam_generic},
+#ifdef KERNELS_X86
+    [KERNEL_SSE] = {KERNEL_SSE, "sse", axpy_sse, dot_sse, axpy_dot_sse, panel_generic, dot_i8_generic, {axpy_bf16_generic, axpy_fp16_generic}, {dot_bf16_generic, dot_fp16_generic}, sparse_axpy_generic, sparse_dot_generic, mask_pack_generic, mask_apply_generic, sgd_generic, momentum_generic, adam_generic},
+    [KERNEL_AVX2] = {KERNEL_AVX2, "avx2", axpy_avx2, dot_avx2, axpy_dot_avx2, panel_avx2, dot_i8_avx2, {axpy_bf16_avx2, axpy_fp16_avx2}, {dot_bf16_avx2, dot_fp16_avx2}, sparse_axpy_generic, sparse_dot_avx2, mask_pack_avx2, mask_apply_avx2, sgd_avx2, momentum_avx2, adam_avx2},
+    [KERNEL_AVX512] = {KERNEL_AVX512, "avx512", axpy_avx512, dot_avx512, axpy_dot_avx512, panel_avx512, dot_i8_avx2, {axpy_bf16_avx2, axpy_fp16_avx2}, {dot_bf16_avx2, dot_fp16_avx2}, sparse_axpy_avx512, sparse_dot_avx512, mask_pack_avx512, mask_apply_avx512, sgd_avx512, momentum_avx512, adam_avx512},
+#endif
+#ifdef KERNELS_NEON
+    [KERNEL_NEON] = {KERNEL_NEON, "neon", axpy_neon, dot_neon, axpy_dot_neon, panel_generic, dot_i8_generic, {axpy_bf16_generic, axpy_fp16_generic}, {dot_bf16_generic, dot_fp16_generic}, sparse_axpy_generic, sparse_dot_generic, mask_pack_generic, mask_apply_generic, sgd_generic, momentum_generic, adam_generic},
+#endif
+};
+
+static const Kernels *active_kernels = NULL;
+
+/* Checks whether a variant is compiled in and supported by the cpu we are running on */
+static int kernel_variant_supported(enum KernelVariant variant)
+{
+    if (variant < 0 || variant >= N_KERNEL_VARIANTS || kernel_table[variant].axpy == NULL)
+    {
+        return 0;
+    }
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    switch (variant)
+    {
+    case KERNEL_SSE:
+        return __builtin_cpu_supports("sse");
+    case KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+    case KERNEL_AVX512:
+        // the variant also runs the avx2 int8 and 16-bit kernels
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+               __builtin_cpu_supports("f16c");
+    default:
+        break;
+    }
+#endif
+    return 1;
+}
+
+/* Returns the kernels for a variant, or NULL if it is not available on this cpu */
+const Kernels *get_kernel_variant(enum KernelVariant variant)
+{
+    if (!kernel_variant_supported(variant))
+    {
+        return NULL;
+    }
+    return &kernel_table[variant];
+}
+
+/* Returns the active kernels, the fastest supported variant is selected on the first call */
+const Kernels *get_kernels(void)
+{
+    if (active_kernels == NULL)
+    {
+        for (int variant = N_KERNEL_VARIANTS - 1; variant >= 0; variant--)
+        {
+            if (kernel_variant_supported((enum KernelVariant)variant))
+            {
+                active_kernels = &kernel_table[variant];
+                break;
+            }
+        }
+    }
+    return active_kernels;
+}
+
+/* Overrides the automatically selected kernels, e.g. to compare variants */
+void set_kernel_variant(enum KernelVariant variant)
+{
+    const Kernels *kernels = get_kernel_variant(variant);
+    if (kernels == NULL)
+    {
+        printf("Error: kernel variant %d is not supported, keeping %s\n", variant, get_kernels()->name);
+        return;
+    }
+    active_kernels = kernels;
+}
@@ -0,0 +1,105 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+#include <stdint.h>
+
+/* Vector primitives used by the forward and backward propagation loops.
+    Every variant computes the same result as the scalar one, up to floating point reassociation. */
+enum KernelVariant
+{
+    KERNEL_SCALAR,
+    KERNEL_GENERIC,
+    KERNEL_SSE,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+    KERNEL_NEON,
+    N_KERNEL_VARIANTS
+};
+
+/* Packed weight panels hold KERNEL_PANEL_WIDTH consecutive outputs of a layer, one row of the panel per input,
+    so a panel kernel streams through memory with unit stride while the outputs stay in registers. */
+#define KERNEL_PANEL_WIDTH 16
+#define KERNEL_PANEL_GROUP 4 // panels a panel kernel works on at once
+
+/* 16-bit float formats weights can be stored in, expanded to float by the kernels that read them */
+enum HalfFormat
+{
+    HALF_BF16,
+    HALF_FP16,
+    N_HALF_FORMATS
+};
+
+/* Weights of a layer in compressed sparse rows, one row per input like the dense layout. Row j holds the nonzero
+    weights of input j, values[row_start[j]] up to values[row_start[j + 1] - 1], and the outputs they connect to
+    in columns, ascending. */
+typedef struct
+{
+    int n_rows;
+    int n_nonzeros;
+    int *row_start; // n_rows + 1 entries
+    int *columns;
+    float *values;
+} SparseWeights;
+
+/* Derivative masks of relu and linear layers, whose derivative is 0 or 1, hold one bit per neuron:
+    bit i % KERNEL_MASK_BITS of word i / KERNEL_MASK_BITS. Bits past the size of the layer are zero. */
+#define KERNEL_MASK_BITS 32
+#define KERNEL_MASK_WORDS(n) (((n) + KERNEL_MASK_BITS - 1) / KERNEL_MASK_BITS)
+
+/* Scalars of one optimizer step, see optimizer_begin_step. The gradients the update kernels read are sums over
+    a batch, grad_scale averages them. */
+typedef struct
+{
+    float learning_rate; // for adam divided by the bias correction of the first moment, 1 - beta1^t
+    float grad_scale;
+    float momentum;
+    float beta1;
+    float beta2;
+    float v_correction; // bias correction of the second moment, 1 / (1 - beta2^t)
+    float epsilon;
+    float decay; // the parameters are scaled by it before the update, 1 - learning rate * weight decay for adamw
+} OptimizerStep;
+
+typedef void (*AxpyKernel)(float *y, const float *x, float a, int n);
+typedef float (*DotKernel)(const float *x, const float *y, int n);
+typedef float (*AxpyDotKernel)(float *y, const float *x, float a, const float *w, int n);
+typedef void (*PanelKernel)(float *y, const float *x, const float *panels, int panel_stride, int n_panels, int n);
+typedef void (*DotI8Kernel)(int32_t *y, const int8_t *rows, const int8_t *x, int n_rows, int n);
+typedef void (*AxpyHalfKernel)(float *y, const uint16_t *x, float a, int n);
+typedef float (*DotHalfKernel)(const uint16_t *x, const float *y, int n);
+typedef void (*SparseAxpyKernel)(float *y, const int *index, const float *x, float a, int n);
+typedef float (*SparseDotKernel)(const float *x, const int *index, const float *y, int n);
+typedef void (*MaskPackKernel)(uint32_t *mask, const float *x, int n);
+typedef void (*MaskApplyKernel)(float *y, const uint32_t *mask, int n);
+typedef void (*SgdKernel)(float *p, const float *g, const OptimizerStep *step, int n);
+typedef void (*MomentumKernel)(float *p, const float *g, float *m, const OptimizerStep *step, int n);
+typedef void (*AdamKernel)(float *p, const float *g, float *m, float *v, const OptimizerStep *step, int n);
+
+typedef struct
+{
+    enum KernelVariant variant;
+    const char *name;
+    AxpyKernel axpy; // y[i] += a * x[i]
+    DotKernel dot;   // sum of x[i] * y[i]
+    AxpyDotKernel axpy_dot; // y[i] += a * x[i] and returns the sum of w[i] * x[i], in one sweep over x
+    PanelKernel panel;      // y[p * KERNEL_PANEL_WIDTH + c] += sum of x[k] * panels[p * panel_stride + k * KERNEL_PANEL_WIDTH + c]
+    DotI8Kernel dot_i8;     // y[r] = sum of rows[r * n + i] * x[i] in int32, exact for n below 2^17
+    AxpyHalfKernel axpy_half[N_HALF_FORMATS]; // axpy with x in a 16-bit format, indexed by enum HalfFormat
+    DotHalfKernel dot_half[N_HALF_FORMATS];   // dot with x in a 16-bit format
+    SparseAxpyKernel sparse_axpy; // y[index[i]] += a * x[i], index must not repeat
+    SparseDotKernel sparse_dot;   // sum of x[i] * y[index[i]]
+    MaskPackKernel mask_pack;     // sets bit i of mask where x[i] > 0, the relu derivative
+    MaskApplyKernel mask_apply;   // y[i] = 0 where bit i of mask is clear
+    /* optimizer updates of parameters p from the gradients g, in one pass over them and their state */
+    SgdKernel sgd;           // p[i] -= learning_rate * grad_scale * g[i]
+    MomentumKernel momentum; // m[i] = momentum * m[i] + grad_scale * g[i], p[i] -= learning_rate * m[i]
+    AdamKernel adam;         // moments m, v of grad_scale * g[i], p[i] = decay * p[i] - learning_rate * m[i] / (sqrt(v_correction * v[i]) + epsilon)
+} Kernels;
+
+const Kernels *get_kernels(void);
+const Kernels *get_kernel_variant(enum KernelVariant variant);
+void set_kernel_variant(enum KernelVariant variant);
+
+void convert_to_half(uint16_t *dst, const float *src, int n, enum HalfFormat format);
+void convert_from_half(float *dst, const uint16_t *src, int n, enum HalfFormat format);
+
+#endif
@@ -1,6 +1,8 @@
 #include "model_binding.h"
+#include "kernels.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 /*
     Model binding is excluded from memory tracking.
 
@@ -16,6 +18,15 @@ void setModel(Model *model, int n_layers, int input_size, int output_size, int *
     model->input_size = input_size;
     model->layers_activation = layers_activation;
     model->output_size = output_size;
+    model->params = NULL;
+    model->n_params = 0;
+    model->params_memory = NULL;
+    model->layers_panels = NULL;
+    model->panels_memory = NULL;
+    model->layers_weights_half = NULL;
+    model->half_format = HALF_BF16;
+    model->half_memory = NULL;
+    model->layers_sparse = NULL;
 }
 
 /* Create Model and sets the model*/
@@ -31,5 +42,561 @@ Model *createAndSetModel(int n_layers, int input_size, int output_size, int *lay
 /* Frees a model, should especially be used when tracking memory. As the model binding is excluded from memory tracking */
 void freeModel(Model *model)
 {
+    free(model->params_memory);
+    free(model->panels_memory);
+    freeMasterWeights(model);
+    free(model->half_memory);
+    densifyModel(model);
     free(model);
 }
+
+/* number of floats per alignment unit of the flat parameter layout */
+#define PARAMS_ALIGN_FLOATS (MODEL_PARAMS_ALIGNMENT / (int)sizeof(float))
+
+static int alignParamsSize(int size)
+{
+    return (size + PARAMS_ALIGN_FLOATS - 1) / PARAMS_ALIGN_FLOATS * PARAMS_ALIGN_FLOATS;
+}
+
+/* Size in floats of the flat parameter layout of a model */
+int modelParamsSize(Model *model)
+{
+    int n_params = 0;
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        n_params += alignParamsSize(size * model->layers_size[i]) + alignParamsSize(model->layers_size[i]);
+        size = model->layers_size[i];
+    }
+    return n_params;
+}
+
+/* points the layer arrays at their place in the flat layout */
+static void layoutModelParams(Model *model, float *params, float **layers_weights, float **layers_biases)
+{
+    int offset = 0;
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        layers_weights[i] = params + offset;
+        offset += alignParamsSize(size * model->layers_size[i]);
+        layers_biases[i] = params + offset;
+        offset += alignParamsSize(model->layers_size[i]);
+        size = model->layers_size[i];
+    }
+}
+
+/* allocates the layer pointer arrays for the flat layout, followed by an aligned buffer of n_params floats if requested.
+    @return the allocation, NULL on failure */
+static void *allocateModelParams(Model *model, int n_params, float ***layers_weights, float ***layers_biases, float **params)
+{
+    size_t pointers_bytes = 2 * model->n_layers * sizeof(float *);
+    size_t n_bytes = pointers_bytes;
+    if (n_params > 0)
+    {
+        n_bytes += MODEL_PARAMS_ALIGNMENT + (size_t)n_params * sizeof(float);
+    }
+    void *memory = malloc(n_bytes);
+    if (memory == NULL)
+    {
+        printf("Error: could not allocate model parameters! \n");
+        return NULL;
+    }
+    *layers_weights = (float **)memory;
+    *layers_biases = *layers_weights + model->n_layers;
+    if (n_params > 0)
+    {
+        uintptr_t aligned = ((uintptr_t)memory + pointers_bytes + MODEL_PARAMS_ALIGNMENT - 1) & ~(uintptr_t)(MODEL_PARAMS_ALIGNMENT - 1);
+        *params = (float *)aligned;
+    }
+    return memory;
+}
+
+/* Moves the weights and biases of a model into one aligned, contiguous buffer owned by the model.
+    The arrays the model was set with are copied and left untouched.
+    @return 0 on success, -1 if the buffer could not be allocated */
+int flattenModel(Model *model)
+{
+    if (model->layers_weights_half != NULL)
+    {
+        printf("Error: a model with 16-bit weights can not be flattened! \n");
+        return -1;
+    }
+    float **layers_weights;
+    float **layers_biases;
+    float *params = NULL;
+    int n_params = modelParamsSize(model);
+    void *memory = allocateModelParams(model, n_params, &layers_weights, &layers_biases, &params);
+    if (memory == NULL)
+    {
+        return -1;
+    }
+
+    // padding is zeroed so the buffer can be checksummed or compared as a whole
+    memset(params, 0, n_params * sizeof(float));
+    layoutModelParams(model, params, layers_weights, layers_biases);
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        memcpy(layers_weights[i], model->layers_weights[i], size * model->layers_size[i] * sizeof(float));
+        memcpy(layers_biases[i], model->layers_biases[i], model->layers_size[i] * sizeof(float));
+        size = model->layers_size[i];
+    }
+
+    free(model->params_memory);
+    model->layers_weights = layers_weights;
+    model->layers_biases = layers_biases;
+    model->params = params;
+    model->n_params = n_params;
+    model->params_memory = memory;
+    return 0;
+}
+
+/* Binds the layers of a model to a caller-provided buffer in the flat layout, without copying.
+    params must be MODEL_PARAMS_ALIGNMENT aligned, hold modelParamsSize(model) floats and outlive the model.
+    @return 0 on success, -1 on failure */
+int bindModelParams(Model *model, float *params)
+{
+    if (model->layers_weights_half != NULL)
+    {
+        printf("Error: a model with 16-bit weights can not be bound to parameters! \n");
+        return -1;
+    }
+    if (((uintptr_t)params & (MODEL_PARAMS_ALIGNMENT - 1)) != 0)
+    {
+        printf("Error: model parameters must be aligned to %d bytes! \n", MODEL_PARAMS_ALIGNMENT);
+        return -1;
+    }
+    float **layers_weights;
+    float **layers_biases;
+    void *memory = allocateModelParams(model, 0, &layers_weights, &layers_biases, NULL);
+    if (memory == NULL)
+    {
+        return -1;
+    }
+    layoutModelParams(model, params, layers_weights, layers_biases);
+
+    free(model->params_memory);
+    model->layers_weights = layers_weights;
+    model->layers_biases = layers_biases;
+    model->params = params;
+    model->n_params = modelParamsSize(model);
+    model->params_memory = memory;
+    return 0;
+}
+
+static int layerInputSize(Model *model, int layer)
+{
+    return (layer == 0) ? model->input_size : model->layers_size[layer - 1];
+}
+
+static int layerPanels(Model *model, int layer)
+{
+    return (model->layers_size[layer] + KERNEL_PANEL_WIDTH - 1) / KERNEL_PANEL_WIDTH;
+}
+
+/* Adds a packed copy of the weights, used by the inference functions in place of the weights.
+    Each panel row is one cache line of unit-stride weights, and the outputs of a panel stay in registers.
+    The weights remain the master copy for training: after changing them, repackModelWeights must be called
+    for the inputs that changed, the training functions do so themselves.
+    @return 0 on success, -1 if the panels could not be allocated */
+int packModel(Model *model)
+{
+    if (model->layers_weights_half != NULL)
+    {
+        printf("Error: a model with 16-bit weights can not be packed! \n");
+        return -1;
+    }
+    size_t pointers_bytes = model->n_layers * sizeof(float *);
+    size_t n_floats = 0;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        n_floats += (size_t)layerPanels(model, i) * layerInputSize(model, i) * KERNEL_PANEL_WIDTH;
+    }
+    void *memory = malloc(pointers_bytes + MODEL_PARAMS_ALIGNMENT + n_floats * sizeof(float));
+    if (memory == NULL)
+    {
+        printf("Error: could not allocate packed weights! \n");
+        return -1;
+    }
+
+    unpackModel(model);
+    model->layers_panels = (float **)memory;
+    model->panels_memory = memory;
+    uintptr_t aligned = ((uintptr_t)memory + pointers_bytes + MODEL_PARAMS_ALIGNMENT - 1) & ~(uintptr_t)(MODEL_PARAMS_ALIGNMENT - 1);
+    float *panels = (float *)aligned;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        model->layers_panels[i] = panels;
+        panels += (size_t)layerPanels(model, i) * layerInputSize(model, i) * KERNEL_PANEL_WIDTH;
+        repackModelWeights(model, i, 0, layerInputSize(model, i));
+    }
+    return 0;
+}
+
+/* Copies the weights of n_inputs inputs of a layer, starting at first_input, into its panels and its sparse copy,
+    or from the fp32 master copy into the 16-bit weights. The outputs past the layer size in the last panel are zero.
+    Does nothing if the model is neither packed, sparse nor compressed. */
+void repackModelWeights(Model *model, int layer, int first_input, int n_inputs)
+{
+    if (model->layers_weights_half != NULL && model->layers_weights[layer] != NULL)
+    {
+        int offset = first_input * model->layers_size[layer];
+        convert_to_half(model->layers_weights_half[layer] + offset, model->layers_weights[layer] + offset,
+                        n_inputs * model->layers_size[layer], model->half_format);
+    }
+    if (model->layers_sparse != NULL && model->layers_sparse[layer] != NULL)
+    {
+        SparseWeights *sparse = model->layers_sparse[layer];
+        const float *weights = model->layers_weights[layer];
+        for (int k = first_input; k < first_input + n_inputs; k++)
+        {
+            for (int i = sparse->row_start[k]; i < sparse->row_start[k + 1]; i++)
+            {
+                sparse->values[i] = weights[k * model->layers_size[layer] + sparse->columns[i]];
+            }
+        }
+    }
+    if (model->layers_panels == NULL)
+    {
+        return;
+    }
+    int n_outputs = model->layers_size[layer];
+    int panel_stride = layerInputSize(model, layer) * KERNEL_PANEL_WIDTH;
+    for (int k = first_input; k < first_input + n_inputs; k++)
+    {
+        const float *row = model->layers_weights[layer] + k * n_outputs;
+        for (int p = 0; p < layerPanels(model, layer); p++)
+        {
+            float *panel_row = model->layers_panels[layer] + p * panel_stride + k * KERNEL_PANEL_WIDTH;
+            int width = (n_outputs - p * KERNEL_PANEL_WIDTH < KERNEL_PANEL_WIDTH) ? n_outputs - p * KERNEL_PANEL_WIDTH : KERNEL_PANEL_WIDTH;
+            memcpy(panel_row, row + p * KERNEL_PANEL_WIDTH, width * sizeof(float));
+            memset(panel_row + width, 0, (KERNEL_PANEL_WIDTH - width) * sizeof(float));
+        }
+    }
+}
+
+/* Drops the packed copy of the weights, inference goes back to the weights themselves */
+void unpackModel(Model *model)
+{
+    free(model->panels_memory);
+    model->layers_panels = NULL;
+    model->panels_memory = NULL;
+}
+
+/* Stores the weights in a 16-bit format, halving the memory traffic of inference and of the layers a partial
+    training step only reads. The kernels expand the weights to float as they load them and accumulate in float.
+    The biases are copied, so the arrays the model was set with are left untouched and no longer used.
+    A flat or packed model can not be compressed.
+    @return 0 on success, -1 on failure */
+int compressModelWeights(Model *model, enum HalfFormat format)
+{
+    if (model->params != NULL || model->layers_panels != NULL || model->layers_weights_half != NULL || model->layers_sparse != NULL)
+    {
+        printf("Error: only a model with separate float weights can be compressed! \n");
+        return -1;
+    }
+    // pointer arrays, then the float biases, then the 16-bit weights on an aligned boundary
+    size_t pointers_bytes = model->n_layers * (2 * sizeof(float *) + sizeof(uint16_t *));
+    size_t n_biases = 0;
+    size_t n_weights = 0;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        n_biases += model->layers_size[i];
+        n_weights += (size_t)layerInputSize(model, i) * model->layers_size[i];
+    }
+    size_t biases_bytes = n_biases * sizeof(float);
+    void *memory = malloc(pointers_bytes + biases_bytes + MODEL_PARAMS_ALIGNMENT + n_weights * sizeof(uint16_t));
+    if (memory == NULL)
+    {
+        printf("Error: could not allocate 16-bit weights! \n");
+        return -1;
+    }
+
+    float **layers_weights = (float **)memory;
+    float **layers_biases = layers_weights + model->n_layers;
+    model->layers_weights_half = (uint16_t **)(layers_biases + model->n_layers);
+    float *biases = (float *)((char *)memory + pointers_bytes);
+    uintptr_t aligned = ((uintptr_t)biases + biases_bytes + MODEL_PARAMS_ALIGNMENT - 1) & ~(uintptr_t)(MODEL_PARAMS_ALIGNMENT - 1);
+    uint16_t *weights = (uint16_t *)aligned;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        int n = layerInputSize(model, i) * model->layers_size[i];
+        convert_to_half(weights, model->layers_weights[i], n, format);
+        memcpy(biases, model->layers_biases[i], model->layers_size[i] * sizeof(float));
+        model->layers_weights_half[i] = weights;
+        layers_weights[i] = NULL;
+        layers_biases[i] = biases;
+        weights += n;
+        biases += model->layers_size[i];
+    }
+    model->layers_weights = layers_weights;
+    model->layers_biases = layers_biases;
+    model->half_format = format;
+    model->half_memory = memory;
+    return 0;
+}
+
+/* Adds an fp32 master copy of the weights of a layer of a compressed model, so training can accumulate updates
+    smaller than the 16-bit precision. The master copy is used in place of the 16-bit weights, which repackModelWeights
+    keeps in sync, until freeMasterWeights. Does nothing for an uncompressed model or a layer that already has one.
+    @return 0 on success, -1 if the copy could not be allocated */
+int createMasterWeights(Model *model, int layer)
+{
+    if (model->layers_weights_half == NULL || model->layers_weights[layer] != NULL)
+    {
+        return 0;
+    }
+    int n = layerInputSize(model, layer) * model->layers_size[layer];
+    float *master = (float *)malloc(n * sizeof(float));
+    if (master == NULL)
+    {
+        printf("Error: could not allocate master weights! \n");
+        return -1;
+    }
+    convert_from_half(master, model->layers_weights_half[layer], n, model->half_format);
+    model->layers_weights[layer] = master;
+    return 0;
+}
+
+/* Drops the master copies of a compressed model once training is done, its layers go back to the 16-bit weights.
+    Does nothing for an uncompressed model, whose weights belong to the caller. */
+void freeMasterWeights(Model *model)
+{
+    if (model->layers_weights_half == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        free(model->layers_weights[i]);
+        model->layers_weights[i] = NULL;
+    }
+}
+
+/* 16-bit weights to read for a layer, NULL when the layer is read from layers_weights */
+const uint16_t *modelHalfWeights(Model *model, int layer)
+{
+    if (model->layers_weights_half == NULL || model->layers_weights[layer] != NULL)
+    {
+        return NULL;
+    }
+    return model->layers_weights_half[layer];
+}
+
+/* Bytes held by the weights of a model, including the master copies of a compressed model */
+size_t modelWeightsBytes(Model *model)
+{
+    size_t n_bytes = 0;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        size_t n = (size_t)layerInputSize(model, i) * model->layers_size[i];
+        if (model->layers_weights_half != NULL)
+        {
+            n_bytes += n * sizeof(uint16_t);
+        }
+        if (model->layers_weights[i] != NULL)
+        {
+            n_bytes += n * sizeof(float);
+        }
+    }
+    return n_bytes;
+}
+
+/* Adds a sparse copy of the weights of a layer in compressed sparse rows, if at most max_density of them are
+    nonzero, e.g. after pruning with model_converter.py --prune. Compute and memory traffic of the layer then
+    scale with its nonzeros. Otherwise the layer stays dense, and a sparse copy made before is dropped.
+    The nonzero pattern is fixed: training only computes gradients for the nonzero weights, so the zeros stay zero.
+    @return 1 if the layer is sparse, 0 if it is dense, -1 on failure */
+int sparsifyModelLayer(Model *model, int layer, float max_density)
+{
+    if (model->layers_weights_half != NULL)
+    {
+        printf("Error: a model with 16-bit weights can not be sparse! \n");
+        return -1;
+    }
+    int n_rows = layerInputSize(model, layer);
+    int n_outputs = model->layers_size[layer];
+    const float *weights = model->layers_weights[layer];
+    int n_nonzeros = 0;
+    for (int i = 0; i < n_rows * n_outputs; i++)
+    {
+        n_nonzeros += (weights[i] != 0);
+    }
+    if (model->layers_sparse == NULL)
+    {
+        model->layers_sparse = (SparseWeights **)calloc(model->n_layers, sizeof(SparseWeights *));
+        if (model->layers_sparse == NULL)
+        {
+            printf("Error: could not allocate sparse weights! \n");
+            return -1;
+        }
+    }
+    free(model->layers_sparse[layer]);
+    model->layers_sparse[layer] = NULL;
+    if (n_nonzeros > max_density * n_rows * n_outputs)
+    {
+        return 0;
+    }
+
+    // the struct, then the row starts and columns, then the values on an aligned boundary
+    size_t index_bytes = sizeof(SparseWeights) + (size_t)(n_rows + 1 + n_nonzeros) * sizeof(int);
+    char *memory = (char *)malloc(index_bytes + MODEL_PARAMS_ALIGNMENT + (size_t)n_nonzeros * sizeof(float));
+    if (memory == NULL)
+    {
+        printf("Error: could not allocate sparse weights! \n");
+        return -1;
+    }
+    SparseWeights *sparse = (SparseWeights *)memory;
+    sparse->n_rows = n_rows;
+    sparse->n_nonzeros = n_nonzeros;
+    sparse->row_start = (int *)(memory + sizeof(SparseWeights));
+    sparse->columns = sparse->row_start + n_rows + 1;
+    uintptr_t aligned = ((uintptr_t)memory + index_bytes + MODEL_PARAMS_ALIGNMENT - 1) & ~(uintptr_t)(MODEL_PARAMS_ALIGNMENT - 1);
+    sparse->values = (float *)aligned;
+    int n = 0;
+    for (int j = 0; j < n_rows; j++)
+    {
+        sparse->row_start[j] = n;
+        for (int o = 0; o < n_outputs; o++)
+        {
+            if (weights[j * n_outputs + o] != 0)
+            {
+                sparse->columns[n] = o;
+                sparse->values[n] = weights[j * n_outputs + o];
+                n++;
+            }
+        }
+    }
+    sparse->row_start[n_rows] = n;
+    model->layers_sparse[layer] = sparse;
+    return 1;
+}
+
+/* sparsifyModelLayer for every layer, e.g. with max_density SPARSE_MAX_DENSITY
+    @return the number of sparse layers, -1 on failure */
+int sparsifyModel(Model *model, float max_density)
+{
+    int n_sparse = 0;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        int sparse = sparsifyModelLayer(model, i, max_density);
+        if (sparse < 0)
+        {
+            return -1;
+        }
+        n_sparse += sparse;
+    }
+    return n_sparse;
+}
+
+/* Drops the sparse copies, every layer goes back to its dense weights */
+void densifyModel(Model *model)
+{
+    if (model->layers_sparse == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        free(model->layers_sparse[i]);
+    }
+    free(model->layers_sparse);
+    model->layers_sparse = NULL;
+}
+
+/* Sparse weights to read for a layer, NULL when the layer is dense */
+const SparseWeights *modelSparseWeights(Model *model, int layer)
+{
+    return (model->layers_sparse == NULL) ? NULL : model->layers_sparse[layer];
+}
+
+/* number of floats per alignment unit, buffers in the arena start on these boundaries */
+#define PLAN_ALIGN_FLOATS (INFERENCE_PLAN_ALIGNMENT / (int)sizeof(float))
+
+static int alignPlanSize(int size)
+{
+    return (size + PLAN_ALIGN_FLOATS - 1) / PLAN_ALIGN_FLOATS * PLAN_ALIGN_FLOATS;
+}
+
+/* Arena size in floats: the input and the final output live in caller memory,
+    so only the outputs of layers 0..n_layers-2 are placed in the arena */
+static int planArenaSize(Model *model)
+{
+    int arena_size = 0;
+    for (int i = 0; i < model->n_layers - 1; i++)
+    {
+        int pair = alignPlanSize(model->layers_size[i]);
+        if (i > 0)
+        {
+            pair += alignPlanSize(model->layers_size[i - 1]);
+        }
+        if (pair > arena_size)
+        {
+            arena_size = pair;
+        }
+    }
+    return arena_size;
+}
+
+/* Bytes needed for the arena of a model, use to size static memory for setInferencePlan */
+size_t inferencePlanArenaBytes(Model *model)
+{
+    return (size_t)planArenaSize(model) * sizeof(float);
+}
+
+/* binds a model and a caller-provided arena to a plan.
+    arena must be INFERENCE_PLAN_ALIGNMENT aligned and hold inferencePlanArenaBytes(model) bytes */
+void setInferencePlan(InferencePlan *plan, Model *model, void *arena)
+{
+    plan->model = model;
+    plan->arena_size = planArenaSize(model);
+    plan->arena = (float *)arena;
+    plan->memory = NULL;
+    plan->n_bytes = sizeof(InferencePlan) + inferencePlanArenaBytes(model);
+}
+
+/* Create a plan owning an aligned arena for the model */
+InferencePlan *createInferencePlan(Model *model)
+{
+    InferencePlan *plan = (InferencePlan *)malloc(sizeof(InferencePlan));
+    size_t arena_bytes = inferencePlanArenaBytes(model);
+    void *memory = malloc(arena_bytes + INFERENCE_PLAN_ALIGNMENT);
+    if (plan == NULL || memory == NULL)
+    {
+        printf("Error: could not allocate inference plan! \n");
+        free(plan);
+        free(memory);
+        return NULL;
+    }
+
+    uintptr_t aligned = ((uintptr_t)memory + INFERENCE_PLAN_ALIGNMENT - 1) & ~(uintptr_t)(INFERENCE_PLAN_ALIGNMENT - 1);
+    setInferencePlan(plan, model, (void *)aligned);
+    plan->memory = memory;
+    plan->n_bytes = sizeof(InferencePlan) + arena_bytes + INFERENCE_PLAN_ALIGNMENT;
+
+    return plan;
+}
+
+/* Exact number of bytes held by the plan, including the plan itself */
+size_t inferencePlanBytes(InferencePlan *plan)
+{
+    return plan->n_bytes;
+}
+
+/* Output buffer of a hidden layer, even layers use the start of the arena and odd layers the end */
+float *inferencePlanLayerOutput(InferencePlan *plan, int layer)
+{
+    if (layer % 2 == 0)
+    {
+        return plan->arena;
+    }
+    return plan->arena + plan->arena_size - alignPlanSize(plan->model->layers_size[layer]);
+}
+
+/* Frees a plan created with createInferencePlan */
+void freeInferencePlan(InferencePlan *plan)
+{
+    free(plan->memory);
+    free(plan);
+}
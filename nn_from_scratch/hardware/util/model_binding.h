@@ -1,7 +1,22 @@
 #ifndef MODEL_BINDING_H
 #define MODEL_BINDING_H
 #include "activation_functions.h"
+#include "kernels.h"
+#include <stddef.h>
 #include <stdint.h>
+
+#ifndef INFERENCE_PLAN_ALIGNMENT
+#define INFERENCE_PLAN_ALIGNMENT 64
+#endif
+
+#ifndef MODEL_PARAMS_ALIGNMENT
+#define MODEL_PARAMS_ALIGNMENT 64
+#endif
+
+#ifndef SPARSE_MAX_DENSITY
+#define SPARSE_MAX_DENSITY 0.15f // largest fraction of nonzero weights a layer is stored sparse with, denser layers are faster dense
+#endif
+
 typedef struct
 {
     int n_layers;
@@ -11,6 +26,24 @@ typedef struct
     float **layers_weights;
     float **layers_biases;
     enum ActivationType *layers_activation;
+    /* Optional flat layout: all weights and biases in one aligned buffer, layer by layer with
+        each array starting on a MODEL_PARAMS_ALIGNMENT boundary. layers_weights and layers_biases
+        then point into params. */
+    float *params;       // NULL when the layers are stored separately
+    int n_params;        // floats in params, including alignment padding
+    void *params_memory; // allocation owned by the model, freed by freeModel
+    /* Optional packed copy of the weights for inference, see packModel. Per layer, panels of
+        KERNEL_PANEL_WIDTH consecutive outputs, each holding one row of KERNEL_PANEL_WIDTH weights per input. */
+    float **layers_panels; // NULL when the model is not packed
+    void *panels_memory;
+    /* Optional 16-bit storage of the weights, see compressModelWeights. layers_weights[i] then holds the fp32
+        master copy of a layer that is being trained, and is NULL for the layers only stored in 16 bits. */
+    uint16_t **layers_weights_half; // NULL when the weights are stored in float
+    enum HalfFormat half_format;
+    void *half_memory;
+    /* Optional sparse copy of the weights of layers with few nonzeros, see sparsifyModel. Inference and training
+        read a sparse layer from it, the weights remain the master copy. */
+    SparseWeights **layers_sparse; // NULL when every layer is dense, NULL entries for the dense layers
 } Model;
 
 void setModel(Model *model, int n_layers, int input_size, int output_size, int *layers_size, float **layers_weights,
@@ -21,4 +54,58 @@ Model *createAndSetModel(int n_layers, int input_size, int output_size, int *lay
 
 void freeModel(Model *model);
 
+int modelParamsSize(Model *model);
+
+int flattenModel(Model *model);
+
+int bindModelParams(Model *model, float *params);
+
+int packModel(Model *model);
+
+void repackModelWeights(Model *model, int layer, int first_input, int n_inputs);
+
+void unpackModel(Model *model);
+
+int compressModelWeights(Model *model, enum HalfFormat format);
+
+int createMasterWeights(Model *model, int layer);
+
+void freeMasterWeights(Model *model);
+
+const uint16_t *modelHalfWeights(Model *model, int layer);
+
+size_t modelWeightsBytes(Model *model);
+
+int sparsifyModelLayer(Model *model, int layer, float max_density);
+
+int sparsifyModel(Model *model, float max_density);
+
+void densifyModel(Model *model);
+
+const SparseWeights *modelSparseWeights(Model *model, int layer);
+
+/* Preplanned activation memory for zero-allocation inference.
+    Hidden layer outputs ping-pong between the two ends of one arena, so it only needs
+    to hold the widest pair of adjacent hidden layers. */
+typedef struct
+{
+    Model *model;
+    int arena_size;  // in floats
+    float *arena;    // aligned to INFERENCE_PLAN_ALIGNMENT
+    void *memory;    // allocation owned by the plan, NULL if the arena was provided by the caller
+    size_t n_bytes;  // total footprint of the plan
+} InferencePlan;
+
+size_t inferencePlanArenaBytes(Model *model);
+
+void setInferencePlan(InferencePlan *plan, Model *model, void *arena);
+
+InferencePlan *createInferencePlan(Model *model);
+
+size_t inferencePlanBytes(InferencePlan *plan);
+
+float *inferencePlanLayerOutput(InferencePlan *plan, int layer);
+
+void freeInferencePlan(InferencePlan *plan);
+
 #endif
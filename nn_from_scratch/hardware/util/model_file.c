@@ -0,0 +1,247 @@
+#define _POSIX_C_SOURCE 200809L // fileno
+#include "model_file.h"
+#include "byte_order.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+/*
+    Like the model binding, model files are excluded from memory tracking.
+*/
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MODEL_FILE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static size_t alignFileOffset(size_t offset)
+{
+    return (offset + MODEL_PARAMS_ALIGNMENT - 1) / MODEL_PARAMS_ALIGNMENT * MODEL_PARAMS_ALIGNMENT;
+}
+
+/* maps the file copy-on-write, so training the model never writes back to it.
+    Falls back to reading it into an aligned buffer where mmap is not available.
+    @return 0 on success */
+static int mapModelFile(ModelFile *file, FILE *f)
+{
+#ifdef MODEL_FILE_MMAP
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size <= 0)
+    {
+        return -1;
+    }
+    file->n_bytes = (size_t)st.st_size;
+    file->data = mmap(NULL, file->n_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+    if (file->data == MAP_FAILED)
+    {
+        file->data = NULL;
+        return -1;
+    }
+    return 0;
+#else
+    if (fseek(f, 0, SEEK_END) != 0)
+    {
+        return -1;
+    }
+    long size = ftell(f);
+    if (size <= 0 || fseek(f, 0, SEEK_SET) != 0)
+    {
+        return -1;
+    }
+    file->n_bytes = (size_t)size;
+    file->memory = malloc(file->n_bytes + MODEL_PARAMS_ALIGNMENT);
+    if (file->memory == NULL)
+    {
+        return -1;
+    }
+    uintptr_t aligned = ((uintptr_t)file->memory + MODEL_PARAMS_ALIGNMENT - 1) & ~(uintptr_t)(MODEL_PARAMS_ALIGNMENT - 1);
+    file->data = (void *)aligned;
+    return fread(file->data, 1, file->n_bytes, f) == file->n_bytes ? 0 : -1;
+#endif
+}
+
+/* Opens a binary model file and builds a model whose layers point straight into the file contents.
+    The parameters are private to this process once written, e.g. by training.
+    @return the opened file, NULL if it could not be read or is not a valid model file */
+ModelFile *openModelFile(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        printf("Error: could not open model file %s! \n", path);
+        return NULL;
+    }
+    ModelFile *file = (ModelFile *)calloc(1, sizeof(ModelFile));
+    int mapped = (file != NULL) ? mapModelFile(file, f) : -1;
+    fclose(f);
+    if (mapped != 0)
+    {
+        printf("Error: could not read model file %s! \n", path);
+        closeModelFile(file);
+        return NULL;
+    }
+
+    const uint8_t *bytes = (const uint8_t *)file->data;
+    if (file->n_bytes < MODEL_FILE_HEADER_BYTES || memcmp(bytes, MODEL_FILE_MAGIC, 4) != 0)
+    {
+        printf("Error: %s is not a model file! \n", path);
+        closeModelFile(file);
+        return NULL;
+    }
+    uint32_t version = read_u32(bytes + 4);
+    uint32_t alignment = read_u32(bytes + 8);
+    uint32_t n_layers = read_u32(bytes + 12);
+    uint32_t input_size = read_u32(bytes + 16);
+    uint32_t output_size = read_u32(bytes + 20);
+    uint32_t params_offset = read_u32(bytes + 24);
+    uint32_t n_params = read_u32(bytes + 28);
+    size_t table_end = MODEL_FILE_HEADER_BYTES + 8 * (size_t)n_layers;
+    if (version != MODEL_FILE_VERSION || alignment != MODEL_PARAMS_ALIGNMENT || n_layers == 0 ||
+        table_end > file->n_bytes || params_offset < table_end || params_offset % alignment != 0 ||
+        params_offset + (size_t)n_params * sizeof(float) > file->n_bytes)
+    {
+        printf("Error: unsupported or corrupt model file %s! \n", path);
+        closeModelFile(file);
+        return NULL;
+    }
+
+    file->layers_size = (int *)malloc(n_layers * sizeof(int));
+    file->layers_activation = (enum ActivationType *)malloc(n_layers * sizeof(enum ActivationType));
+    int valid = file->layers_size != NULL && file->layers_activation != NULL;
+    for (uint32_t i = 0; valid && i < n_layers; i++)
+    {
+        uint32_t size = read_u32(bytes + MODEL_FILE_HEADER_BYTES + 8 * i);
+        uint32_t activation = read_u32(bytes + MODEL_FILE_HEADER_BYTES + 8 * i + 4);
+        valid = size > 0 && (activation == LINEAR || activation == RELU);
+        if (valid)
+        {
+            file->layers_size[i] = (int)size;
+            file->layers_activation[i] = (enum ActivationType)activation;
+        }
+    }
+    if (valid)
+    {
+        file->model = createAndSetModel((int)n_layers, (int)input_size, (int)output_size, file->layers_size,
+                                        NULL, NULL, file->layers_activation);
+        valid = file->model != NULL && (int)output_size == file->layers_size[n_layers - 1] &&
+                (int)n_params == modelParamsSize(file->model);
+    }
+    if (!valid)
+    {
+        printf("Error: unsupported or corrupt model file %s! \n", path);
+        closeModelFile(file);
+        return NULL;
+    }
+
+    float *params = (float *)((uint8_t *)file->data + params_offset);
+    // the contents are private to this process, so the parameters can be swapped in place
+    swap_floats(params, n_params);
+    if (bindModelParams(file->model, params) != 0)
+    {
+        closeModelFile(file);
+        return NULL;
+    }
+    return file;
+}
+
+/* Closes a model file, the model it holds can no longer be used */
+void closeModelFile(ModelFile *file)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    if (file->model != NULL)
+    {
+        freeModel(file->model);
+    }
+#ifdef MODEL_FILE_MMAP
+    if (file->data != NULL)
+    {
+        munmap(file->data, file->n_bytes);
+    }
+#endif
+    free(file->memory);
+    free(file->layers_size);
+    free(file->layers_activation);
+    free(file);
+}
+
+/* writes 16-bit weights expanded to floats, a block at a time */
+static int writeHalfAsFloats(const uint16_t *values, int n, enum HalfFormat format, FILE *f)
+{
+    float block[256];
+    for (int i = 0; i < n; i += 256)
+    {
+        int count = (n - i < 256) ? n - i : 256;
+        convert_from_half(block, values + i, count, format);
+        if (write_floats(block, count, f) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* writes zero bytes up to the next alignment boundary
+    @return 0 on success */
+static int writePadding(size_t offset, FILE *f)
+{
+    static const uint8_t zeros[MODEL_PARAMS_ALIGNMENT] = {0};
+    size_t padding = alignFileOffset(offset) - offset;
+    return fwrite(zeros, 1, padding, f) == padding ? 0 : -1;
+}
+
+/* Saves a model, flat or not, as a binary model file, e.g. to snapshot a trained model. 16-bit weights are saved as floats.
+    @return 0 on success, -1 on failure */
+int writeModelFile(Model *model, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        printf("Error: could not create model file %s! \n", path);
+        return -1;
+    }
+
+    size_t table_end = MODEL_FILE_HEADER_BYTES + 8 * (size_t)model->n_layers;
+    uint8_t header[MODEL_FILE_HEADER_BYTES];
+    memcpy(header, MODEL_FILE_MAGIC, 4);
+    put_u32(header + 4, MODEL_FILE_VERSION);
+    put_u32(header + 8, MODEL_PARAMS_ALIGNMENT);
+    put_u32(header + 12, (uint32_t)model->n_layers);
+    put_u32(header + 16, (uint32_t)model->input_size);
+    put_u32(header + 20, (uint32_t)model->output_size);
+    put_u32(header + 24, (uint32_t)alignFileOffset(table_end));
+    put_u32(header + 28, (uint32_t)modelParamsSize(model));
+    int failed = fwrite(header, 1, MODEL_FILE_HEADER_BYTES, f) != MODEL_FILE_HEADER_BYTES;
+
+    for (int i = 0; i < model->n_layers && !failed; i++)
+    {
+        uint8_t layer[8];
+        put_u32(layer, (uint32_t)model->layers_size[i]);
+        put_u32(layer + 4, (uint32_t)model->layers_activation[i]);
+        failed = fwrite(layer, 1, 8, f) != 8;
+    }
+    failed = failed || writePadding(table_end, f);
+
+    // weights and biases of each layer, every array padded to the alignment
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers && !failed; i++)
+    {
+        int n_weights = size * model->layers_size[i];
+        const uint16_t *half_weights = modelHalfWeights(model, i);
+        failed = (half_weights != NULL ? writeHalfAsFloats(half_weights, n_weights, model->half_format, f)
+                                       : write_floats(model->layers_weights[i], n_weights, f)) ||
+                 writePadding(n_weights * sizeof(float), f) ||
+                 write_floats(model->layers_biases[i], model->layers_size[i], f) ||
+                 writePadding(model->layers_size[i] * sizeof(float), f);
+        size = model->layers_size[i];
+    }
+
+    if (fclose(f) != 0 || failed)
+    {
+        printf("Error: could not write model file %s! \n", path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+#include "model_binding.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Binary model file, version 1. All fields are little-endian.
+    offset 0:  char[4]  magic "NNFM"
+    offset 4:  uint32   version
+    offset 8:  uint32   alignment of the parameter blob and of every array in it, must equal MODEL_PARAMS_ALIGNMENT
+    offset 12: uint32   n_layers
+    offset 16: uint32   input_size
+    offset 20: uint32   output_size
+    offset 24: uint32   params_offset, multiple of alignment
+    offset 28: uint32   n_params, in floats
+    offset 32: n_layers x {uint32 layer size, uint32 activation (enum ActivationType)}
+    params_offset: float32[n_params], the flat parameter layout of model_binding.h
+*/
+#define MODEL_FILE_MAGIC "NNFM"
+#define MODEL_FILE_VERSION 1
+#define MODEL_FILE_HEADER_BYTES 32
+
+typedef struct
+{
+    Model *model;
+    void *data;    // the file contents, mapped where mmap is available
+    size_t n_bytes;
+    void *memory;  // allocation holding data when the file was read instead of mapped
+    int *layers_size;
+    enum ActivationType *layers_activation;
+} ModelFile;
+
+ModelFile *openModelFile(const char *path);
+
+void closeModelFile(ModelFile *file);
+
+int writeModelFile(Model *model, const char *path);
+
+#endif
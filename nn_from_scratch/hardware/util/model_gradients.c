@@ -1,18 +1,166 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include "config.h"
 #include "model_gradients.h"
+#include "kernels.h"
+/* Layers per segment, 0 when every layer keeps its net inputs and nothing is recomputed */
+static int normalize_checkpoint_interval(Model *model, int interval)
+{
+    return (interval > 0 && interval < model->n_layers) ? interval : 0;
+}
+
+/* A layer keeps its net inputs as a checkpoint when it ends a segment of interval layers, the output layer never does */
+static int is_checkpoint(Model *model, int interval, int layer)
+{
+    return interval > 0 && layer % interval == interval - 1 && layer < model->n_layers - 1;
+}
+
+/* Floats of the net inputs recomputed at one position of the segments, the widest layer at that position */
+static int segment_slot_size(Model *model, int interval, int slot)
+{
+    int size = 0;
+    for (int i = slot; i < model->n_layers; i += interval)
+    {
+        if (!is_checkpoint(model, interval, i) && model->layers_size[i] > size)
+        {
+            size = model->layers_size[i];
+        }
+    }
+    return size;
+}
+
+/* Bytes of net inputs the gradients hold for one sample, the checkpoints and the segment being recomputed
+    @param interval: layers per segment, 0 keeps the net inputs of every layer */
+size_t gradients_activations_size(Model *model, int interval)
+{
+    size_t size = 0;
+    interval = normalize_checkpoint_interval(model, interval);
+    if (interval == 0)
+    {
+        interval = model->n_layers;
+    }
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        size += is_checkpoint(model, interval, i) ? model->layers_size[i] : 0;
+    }
+    for (int slot = 0; slot < interval; slot++)
+    {
+        size += segment_slot_size(model, interval, slot);
+    }
+    return size * sizeof(float);
+}
+
+/* Picks the checkpoint interval whose net inputs fit a budget with the least recomputation. The layers before the
+    last segment are computed twice, except the checkpoints.
+    @param budget: bytes of net inputs, see gradients_activations_size
+    @return the interval, 0 if the net inputs of every layer fit, -1 if no interval fits */
+int checkpoint_interval_for_budget(Model *model, size_t budget)
+{
+    int best = -1;
+    uint64_t best_cost = 0;
+    size_t best_size = 0;
+    for (int interval = 1; interval <= model->n_layers; interval++)
+    {
+        size_t size = gradients_activations_size(model, interval);
+        if (size > budget)
+        {
+            continue;
+        }
+        uint64_t cost = 0;
+        int last_segment = (model->n_layers - 1) / interval * interval;
+        int input_size = model->input_size;
+        for (int i = 0; i < last_segment; i++)
+        {
+            cost += is_checkpoint(model, interval, i) ? 0 : (uint64_t)input_size * model->layers_size[i];
+            input_size = model->layers_size[i];
+        }
+        if (best < 0 || cost < best_cost || (cost == best_cost && size < best_size))
+        {
+            best = interval;
+            best_cost = cost;
+            best_size = size;
+        }
+    }
+    if (best < 0)
+    {
+        printf("Error: the net inputs of one layer do not fit in %zu bytes! \n", budget);
+        return -1;
+    }
+    return (best_cost == 0) ? 0 : best;
+}
+
 Gradients *allocate_gradients(Model *model)
+{
+    return allocate_checkpointed_gradients(model, 0);
+}
+
+/* Allocates gradients that keep the net inputs of every interval-th layer only. The layers between two checkpoints
+    share one segment of buffers and are recomputed from the checkpoint below them during backprop, see fc_calc_gradients.
+    @param interval: layers per segment, 0 or the number of layers keeps the net inputs of every layer
+*/
+Gradients *allocate_checkpointed_gradients(Model *model, int interval)
 {
     Gradients *gradients = (Gradients *)malloc(sizeof(Gradients));
 
     gradients->biases = (float **)malloc(model->n_layers * sizeof(float *));
     gradients->weights = (float **)malloc(model->n_layers * sizeof(float *));
     gradients->net_inputs = (float **)malloc(model->n_layers * sizeof(float *));
+    gradients->params = NULL;
+    gradients->n_params = 0;
+    gradients->params_memory = NULL;
+    gradients->checkpoint_interval = normalize_checkpoint_interval(model, interval);
+    gradients->activations_memory = NULL;
+
+    if (gradients->checkpoint_interval > 0)
+    {
+        interval = gradients->checkpoint_interval;
+        float *next = (float *)malloc(gradients_activations_size(model, interval));
+        gradients->activations_memory = next;
+        // checkpoints first, then one buffer per position in a segment
+        for (int i = 0; i < model->n_layers; i++)
+        {
+            if (is_checkpoint(model, interval, i))
+            {
+                gradients->net_inputs[i] = next;
+                next += model->layers_size[i];
+            }
+        }
+        for (int slot = 0; slot < interval; slot++)
+        {
+            for (int i = slot; i < model->n_layers; i += interval)
+            {
+                if (!is_checkpoint(model, interval, i))
+                {
+                    gradients->net_inputs[i] = next;
+                }
+            }
+            next += segment_slot_size(model, interval, slot);
+        }
+    }
+
+    if (model->params != NULL)
+    {
+        // same offsets as the model, so the whole buffer can be zeroed and applied in one pass
+        gradients->params_memory = calloc(model->n_params * sizeof(float) + MODEL_PARAMS_ALIGNMENT, 1);
+        uintptr_t aligned = ((uintptr_t)gradients->params_memory + MODEL_PARAMS_ALIGNMENT - 1) & ~(uintptr_t)(MODEL_PARAMS_ALIGNMENT - 1);
+        gradients->params = (float *)aligned;
+        gradients->n_params = model->n_params;
+    }
 
     for (int i = 0; i < model->n_layers; i++)
     {
+        if (gradients->activations_memory == NULL)
+        {
+            gradients->net_inputs[i] = (float *)malloc(model->layers_size[i] * sizeof(float));
+        }
+        if (gradients->params != NULL)
+        {
+            gradients->biases[i] = gradients->params + (model->layers_biases[i] - model->params);
+            gradients->weights[i] = gradients->params + (model->layers_weights[i] - model->params);
+            continue;
+        }
         gradients->biases[i] = (float *)calloc(model->layers_size[i], sizeof(float));
-        gradients->net_inputs[i] = (float *)malloc(model->layers_size[i] * sizeof(float));
         // size of weights:
         if (i == 0)
         {
@@ -33,9 +181,23 @@ void free_gradients(Gradients *gradients, Model *model)
 
     for (int i = 0; i < model->n_layers; i++)
     {
-        free(gradients->biases[i]);
-        free(gradients->weights[i]);
-        free(gradients->net_inputs[i]);
+        if (gradients->params == NULL)
+        {
+            free(gradients->biases[i]);
+            free(gradients->weights[i]);
+        }
+        if (gradients->activations_memory == NULL)
+        {
+            free(gradients->net_inputs[i]);
+        }
+    }
+    if (gradients->params_memory != NULL)
+    {
+        free(gradients->params_memory);
+    }
+    if (gradients->activations_memory != NULL)
+    {
+        free(gradients->activations_memory);
     }
     free(gradients->biases);
     free(gradients->weights);
@@ -43,20 +205,66 @@ void free_gradients(Gradients *gradients, Model *model)
     free(gradients);
 }
 
+/* Accumulates the weight and bias gradients of other into gradients */
+void add_gradients(Gradients *gradients, Gradients *other, Model *model)
+{
+    AxpyKernel axpy = get_kernels()->axpy;
+    if (gradients->params != NULL && other->params != NULL)
+    {
+        axpy(gradients->params, other->params, 1, gradients->n_params);
+        return;
+    }
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        axpy(gradients->biases[i], other->biases[i], 1, model->layers_size[i]);
+        axpy(gradients->weights[i], other->weights[i], 1, model->layers_size[i] * size);
+        size = model->layers_size[i];
+    }
+}
+
+/* Clears the weight and bias gradients for the next step, net inputs are overwritten by the forward pass */
+void zero_gradients(Gradients *gradients, Model *model)
+{
+    if (gradients->params != NULL)
+    {
+        memset(gradients->params, 0, gradients->n_params * sizeof(float));
+        return;
+    }
+    int size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        memset(gradients->biases[i], 0, model->layers_size[i] * sizeof(float));
+        memset(gradients->weights[i], 0, model->layers_size[i] * size * sizeof(float));
+        size = model->layers_size[i];
+    }
+}
+
 PartialGradients *allocate_partial_gradients(Model *model, int target_layer, int n_neurons)
 {
     PartialGradients *gradients = (PartialGradients *)malloc(sizeof(PartialGradients));
 
     gradients->biases = (float *)calloc(model->layers_size[target_layer], sizeof(float)); // biases updated for the targets and for prev layer
-    gradients->deriv_activations = (uint8_t **)malloc((model->n_layers - target_layer) * sizeof(uint8_t *));
+    gradients->deriv_masks = (uint32_t **)malloc((model->n_layers - target_layer) * sizeof(uint32_t *));
     gradients->weights = (float *)calloc(n_neurons * model->layers_size[target_layer], sizeof(float));
     gradients->net_input = (float *)malloc(n_neurons * sizeof(float));
 
     // neurons will be set when forward propagating
     for (int i = 0; i < model->n_layers - target_layer; i++)
     {
-        gradients->deriv_activations[i] = (uint8_t *)malloc(model->layers_size[i + target_layer] * sizeof(uint8_t));
+        gradients->deriv_masks[i] = (uint32_t *)malloc(KERNEL_MASK_WORDS(model->layers_size[i + target_layer]) * sizeof(uint32_t));
+    }
+
+    int max_size = 0;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        if (model->layers_size[i] > max_size)
+        {
+            max_size = model->layers_size[i];
+        }
     }
+    gradients->layer_buffers[0] = (float *)malloc(max_size * sizeof(float));
+    gradients->layer_buffers[1] = (float *)malloc(max_size * sizeof(float));
 
     return gradients;
 }
@@ -67,9 +275,119 @@ void free_partial_gradients(PartialGradients *gradients, Model *model, int targe
     free(gradients->weights);
     for (int i = 0; i < model->n_layers - target_layer; i++)
     {
-        free(gradients->deriv_activations[i]);
+        free(gradients->deriv_masks[i]);
     }
-    free(gradients->deriv_activations);
+    free(gradients->deriv_masks);
     free(gradients->net_input);
+    free(gradients->layer_buffers[0]);
+    free(gradients->layer_buffers[1]);
     free(gradients);
+}
+
+void zero_partial_gradients(PartialGradients *gradients, Model *model, int target_layer, int n_neurons)
+{
+    memset(gradients->biases, 0, model->layers_size[target_layer] * sizeof(float));
+    memset(gradients->weights, 0, n_neurons * model->layers_size[target_layer] * sizeof(float));
+}
+
+TrainContext *create_train_context(void)
+{
+    TrainContext *context = (TrainContext *)malloc(sizeof(TrainContext));
+    context->gradients = NULL;
+    context->thread_gradients = NULL;
+    context->n_thread_gradients = 0;
+    context->partial_gradients = NULL;
+    context->partial_target_layer = -1;
+    context->partial_n_weights = 0;
+    context->optimizer = NULL;
+    context->checkpoint_interval = 0;
+    return context;
+}
+
+/* Gradients for full model training, allocated on the first call and when the checkpoint interval changes */
+Gradients *train_context_gradients(TrainContext *context, Model *model)
+{
+    if (context->gradients != NULL &&
+        context->gradients->checkpoint_interval != normalize_checkpoint_interval(model, context->checkpoint_interval))
+    {
+        free_gradients(context->gradients, model);
+        context->gradients = NULL;
+    }
+    if (context->gradients == NULL)
+    {
+        context->gradients = allocate_checkpointed_gradients(model, context->checkpoint_interval);
+    }
+    return context->gradients;
+}
+
+/* Gradients for each of n_threads threads, only allocated when more threads are used than before and reallocated
+    when the checkpoint interval changes */
+Gradients **train_context_thread_gradients(TrainContext *context, Model *model, int n_threads)
+{
+    if (context->n_thread_gradients > 0 &&
+        context->thread_gradients[0]->checkpoint_interval != normalize_checkpoint_interval(model, context->checkpoint_interval))
+    {
+        for (int t = 0; t < context->n_thread_gradients; t++)
+        {
+            free_gradients(context->thread_gradients[t], model);
+        }
+        free(context->thread_gradients);
+        context->thread_gradients = NULL;
+        context->n_thread_gradients = 0;
+    }
+    if (n_threads > context->n_thread_gradients)
+    {
+        Gradients **thread_gradients = (Gradients **)malloc(n_threads * sizeof(Gradients *));
+        for (int t = 0; t < n_threads; t++)
+        {
+            thread_gradients[t] = (t < context->n_thread_gradients) ? context->thread_gradients[t]
+                                                                       : allocate_checkpointed_gradients(model, context->checkpoint_interval);
+        }
+        if (context->thread_gradients != NULL)
+        {
+            free(context->thread_gradients);
+        }
+        context->thread_gradients = thread_gradients;
+        context->n_thread_gradients = n_threads;
+    }
+    return context->thread_gradients;
+}
+
+/* Partial gradients for the target layer, only reallocated when the target or number of neurons changes */
+PartialGradients *train_context_partial_gradients(TrainContext *context, Model *model, int target_layer, int n_neurons)
+{
+    if (context->partial_gradients != NULL &&
+        (context->partial_target_layer != target_layer || context->partial_n_weights != n_neurons))
+    {
+        free_partial_gradients(context->partial_gradients, model, context->partial_target_layer);
+        context->partial_gradients = NULL;
+    }
+    if (context->partial_gradients == NULL)
+    {
+        context->partial_gradients = allocate_partial_gradients(model, target_layer, n_neurons);
+        context->partial_target_layer = target_layer;
+        context->partial_n_weights = n_neurons;
+    }
+    return context->partial_gradients;
+}
+
+void free_train_context(TrainContext *context, Model *model)
+{
+    if (context->gradients != NULL)
+    {
+        free_gradients(context->gradients, model);
+    }
+    for (int t = 0; t < context->n_thread_gradients; t++)
+    {
+        free_gradients(context->thread_gradients[t], model);
+    }
+    if (context->thread_gradients != NULL)
+    {
+        free(context->thread_gradients);
+    }
+    if (context->partial_gradients != NULL)
+    {
+        free_partial_gradients(context->partial_gradients, model, context->partial_target_layer);
+    }
+    free(context);
 }
\ No newline at end of file
@@ -4,12 +4,18 @@
 #include "activation_functions.h"
 #include <stdint.h>
 #include "model_binding.h"
+#include "optimizer.h"
 typedef struct
 {
     float **weights;
     float **biases;
     float **net_inputs;
     uint8_t **deriv_activations;
+    float *params;       // flat layout mirroring model->params, NULL if the model is not flat
+    int n_params;
+    void *params_memory; // allocation holding params
+    int checkpoint_interval;  // net inputs are kept at every checkpoint_interval-th layer, 0 keeps all of them
+    void *activations_memory; // allocation holding the checkpoints and segment net inputs, NULL without checkpointing
 } Gradients;
 
 typedef struct
@@ -17,13 +23,41 @@ typedef struct
     float *weights;
     float *biases;
     float *net_input;
-    uint8_t **deriv_activations;
+    uint32_t **deriv_masks; // per layer from the target up, bit-packed relu/linear derivatives, see pack_deriv_mask
+    float *layer_buffers[2]; // ping-pong outputs and gradients of the layers, widest layer each
 } PartialGradients;
 
+/* Workspace reused across training steps of one model. Buffers are allocated on first use and only
+    zeroed between steps, so a training step in the steady state does not allocate.
+*/
+typedef struct
+{
+    Gradients *gradients;
+    Gradients **thread_gradients; // one per thread for parallel training
+    int n_thread_gradients;
+    PartialGradients *partial_gradients; // shaped for partial_target_layer and partial_n_weights
+    int partial_target_layer;
+    int partial_n_weights;
+    Optimizer *optimizer; // applies the gradients, NULL for sgd with LEARNING_RATE. Owned by the caller
+    int checkpoint_interval; // of the full model gradients, 0 without checkpointing, see allocate_checkpointed_gradients
+} TrainContext;
+
 Gradients *allocate_gradients(Model *model);
+Gradients *allocate_checkpointed_gradients(Model *model, int interval);
+size_t gradients_activations_size(Model *model, int interval);
+int checkpoint_interval_for_budget(Model *model, size_t budget);
 void free_gradients(Gradients *gradients, Model *model);
+void add_gradients(Gradients *gradients, Gradients *other, Model *model);
+void zero_gradients(Gradients *gradients, Model *model);
 
 PartialGradients *allocate_partial_gradients(Model *model, int target_layer, int n_neurons);
 void free_partial_gradients(PartialGradients *gradients, Model *model, int target_layer);
+void zero_partial_gradients(PartialGradients *gradients, Model *model, int target_layer, int n_neurons);
+
+TrainContext *create_train_context(void);
+Gradients *train_context_gradients(TrainContext *context, Model *model);
+Gradients **train_context_thread_gradients(TrainContext *context, Model *model, int n_threads);
+PartialGradients *train_context_partial_gradients(TrainContext *context, Model *model, int target_layer, int n_neurons);
+void free_train_context(TrainContext *context, Model *model);
 
 #endif
\ No newline at end of file
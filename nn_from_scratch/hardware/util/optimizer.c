@@ -0,0 +1,182 @@
+#include "optimizer.h"
+#include "kernels.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Creates an optimizer with the default hyperparameters of config.h, its state is allocated at the first step
+    @param batch_size: samples the gradients of a step are summed over, e.g. BATCH_SIZE
+    @return the optimizer, NULL on failure */
+Optimizer *create_optimizer(enum OptimizerType type, float learning_rate, int batch_size)
+{
+    if (type < OPTIMIZER_SGD || type > OPTIMIZER_ADAMW || learning_rate <= 0 || batch_size < 1)
+    {
+        printf("Invalid arguments for the optimizer! \n");
+        return NULL;
+    }
+    Optimizer *optimizer = (Optimizer *)calloc(1, sizeof(Optimizer));
+    if (optimizer == NULL)
+    {
+        printf("Error: could not allocate optimizer! \n");
+        return NULL;
+    }
+    optimizer->type = type;
+    optimizer->learning_rate = learning_rate;
+    optimizer->batch_size = batch_size;
+    optimizer->momentum = SGD_MOMENTUM;
+    optimizer->beta1 = ADAM_BETA1;
+    optimizer->beta2 = ADAM_BETA2;
+    optimizer->epsilon = ADAM_EPSILON;
+    optimizer->weight_decay = ADAMW_WEIGHT_DECAY;
+    optimizer->n_state = (type == OPTIMIZER_SGD) ? 0 : (type == OPTIMIZER_SGD_MOMENTUM) ? 1 : 2;
+    return optimizer;
+}
+
+/* Lays the state out for a model, at the offsets of its flat params or layer by layer with the weights before the biases
+    @return 0 on success, -1 if the state could not be allocated */
+static int bind_optimizer(Optimizer *optimizer, Model *model)
+{
+    optimizer->layers_offset = (size_t *)malloc(2 * model->n_layers * sizeof(size_t));
+    if (optimizer->layers_offset == NULL)
+    {
+        printf("Error: could not allocate optimizer state! \n");
+        return -1;
+    }
+    size_t size = 0;
+    int input_size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        if (model->params != NULL)
+        {
+            optimizer->layers_offset[2 * i] = model->layers_weights[i] - model->params;
+            optimizer->layers_offset[2 * i + 1] = model->layers_biases[i] - model->params;
+        }
+        else
+        {
+            optimizer->layers_offset[2 * i] = size;
+            size += (size_t)input_size * model->layers_size[i];
+            optimizer->layers_offset[2 * i + 1] = size;
+            size += model->layers_size[i];
+        }
+        input_size = model->layers_size[i];
+    }
+    optimizer->state_size = (model->params != NULL) ? (size_t)model->n_params : size;
+
+    if (optimizer->n_state > 0)
+    {
+        optimizer->state = (float *)calloc(optimizer->n_state * optimizer->state_size, sizeof(float));
+        if (optimizer->state == NULL)
+        {
+            printf("Error: could not allocate optimizer state! \n");
+            free(optimizer->layers_offset);
+            optimizer->layers_offset = NULL;
+            return -1;
+        }
+    }
+    optimizer->model = model;
+    optimizer->params = model->params;
+    return 0;
+}
+
+/* Starts a training step of a model: lays the state out at the first step and fills the scalars the update kernels
+    read. A NULL optimizer is plain sgd with LEARNING_RATE and BATCH_SIZE.
+    @return 0 on success, -1 if the state belongs to another model or layout or could not be allocated */
+int optimizer_begin_step(Optimizer *optimizer, Model *model, OptimizerStep *step)
+{
+    step->learning_rate = LEARNING_RATE;
+    step->grad_scale = 1.0f / BATCH_SIZE;
+    step->momentum = 0;
+    step->beta1 = 0;
+    step->beta2 = 0;
+    step->v_correction = 1;
+    step->epsilon = 0;
+    step->decay = 1;
+    if (optimizer == NULL)
+    {
+        return 0;
+    }
+
+    if (optimizer->model == NULL)
+    {
+        if (bind_optimizer(optimizer, model) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (optimizer->model != model || optimizer->params != model->params)
+    {
+        printf("Error: the optimizer state belongs to another model or layout! \n");
+        return -1;
+    }
+    optimizer->step++;
+    step->learning_rate = optimizer->learning_rate;
+    step->grad_scale = 1.0f / optimizer->batch_size;
+    step->momentum = optimizer->momentum;
+    if (optimizer->type == OPTIMIZER_ADAM || optimizer->type == OPTIMIZER_ADAMW)
+    {
+        step->beta1 = optimizer->beta1;
+        step->beta2 = optimizer->beta2;
+        step->epsilon = optimizer->epsilon;
+        // the bias correction of the first moment is folded into the learning rate
+        step->learning_rate = (float)(optimizer->learning_rate / (1 - pow(optimizer->beta1, optimizer->step)));
+        step->v_correction = (float)(1 / (1 - pow(optimizer->beta2, optimizer->step)));
+    }
+    if (optimizer->type == OPTIMIZER_ADAMW)
+    {
+        step->decay = 1 - optimizer->learning_rate * optimizer->weight_decay;
+    }
+    return 0;
+}
+
+/* Applies the gradients of n consecutive parameters in one pass, e.g. the flat params or a range of rows of a layer
+    @param state_offset: offset of params[0] in the state, see optimizer_weights_offset
+*/
+void optimizer_update(Optimizer *optimizer, const OptimizerStep *step, float *params, const float *gradients,
+                      size_t state_offset, int n)
+{
+    const Kernels *kernels = get_kernels();
+    if (optimizer == NULL || optimizer->n_state == 0)
+    {
+        kernels->sgd(params, gradients, step, n);
+        return;
+    }
+    float *m = optimizer->state + state_offset;
+    if (optimizer->n_state == 1)
+    {
+        kernels->momentum(params, gradients, m, step, n);
+        return;
+    }
+    kernels->adam(params, gradients, m, m + optimizer->state_size, step, n);
+}
+
+/* Samples the gradients of a step are summed over, BATCH_SIZE for a NULL optimizer */
+int optimizer_batch_size(Optimizer *optimizer)
+{
+    return (optimizer == NULL) ? BATCH_SIZE : optimizer->batch_size;
+}
+
+/* Offset of the weights of a layer in the state, 0 for a NULL optimizer which has none */
+size_t optimizer_weights_offset(Optimizer *optimizer, int layer)
+{
+    return (optimizer == NULL) ? 0 : optimizer->layers_offset[2 * layer];
+}
+
+/* Offset of the biases of a layer in the state */
+size_t optimizer_biases_offset(Optimizer *optimizer, int layer)
+{
+    return (optimizer == NULL) ? 0 : optimizer->layers_offset[2 * layer + 1];
+}
+
+void free_optimizer(Optimizer *optimizer)
+{
+    if (optimizer->state != NULL)
+    {
+        free(optimizer->state);
+    }
+    if (optimizer->layers_offset != NULL)
+    {
+        free(optimizer->layers_offset);
+    }
+    free(optimizer);
+}
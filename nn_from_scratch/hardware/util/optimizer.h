@@ -0,0 +1,48 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+#include "config.h"
+#include "model_binding.h"
+#include <stddef.h>
+
+enum OptimizerType
+{
+    OPTIMIZER_SGD,
+    OPTIMIZER_SGD_MOMENTUM,
+    OPTIMIZER_ADAM,
+    OPTIMIZER_ADAMW
+};
+
+/* Rule the gradients of a training step are applied with, see optimizer_begin_step. The hyperparameters are read
+    at every step and may be changed between steps. The state, the momentum or the two moments of adam, mirrors the
+    parameters of the model of the first step: the flat params when the model is flat, layer by layer otherwise.
+    An update then streams through the parameters, their gradients and their state together. The layout of the model
+    must not change afterwards, e.g. by flattenModel. */
+typedef struct
+{
+    enum OptimizerType type;
+    float learning_rate;
+    int batch_size;     // samples the gradients of a step are summed over
+    float momentum;     // OPTIMIZER_SGD_MOMENTUM
+    float beta1;        // decay rates of the adam moments
+    float beta2;
+    float epsilon;
+    float weight_decay; // OPTIMIZER_ADAMW, decoupled from the gradients
+    int step;           // steps taken, for the bias correction of adam
+    const Model *model;    // model the state is laid out for, NULL before the first step
+    const float *params;   // flat params of that model, NULL if it was not flat
+    int n_state;           // state buffers: 0 for sgd, 1 for momentum, 2 for adam
+    size_t state_size;     // floats per buffer
+    float *state;          // n_state buffers of state_size floats, zero at the first step
+    size_t *layers_offset; // per layer, offset of its weights and then of its biases in a buffer
+} Optimizer;
+
+Optimizer *create_optimizer(enum OptimizerType type, float learning_rate, int batch_size);
+int optimizer_begin_step(Optimizer *optimizer, Model *model, OptimizerStep *step);
+void optimizer_update(Optimizer *optimizer, const OptimizerStep *step, float *params, const float *gradients,
+                      size_t state_offset, int n);
+int optimizer_batch_size(Optimizer *optimizer);
+size_t optimizer_weights_offset(Optimizer *optimizer, int layer);
+size_t optimizer_biases_offset(Optimizer *optimizer, int layer);
+void free_optimizer(Optimizer *optimizer);
+
+#endif
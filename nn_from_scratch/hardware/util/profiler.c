@@ -0,0 +1,178 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "profiler.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define PROFILE_HAS_CYCLES
+#endif
+
+/* Counters are indexed by op and layer, layers past PROFILE_MAX_LAYERS - 1 share the last slot
+    and the slot after it holds the calls covering all layers. Updates are atomic when threads are enabled. */
+#ifdef ENABLE_THREADS
+#define ATOMIC_ADD(var, n) __atomic_add_fetch(&(var), (n), __ATOMIC_RELAXED)
+#define ATOMIC_LOAD(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define ATOMIC_EXCHANGE(var, value) __atomic_exchange_n(&(var), (value), __ATOMIC_ACQ_REL)
+#else
+#define ATOMIC_ADD(var, n) ((var) += (n))
+#define ATOMIC_LOAD(var) (var)
+static int exchange_int(int *var, int value)
+{
+    int old = *var;
+    *var = value;
+    return old;
+}
+#define ATOMIC_EXCHANGE(var, value) exchange_int(&(var), (value))
+#endif
+
+#define ALL_LAYERS PROFILE_MAX_LAYERS
+
+static ProfileCounter counters[PROFILE_N_OPS][PROFILE_MAX_LAYERS + 1];
+static int report_registered = 0;
+
+static const char *op_names[PROFILE_N_OPS] = {"forward", "backward", "light_backward", "apply", "recompute"};
+
+/* current time of the monotonic clock and the cycle counter */
+ProfileStamp profile_now()
+{
+    ProfileStamp stamp;
+#if defined(__unix__) || defined(__APPLE__)
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    stamp.ns = (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+#else
+    stamp.ns = (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+#ifdef PROFILE_HAS_CYCLES
+    stamp.cycles = __rdtsc();
+#else
+    stamp.cycles = 0;
+#endif
+    return stamp;
+}
+
+static void print_profile_at_exit()
+{
+    print_profile();
+}
+
+/* Adds the time since start to the counters of an op on a layer
+    @param flops: floating point operations done by the call
+    @param samples: samples the call accounts for
+*/
+void profile_record(enum ProfileOp op, int layer, const ProfileStamp *start, uint64_t flops, uint64_t samples)
+{
+    ProfileStamp end = profile_now();
+    if (layer < 0)
+    {
+        layer = ALL_LAYERS;
+    }
+    else if (layer >= PROFILE_MAX_LAYERS)
+    {
+        layer = PROFILE_MAX_LAYERS - 1;
+    }
+    ProfileCounter *counter = &counters[op][layer];
+    ATOMIC_ADD(counter->calls, 1);
+    ATOMIC_ADD(counter->samples, samples);
+    ATOMIC_ADD(counter->ns, end.ns - start->ns);
+    ATOMIC_ADD(counter->cycles, end.cycles - start->cycles);
+    ATOMIC_ADD(counter->flops, flops);
+
+    if (ATOMIC_LOAD(report_registered) == 0 && ATOMIC_EXCHANGE(report_registered, 1) == 0)
+    {
+        atexit(print_profile_at_exit);
+    }
+}
+
+static void print_profile_row(const char *layer, const char *op, uint64_t calls, double ns_per_sample,
+                              double cycles_per_sample, uint64_t flops, uint64_t ns, uint64_t total_ns)
+{
+    printf("%-6s %-16s %10llu %12.1f", layer, op, (unsigned long long)calls, ns_per_sample);
+#ifdef PROFILE_HAS_CYCLES
+    printf(" %14.1f", cycles_per_sample);
+#else
+    (void)cycles_per_sample;
+    printf(" %14s", "-");
+#endif
+    if (flops > 0 && ns > 0)
+    {
+        printf(" %9.3f", (double)flops / ns);
+    }
+    else
+    {
+        printf(" %9s", "-");
+    }
+    printf(" %7.1f\n", 100.0 * ns / total_ns);
+}
+
+/* Prints time per sample, achieved GFLOP/s and share of the profiled time of every op on every layer,
+    followed by the total of each layer */
+void print_profile()
+{
+    uint64_t total_ns = 0;
+    for (int op = 0; op < PROFILE_N_OPS; op++)
+    {
+        for (int layer = 0; layer <= PROFILE_MAX_LAYERS; layer++)
+        {
+            total_ns += counters[op][layer].ns;
+        }
+    }
+    if (total_ns == 0)
+    {
+        return;
+    }
+
+    printf("Profile per layer \n");
+    printf("%-6s %-16s %10s %12s %14s %9s %7s\n", "layer", "op", "calls", "ns/sample", "cycles/sample", "GFLOP/s", "time %");
+    for (int layer = 0; layer <= PROFILE_MAX_LAYERS; layer++)
+    {
+        char name[16];
+        if (layer == ALL_LAYERS)
+        {
+            snprintf(name, sizeof(name), "all");
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "%d", layer);
+        }
+
+        // the per sample costs of the ops add up to the layer's, each op is normalized by its own samples
+        uint64_t calls = 0, flops = 0, ns = 0;
+        double ns_per_sample = 0, cycles_per_sample = 0;
+        int n_ops = 0;
+        for (int op = 0; op < PROFILE_N_OPS; op++)
+        {
+            const ProfileCounter *counter = &counters[op][layer];
+            if (counter->calls == 0)
+            {
+                continue;
+            }
+            double samples = counter->samples > 0 ? (double)counter->samples : 1.0;
+            print_profile_row(name, op_names[op], counter->calls, counter->ns / samples, counter->cycles / samples,
+                              counter->flops, counter->ns, total_ns);
+            calls += counter->calls;
+            flops += counter->flops;
+            ns += counter->ns;
+            ns_per_sample += counter->ns / samples;
+            cycles_per_sample += counter->cycles / samples;
+            n_ops++;
+        }
+        if (n_ops > 1)
+        {
+            print_profile_row(name, "total", calls, ns_per_sample, cycles_per_sample, flops, ns, total_ns);
+        }
+    }
+}
+
+/* Clears the counters, e.g. to leave warm-up steps out of the report */
+void reset_profile()
+{
+    for (int op = 0; op < PROFILE_N_OPS; op++)
+    {
+        for (int layer = 0; layer <= PROFILE_MAX_LAYERS; layer++)
+        {
+            counters[op][layer] = (ProfileCounter){0, 0, 0, 0, 0};
+        }
+    }
+}
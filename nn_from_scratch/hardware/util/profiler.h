@@ -0,0 +1,45 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include "config.h"
+#include <stdint.h>
+
+/* Hot-path timing, compiled in with ENABLE_PROFILING.
+    Each kernel call of a training step or prediction is timed with the monotonic clock and the cycle counter
+    and aggregated per layer. The breakdown is printed at exit, or on demand with print_profile. */
+enum ProfileOp
+{
+    PROFILE_FORWARD,
+    PROFILE_BACKWARD,
+    PROFILE_LIGHT_BACKWARD,
+    PROFILE_APPLY,
+    PROFILE_RECOMPUTE, // forward passes repeated by checkpointed training
+    PROFILE_N_OPS
+};
+
+typedef struct
+{
+    uint64_t ns;
+    uint64_t cycles; // 0 where no cycle counter is available
+} ProfileStamp;
+
+typedef struct
+{
+    uint64_t calls;
+    uint64_t samples; // samples the calls account for, an apply covers a whole batch
+    uint64_t ns;
+    uint64_t cycles;
+    uint64_t flops; // multiply-adds count as two
+} ProfileCounter;
+
+ProfileStamp profile_now();
+void profile_record(enum ProfileOp op, int layer, const ProfileStamp *start, uint64_t flops, uint64_t samples);
+void print_profile();
+void reset_profile();
+
+#ifdef ENABLE_PROFILING
+/* Scoped timer, PROFILE_STOP records the time since the PROFILE_START of the same name.
+    A layer of -1 stands for all layers at once, e.g. a flat apply. */
+#define PROFILE_START(stamp) ProfileStamp stamp = profile_now()
+#define PROFILE_STOP(stamp, op, layer, flops, samples) profile_record(op, layer, &stamp, flops, samples)
+#endif
+#endif
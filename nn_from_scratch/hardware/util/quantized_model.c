@@ -0,0 +1,236 @@
+#include "quantized_model.h"
+#include "forward_prop.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+/*
+    Like the model binding, quantized models are excluded from memory tracking.
+
+*/
+
+/* Quantizes values with a symmetric scale, rounding to nearest and saturating to +-QUANT_MAX */
+void quantizeValues(const float *x, int n, float scale, int8_t *q)
+{
+    float inv_scale = 1.0f / scale;
+    for (int i = 0; i < n; i++)
+    {
+        float v = x[i] * inv_scale;
+        v = (v > QUANT_MAX) ? QUANT_MAX : (v < -QUANT_MAX) ? -QUANT_MAX : v;
+        q[i] = (int8_t)((v >= 0) ? v + 0.5f : v - 0.5f);
+    }
+}
+
+/* scale that maps the largest magnitude onto QUANT_MAX, 1 for all zero values */
+static float symmetricScale(float max_abs)
+{
+    return (max_abs > 0) ? max_abs / QUANT_MAX : 1.0f;
+}
+
+static int widestLayer(int n_layers, int input_size, int *layers_size)
+{
+    int width = input_size;
+    for (int i = 0; i < n_layers; i++)
+    {
+        width = (layers_size[i] > width) ? layers_size[i] : width;
+    }
+    return width;
+}
+
+/* rounds a size up so the next array in an allocation stays aligned */
+static size_t alignBytes(size_t n_bytes)
+{
+    return (n_bytes + 15) & ~(size_t)15;
+}
+
+/* bytes of the inference scratch of a model, see QuantizedModel */
+static size_t scratchBytes(int width)
+{
+    return alignBytes(width * sizeof(float)) + alignBytes(2 * width * sizeof(int8_t));
+}
+
+static void setScratch(QuantizedModel *model, char *scratch, int width)
+{
+    model->net_inputs = (float *)scratch;
+    model->activations[0] = (int8_t *)(scratch + alignBytes(width * sizeof(float)));
+    model->activations[1] = model->activations[0] + width;
+}
+
+/* Creates a quantized model from arrays in its layout, e.g. the ones generated by model_converter.py --quantize.
+    The arrays are not copied, only the inference scratch is allocated.
+    @return the model, NULL if the scratch could not be allocated */
+QuantizedModel *createAndSetQuantizedModel(int n_layers, int input_size, int output_size, int *layers_size,
+                                           int8_t **layers_weights, float **layers_weight_scales, int32_t **layers_biases,
+                                           float *layers_input_scale, enum ActivationType *layers_activation)
+{
+    int width = widestLayer(n_layers, input_size, layers_size);
+    size_t model_bytes = alignBytes(sizeof(QuantizedModel));
+    QuantizedModel *model = (QuantizedModel *)malloc(model_bytes + scratchBytes(width));
+    if (model == NULL)
+    {
+        printf("Error: could not allocate quantized model! \n");
+        return NULL;
+    }
+    model->n_layers = n_layers;
+    model->input_size = input_size;
+    model->output_size = output_size;
+    model->layers_size = layers_size;
+    model->layers_activation = layers_activation;
+    model->layers_weights = layers_weights;
+    model->layers_weight_scales = layers_weight_scales;
+    model->layers_biases = layers_biases;
+    model->layers_input_scale = layers_input_scale;
+    setScratch(model, (char *)model + model_bytes, width);
+    return model;
+}
+
+/* Largest magnitude of the input of every layer over the calibration samples, the float model is run on each sample */
+static int calibrateInputs(Model *model, const float *calibration_x, int n_samples, float *max_abs)
+{
+    int width = widestLayer(model->n_layers, model->input_size, model->layers_size);
+    float *buffers = (float *)malloc(2 * width * sizeof(float));
+    if (buffers == NULL)
+    {
+        printf("Error: could not allocate calibration buffers! \n");
+        return -1;
+    }
+    memset(max_abs, 0, model->n_layers * sizeof(float));
+    for (int s = 0; s < n_samples; s++)
+    {
+        const float *input = calibration_x + s * model->input_size;
+        int input_size = model->input_size;
+        for (int i = 0; i < model->n_layers; i++)
+        {
+            for (int j = 0; j < input_size; j++)
+            {
+                float v = (input[j] < 0) ? -input[j] : input[j];
+                max_abs[i] = (v > max_abs[i]) ? v : max_abs[i];
+            }
+            float *output = buffers + (i % 2) * width;
+            fc_forward_prop_batch(input, 1, input_size, output, model->layers_size[i], model->layers_weights[i],
+                                  model->layers_biases[i], get_activation_func(model->layers_activation[i]));
+            input = output;
+            input_size = model->layers_size[i];
+        }
+    }
+    free(buffers);
+    return 0;
+}
+
+/* Quantizes a float model to int8. Weights get one symmetric scale per output channel, and the input of
+    every layer one symmetric scale covering its range over the calibration samples.
+    @param calibration_x: input rows, row-major (n_samples x input_size), e.g. the eqcheck samples
+    @return the quantized model, owning all of its arrays, NULL on failure */
+QuantizedModel *quantizeModel(Model *model, const float *calibration_x, int n_samples)
+{
+    if (model->layers_weights_half != NULL)
+    {
+        printf("Error: a model with 16-bit weights can not be quantized! \n");
+        return NULL;
+    }
+    int n_layers = model->n_layers;
+    int width = widestLayer(n_layers, model->input_size, model->layers_size);
+
+    // one allocation: the model, its arrays and the scratch, every array starting on a 16 byte boundary
+    size_t n_bytes = alignBytes(sizeof(QuantizedModel));
+    n_bytes += alignBytes(n_layers * (sizeof(int8_t *) + sizeof(float *) + sizeof(int32_t *)));
+    n_bytes += alignBytes(n_layers * (sizeof(float) + sizeof(int) + sizeof(enum ActivationType)));
+    int input_size = model->input_size;
+    for (int i = 0; i < n_layers; i++)
+    {
+        n_bytes += alignBytes(model->layers_size[i] * (sizeof(float) + sizeof(int32_t)));
+        n_bytes += alignBytes((size_t)input_size * model->layers_size[i]);
+        input_size = model->layers_size[i];
+    }
+    n_bytes += scratchBytes(width);
+    char *memory = (char *)malloc(n_bytes);
+    if (memory == NULL)
+    {
+        printf("Error: could not allocate quantized model! \n");
+        return NULL;
+    }
+
+    QuantizedModel *quantized = (QuantizedModel *)memory;
+    char *next = memory + alignBytes(sizeof(QuantizedModel));
+    quantized->layers_weights = (int8_t **)next;
+    quantized->layers_weight_scales = (float **)(quantized->layers_weights + n_layers);
+    quantized->layers_biases = (int32_t **)(quantized->layers_weight_scales + n_layers);
+    next += alignBytes(n_layers * (sizeof(int8_t *) + sizeof(float *) + sizeof(int32_t *)));
+    quantized->layers_input_scale = (float *)next;
+    quantized->layers_size = (int *)(quantized->layers_input_scale + n_layers);
+    quantized->layers_activation = (enum ActivationType *)(quantized->layers_size + n_layers);
+    next += alignBytes(n_layers * (sizeof(float) + sizeof(int) + sizeof(enum ActivationType)));
+    quantized->n_layers = n_layers;
+    quantized->input_size = model->input_size;
+    quantized->output_size = model->output_size;
+    memcpy(quantized->layers_size, model->layers_size, n_layers * sizeof(int));
+    memcpy(quantized->layers_activation, model->layers_activation, n_layers * sizeof(enum ActivationType));
+
+    if (calibrateInputs(model, calibration_x, n_samples, quantized->layers_input_scale) != 0)
+    {
+        free(memory);
+        return NULL;
+    }
+
+    input_size = model->input_size;
+    for (int i = 0; i < n_layers; i++)
+    {
+        int output_size = model->layers_size[i];
+        float input_scale = symmetricScale(quantized->layers_input_scale[i]);
+        quantized->layers_input_scale[i] = input_scale;
+        float *scales = (float *)next;
+        int32_t *biases = (int32_t *)(scales + output_size);
+        next += alignBytes(output_size * (sizeof(float) + sizeof(int32_t)));
+        int8_t *weights = (int8_t *)next;
+        next += alignBytes((size_t)input_size * output_size);
+
+        const float *layer_weights = model->layers_weights[i];
+        for (int o = 0; o < output_size; o++)
+        {
+            // the float weights are input-major, weights[j * output_size + o]
+            float max_abs = 0;
+            for (int j = 0; j < input_size; j++)
+            {
+                float v = layer_weights[j * output_size + o];
+                v = (v < 0) ? -v : v;
+                max_abs = (v > max_abs) ? v : max_abs;
+            }
+            scales[o] = symmetricScale(max_abs);
+            float inv_scale = 1.0f / scales[o];
+            for (int j = 0; j < input_size; j++)
+            {
+                float v = layer_weights[j * output_size + o] * inv_scale;
+                weights[o * input_size + j] = (int8_t)((v >= 0) ? v + 0.5f : v - 0.5f);
+            }
+
+            double bias = (double)model->layers_biases[i][o] / ((double)input_scale * scales[o]);
+            bias = (bias > INT32_MAX) ? INT32_MAX : (bias < -INT32_MAX) ? -INT32_MAX : bias;
+            biases[o] = (int32_t)((bias >= 0) ? bias + 0.5 : bias - 0.5);
+        }
+        quantized->layers_weights[i] = weights;
+        quantized->layers_weight_scales[i] = scales;
+        quantized->layers_biases[i] = biases;
+        input_size = output_size;
+    }
+    setScratch(quantized, next, width);
+    return quantized;
+}
+
+/* Frees a quantized model, together with its arrays if it was created by quantizeModel */
+void freeQuantizedModel(QuantizedModel *model)
+{
+    free(model);
+}
+
+/* Bytes taken by the weights, biases and scales of a quantized model, without the inference scratch */
+size_t quantizedModelParamsBytes(QuantizedModel *model)
+{
+    size_t n_bytes = model->n_layers * sizeof(float);
+    int input_size = model->input_size;
+    for (int i = 0; i < model->n_layers; i++)
+    {
+        n_bytes += (size_t)input_size * model->layers_size[i] * sizeof(int8_t);
+        n_bytes += model->layers_size[i] * (sizeof(float) + sizeof(int32_t));
+        input_size = model->layers_size[i];
+    }
+    return n_bytes;
+}
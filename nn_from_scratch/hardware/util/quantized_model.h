@@ -0,0 +1,41 @@
+#ifndef QUANTIZED_MODEL_H
+#define QUANTIZED_MODEL_H
+#include "model_binding.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define QUANT_MAX 127 // symmetric int8 range, -128 is never produced
+
+/* Int8 copy of a model for inference.
+    Weights are stored output-major with one scale per output channel, layer inputs are quantized with one
+    scale per layer, and the biases are pre-scaled to the int32 accumulator of input_scale * weight_scale.
+    A real value v is represented by the integer round(v / scale). */
+typedef struct
+{
+    int n_layers;
+    int input_size;
+    int output_size;
+    int *layers_size;
+    enum ActivationType *layers_activation;
+    int8_t **layers_weights;       // shape: (n_layers)(output_size * input_size), weights[i * input_size + j]
+    float **layers_weight_scales;  // shape: (n_layers)(output_size)
+    int32_t **layers_biases;       // shape: (n_layers)(output_size)
+    float *layers_input_scale;     // shape: (n_layers)
+    /* inference scratch, so a quantized model serves one prediction at a time */
+    int8_t *activations[2]; // buffers of the widest layer the quantized activations ping-pong between
+    float *net_inputs;      // dequantized net inputs of the current layer
+} QuantizedModel; // allocated as one block with its scratch, freed by freeQuantizedModel
+
+QuantizedModel *createAndSetQuantizedModel(int n_layers, int input_size, int output_size, int *layers_size,
+                                           int8_t **layers_weights, float **layers_weight_scales, int32_t **layers_biases,
+                                           float *layers_input_scale, enum ActivationType *layers_activation);
+
+QuantizedModel *quantizeModel(Model *model, const float *calibration_x, int n_samples);
+
+void freeQuantizedModel(QuantizedModel *model);
+
+size_t quantizedModelParamsBytes(QuantizedModel *model);
+
+void quantizeValues(const float *x, int n, float scale, int8_t *q);
+
+#endif
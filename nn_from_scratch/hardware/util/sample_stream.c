@@ -0,0 +1,280 @@
+#define _POSIX_C_SOURCE 200809L // fileno, posix_fadvise
+#include "sample_stream.h"
+#include "byte_order.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+/* reads the next batch of the epoch and splits the records into x and y, n_rows is 0 at the end of the epoch */
+static void read_batch(SampleStream *stream, SampleBatch *batch)
+{
+    int record_size = stream->input_size + stream->output_size;
+    uint64_t left = stream->n_samples - stream->read_samples;
+    size_t rows = (left < (uint64_t)stream->batch_size) ? (size_t)left : (size_t)stream->batch_size;
+    if (rows > 0)
+    {
+        size_t read = fread(stream->records, record_size * sizeof(float), rows, stream->file);
+        if (read < rows)
+        {
+            printf("Error: sample file ended after %llu of %llu samples! \n",
+                   (unsigned long long)(stream->read_samples + read), (unsigned long long)stream->n_samples);
+            stream->n_samples = stream->read_samples + read;
+            rows = read;
+        }
+        swap_floats(stream->records, rows * record_size);
+    }
+
+    for (size_t i = 0; i < rows; i++)
+    {
+        const float *record = stream->records + i * record_size;
+        memcpy(batch->x + i * stream->input_size, record, stream->input_size * sizeof(float));
+        memcpy(batch->y + i * stream->output_size, record + stream->input_size, stream->output_size * sizeof(float));
+    }
+    batch->n_rows = (int)rows;
+    stream->read_samples += rows;
+}
+
+static void restart_epoch(SampleStream *stream)
+{
+    fseek(stream->file, stream->data_offset, SEEK_SET);
+    stream->read_samples = 0;
+}
+
+/* frees the records and batch buffers that were allocated */
+static void free_stream_buffers(SampleStream *stream)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (stream->batches[i].x != NULL)
+        {
+            free(stream->batches[i].x);
+        }
+        if (stream->batches[i].y != NULL)
+        {
+            free(stream->batches[i].y);
+        }
+    }
+    if (stream->records != NULL)
+    {
+        free(stream->records);
+    }
+}
+
+#ifdef ENABLE_THREADS
+/* background reader, keeps the batch that is not in use by the consumer filled */
+static void *prefetch_loop(void *arg)
+{
+    SampleStream *stream = (SampleStream *)arg;
+
+    pthread_mutex_lock(&stream->lock);
+    while (1)
+    {
+        while (!stream->stop && !stream->rewind && (stream->epoch_done || stream->batches[stream->producer].full))
+        {
+            pthread_cond_wait(&stream->cond, &stream->lock);
+        }
+        if (stream->stop)
+        {
+            break;
+        }
+        if (stream->rewind)
+        {
+            restart_epoch(stream);
+            stream->batches[0].full = 0;
+            stream->batches[1].full = 0;
+            stream->consumer = 0;
+            stream->producer = 0;
+            stream->held = -1;
+            stream->epoch_done = 0;
+            stream->rewind = 0;
+            pthread_cond_broadcast(&stream->cond);
+            continue;
+        }
+
+        // the batch being filled is neither full nor held, so it can be written without the lock
+        SampleBatch *batch = &stream->batches[stream->producer];
+        pthread_mutex_unlock(&stream->lock);
+        read_batch(stream, batch);
+        pthread_mutex_lock(&stream->lock);
+
+        batch->full = 1;
+        stream->epoch_done = (batch->n_rows == 0);
+        stream->producer ^= 1;
+        pthread_cond_broadcast(&stream->cond);
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return NULL;
+}
+#endif
+
+/* Opens a sample file for reading mini-batches of batch_size samples
+    @return the stream, NULL if the file could not be read or is not a valid sample file */
+SampleStream *open_sample_stream(const char *path, int batch_size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        printf("Error: could not open sample file %s! \n", path);
+        return NULL;
+    }
+    uint8_t header[SAMPLE_FILE_HEADER_BYTES];
+    if (fread(header, 1, SAMPLE_FILE_HEADER_BYTES, file) != SAMPLE_FILE_HEADER_BYTES ||
+        memcmp(header, SAMPLE_FILE_MAGIC, 4) != 0 || read_u32(header + 4) != SAMPLE_FILE_VERSION ||
+        read_u32(header + 8) == 0 || read_u32(header + 12) == 0 || read_u32(header + 24) < SAMPLE_FILE_HEADER_BYTES ||
+        batch_size < 1)
+    {
+        printf("Error: unsupported or corrupt sample file %s! \n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    SampleStream *stream = (SampleStream *)malloc(sizeof(SampleStream));
+    if (stream == NULL)
+    {
+        printf("Error: could not allocate sample stream! \n");
+        fclose(file);
+        return NULL;
+    }
+    stream->file = file;
+    stream->input_size = (int)read_u32(header + 8);
+    stream->output_size = (int)read_u32(header + 12);
+    stream->n_samples = (uint64_t)read_u32(header + 16) | (uint64_t)read_u32(header + 20) << 32;
+    stream->data_offset = (long)read_u32(header + 24);
+    stream->batch_size = batch_size;
+    stream->records = (float *)malloc(batch_size * (stream->input_size + stream->output_size) * sizeof(float));
+    int allocated = stream->records != NULL;
+    for (int i = 0; i < 2; i++)
+    {
+        stream->batches[i].x = (float *)malloc(batch_size * stream->input_size * sizeof(float));
+        stream->batches[i].y = (float *)malloc(batch_size * stream->output_size * sizeof(float));
+        stream->batches[i].n_rows = 0;
+        stream->batches[i].full = 0;
+        allocated &= stream->batches[i].x != NULL && stream->batches[i].y != NULL;
+    }
+    if (!allocated)
+    {
+        printf("Error: could not allocate sample batches! \n");
+        free_stream_buffers(stream);
+        free(stream);
+        fclose(file);
+        return NULL;
+    }
+    stream->consumer = 0;
+    stream->held = -1;
+    stream->producer = 0;
+    restart_epoch(stream);
+#ifdef __linux__
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+#ifdef ENABLE_THREADS
+    stream->epoch_done = 0;
+    stream->rewind = 0;
+    stream->stop = 0;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+    pthread_create(&stream->thread, NULL, prefetch_loop, stream);
+#endif
+    return stream;
+}
+
+/* Hands out the next mini-batch of the epoch, valid until the next call.
+    The last batch of an epoch may hold fewer than batch_size samples.
+    @return number of samples in the batch, 0 at the end of the epoch */
+int sample_stream_next(SampleStream *stream, float **x, float **y)
+{
+#ifdef ENABLE_THREADS
+    pthread_mutex_lock(&stream->lock);
+    if (stream->held >= 0)
+    {
+        stream->batches[stream->held].full = 0;
+        stream->held = -1;
+        pthread_cond_broadcast(&stream->cond);
+    }
+    while (!stream->batches[stream->consumer].full)
+    {
+        pthread_cond_wait(&stream->cond, &stream->lock);
+    }
+    SampleBatch *batch = &stream->batches[stream->consumer];
+    // the end of epoch marker stays queued, so later calls keep returning 0 until the stream is rewound
+    if (batch->n_rows > 0)
+    {
+        stream->held = stream->consumer;
+        stream->consumer ^= 1;
+    }
+    pthread_mutex_unlock(&stream->lock);
+#else
+    SampleBatch *batch = &stream->batches[0];
+    read_batch(stream, batch);
+#endif
+    *x = batch->x;
+    *y = batch->y;
+    return batch->n_rows;
+}
+
+/* Starts the next epoch from the first sample, batches handed out before are no longer valid */
+void sample_stream_rewind(SampleStream *stream)
+{
+#ifdef ENABLE_THREADS
+    pthread_mutex_lock(&stream->lock);
+    stream->rewind = 1;
+    pthread_cond_broadcast(&stream->cond);
+    while (stream->rewind)
+    {
+        pthread_cond_wait(&stream->cond, &stream->lock);
+    }
+    pthread_mutex_unlock(&stream->lock);
+#else
+    restart_epoch(stream);
+#endif
+}
+
+void close_sample_stream(SampleStream *stream)
+{
+#ifdef ENABLE_THREADS
+    pthread_mutex_lock(&stream->lock);
+    stream->stop = 1;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->thread, NULL);
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->cond);
+#endif
+    fclose(stream->file);
+    free_stream_buffers(stream);
+    free(stream);
+}
+
+/* Writes samples, x row-major (n_samples x input_size) and y row-major (n_samples x output_size), to a sample file
+    @return 0 on success, -1 on failure */
+int write_sample_file(const char *path, const float *x, const float *y, int n_samples, int input_size, int output_size)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("Error: could not create sample file %s! \n", path);
+        return -1;
+    }
+    uint8_t header[SAMPLE_FILE_HEADER_BYTES] = {0};
+    memcpy(header, SAMPLE_FILE_MAGIC, 4);
+    put_u32(header + 4, SAMPLE_FILE_VERSION);
+    put_u32(header + 8, (uint32_t)input_size);
+    put_u32(header + 12, (uint32_t)output_size);
+    put_u32(header + 16, (uint32_t)n_samples);
+    put_u32(header + 24, SAMPLE_FILE_HEADER_BYTES);
+    int failed = fwrite(header, 1, SAMPLE_FILE_HEADER_BYTES, file) != SAMPLE_FILE_HEADER_BYTES;
+
+    for (int i = 0; i < n_samples && !failed; i++)
+    {
+        failed = write_floats(x + i * input_size, input_size, file) || write_floats(y + i * output_size, output_size, file);
+    }
+
+    if (fclose(file) != 0 || failed)
+    {
+        printf("Error: could not write sample file %s! \n", path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef SAMPLE_STREAM_H
+#define SAMPLE_STREAM_H
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#ifdef ENABLE_THREADS
+#include <pthread.h>
+#endif
+
+/* Binary sample file, version 1. All fields are little-endian.
+    offset 0:  char[4]  magic "NNFD"
+    offset 4:  uint32   version
+    offset 8:  uint32   input_size
+    offset 12: uint32   output_size
+    offset 16: uint64   n_samples
+    offset 24: uint32   data_offset
+    offset 28: uint32   reserved, 0
+    data_offset: n_samples records of float32[input_size] x followed by float32[output_size] y
+*/
+#define SAMPLE_FILE_MAGIC "NNFD"
+#define SAMPLE_FILE_VERSION 1
+#define SAMPLE_FILE_HEADER_BYTES 32
+
+typedef struct
+{
+    float *x;   // batch_size x input_size
+    float *y;   // batch_size x output_size
+    int n_rows; // 0 marks the end of the epoch
+    int full;   // filled and not yet released by the consumer
+} SampleBatch;
+
+/* Reads mini-batches from a sample file. With ENABLE_THREADS a background thread reads the next
+    batch while the current one is used, otherwise batches are read when they are requested. */
+typedef struct
+{
+    FILE *file;
+    int input_size;
+    int output_size;
+    int batch_size;
+    uint64_t n_samples;
+    long data_offset;
+    uint64_t read_samples; // samples read in the current epoch
+    float *records;        // raw records of one batch
+    SampleBatch batches[2];
+    int consumer;          // batch handed out next
+    int held;              // batch in use by the consumer, -1 if none
+    int producer;          // batch filled next
+#ifdef ENABLE_THREADS
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int epoch_done; // the end of epoch marker has been queued
+    int rewind;     // rewind requested by the consumer
+    int stop;
+#endif
+} SampleStream;
+
+SampleStream *open_sample_stream(const char *path, int batch_size);
+int sample_stream_next(SampleStream *stream, float **x, float **y);
+void sample_stream_rewind(SampleStream *stream);
+void close_sample_stream(SampleStream *stream);
+int write_sample_file(const char *path, const float *x, const float *y, int n_samples, int input_size, int output_size);
+
+#endif
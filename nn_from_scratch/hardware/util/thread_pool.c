@@ -0,0 +1,119 @@
+#include "thread_pool.h"
+#ifdef ENABLE_THREADS
+#include <stdlib.h>
+#include <stdio.h>
+#include "kernels.h"
+
+typedef struct
+{
+    ThreadPool *pool;
+    int thread_id;
+} WorkerArgs;
+
+static void *worker_loop(void *arg)
+{
+    WorkerArgs *worker = (WorkerArgs *)arg;
+    ThreadPool *pool = worker->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1)
+    {
+        while (pool->generation == seen && !pool->shutdown)
+        {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown)
+        {
+            break;
+        }
+        seen = pool->generation;
+        ThreadTask task = pool->task;
+        void *args = pool->args;
+        pthread_mutex_unlock(&pool->lock);
+
+        task(args, worker->thread_id, pool->n_threads);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0)
+        {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    free(worker);
+    return NULL;
+}
+
+/* Creates a pool running tasks on n_threads threads, including the caller */
+ThreadPool *create_thread_pool(int n_threads)
+{
+    if (n_threads < 1)
+    {
+        printf("Invalid number of threads for thread pool! \n");
+        return NULL;
+    }
+    // resolve the kernel dispatch before any worker can race on it
+    get_kernels();
+
+    ThreadPool *pool = (ThreadPool *)malloc(sizeof(ThreadPool));
+    pool->n_threads = n_threads;
+    pool->threads = (pthread_t *)malloc(n_threads * sizeof(pthread_t));
+    pool->task = NULL;
+    pool->args = NULL;
+    pool->generation = 0;
+    pool->running = 0;
+    pool->shutdown = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 1; i < n_threads; i++)
+    {
+        WorkerArgs *worker = (WorkerArgs *)malloc(sizeof(WorkerArgs));
+        worker->pool = pool;
+        worker->thread_id = i;
+        pthread_create(&pool->threads[i], NULL, worker_loop, worker);
+    }
+    return pool;
+}
+
+/* Runs task on every thread of the pool and returns once all of them finished */
+void thread_pool_run(ThreadPool *pool, ThreadTask task, void *args)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->args = args;
+    pool->running = pool->n_threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    task(args, 0, pool->n_threads);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void free_thread_pool(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->n_threads; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool);
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include "config.h"
+#ifdef ENABLE_THREADS
+#include <pthread.h>
+
+/* Fixed pool of worker threads, enabled with ENABLE_THREADS in settings/user_settings.h (pthreads, link with -pthread).
+    thread_pool_run hands the same task to every thread, the calling thread takes part as thread 0. */
+typedef void (*ThreadTask)(void *args, int thread_id, int n_threads);
+
+typedef struct
+{
+    int n_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    ThreadTask task;
+    void *args;
+    unsigned long generation; // incremented for every run, wakes the workers
+    int running;              // workers still busy with the current run
+    int shutdown;
+} ThreadPool;
+
+ThreadPool *create_thread_pool(int n_threads);
+void thread_pool_run(ThreadPool *pool, ThreadTask task, void *args);
+void free_thread_pool(ThreadPool *pool);
+
+#endif
+#endif
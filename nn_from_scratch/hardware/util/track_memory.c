@@ -1,11 +1,48 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "track_memory.h"
 // undef to avoid recursive loop-call, when macro is defined from header
 #undef malloc
 #undef free
 #undef calloc
 
+/* Every tracked block carries a MemoryBlock header, so allocations and frees are O(1).
+    The counters and the site table are updated with atomics when threads are enabled,
+    only recording a new peak takes a lock. */
+#ifdef ENABLE_THREADS
+#include <pthread.h>
+static pthread_mutex_t peak_lock = PTHREAD_MUTEX_INITIALIZER;
+#define PEAK_LOCK() pthread_mutex_lock(&peak_lock)
+#define PEAK_UNLOCK() pthread_mutex_unlock(&peak_lock)
+#define ATOMIC_ADD(var, n) __atomic_add_fetch(&(var), (n), __ATOMIC_RELAXED)
+#define ATOMIC_SUB(var, n) __atomic_sub_fetch(&(var), (n), __ATOMIC_RELAXED)
+#define ATOMIC_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+#define ATOMIC_CLAIM(var) __atomic_compare_exchange_n(&(var), &(int){0}, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define ATOMIC_EXCHANGE(var, value) __atomic_exchange_n(&(var), (value), __ATOMIC_RELAXED)
+#else
+#define PEAK_LOCK()
+#define PEAK_UNLOCK()
+#define ATOMIC_ADD(var, n) ((var) += (n))
+#define ATOMIC_SUB(var, n) ((var) -= (n))
+#define ATOMIC_LOAD(var) (var)
+#define ATOMIC_STORE(var, value) ((var) = (value))
+#define ATOMIC_CLAIM(var) ((var) == 0 ? ((var) = 1) : 0)
+static size_t exchange_size(size_t *var, size_t value)
+{
+    size_t old = *var;
+    *var = value;
+    return old;
+}
+#define ATOMIC_EXCHANGE(var, value) exchange_size(&(var), (value))
+#endif
+
+#define BLOCK_MAGIC 0x7472636bu
+#define OVERFLOW_SITE TRACK_MAX_SITES // counts the sites that did not fit in the table
+
 // Define global variables to track memory allocation
 size_t total_allocated = 0;
 size_t total_freed = 0;
@@ -13,139 +50,165 @@ size_t peak_allocated = 0;
 
 int num_blocks = 0;
 int occupied_blocks = 0;
-MemoryBlock *headBlock = NULL;
-MemoryBlock *currBlock = NULL;
-void *tracked_malloc(size_t size)
+static MemorySite sites[TRACK_MAX_SITES + 1] = {[OVERFLOW_SITE] = {"other", "other", 0, 2, 0, 0, 0, 0, 0}};
+
+// timeline of the phase markers, only recorded between memory_timeline_start and memory_timeline_stop
+typedef struct
 {
-    void *ptr = malloc(size);
-    if (ptr != NULL)
+    const char *name;
+    size_t live_at_begin;
+    size_t peak;
+    double start;
+} OpenPhase;
+
+static int timeline_active = 0;
+static double timeline_start;
+static size_t timeline_high_water = 0; // since the last timeline entry
+static MemoryTimelineEntry *timeline = NULL;
+static int timeline_capacity = 0;
+static int timeline_entries = 0;
+static size_t timeline_dropped = 0;
+static OpenPhase phase_stack[TRACK_MAX_PHASE_DEPTH];
+static int phase_depth = 0; // may exceed TRACK_MAX_PHASE_DEPTH, deeper phases only show up in the timeline
+static MemoryPhase phases[TRACK_MAX_PHASES];
+static int n_phases = 0;
+#ifdef ENABLE_THREADS
+static pthread_t timeline_owner;
+#endif
+
+/* raises max to value if it is larger */
+static void atomic_max(size_t *max, size_t value)
+{
+#ifdef ENABLE_THREADS
+    size_t seen = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > seen && !__atomic_compare_exchange_n(max, &seen, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
     {
-        MemoryBlock *block = (MemoryBlock *)malloc(sizeof(MemoryBlock));
-        block->ptr = ptr;
-        block->size = size;
-        block->next = NULL;
+    }
+#else
+    if (value > *max)
+    {
+        *max = value;
+    }
+#endif
+}
 
-        if (headBlock == NULL)
+/* finds the site of file and line in the open addressing table, claiming a free slot for new sites */
+static uint32_t find_site(const char *file, int line, const char *func)
+{
+    uint32_t hash = (uint32_t)(((uintptr_t)file >> 3) * 2654435761u) ^ (uint32_t)line * 40503u;
+    for (uint32_t probe = 0; probe < TRACK_MAX_SITES; probe++)
+    {
+        uint32_t index = (hash + probe) & (TRACK_MAX_SITES - 1);
+        MemorySite *site = &sites[index];
+        int state = ATOMIC_LOAD(site->state);
+        if (state == 0 && ATOMIC_CLAIM(site->state))
         {
-            headBlock = block;
-            currBlock = headBlock;
+            site->file = file;
+            site->line = line;
+            site->func = func;
+            ATOMIC_STORE(site->state, 2);
+            return index;
         }
-        else
+        // another thread is filling in this slot
+        while ((state = ATOMIC_LOAD(site->state)) == 1)
         {
-            currBlock->next = block;
-            currBlock = block;
         }
-        occupied_blocks++;
-        num_blocks++;
-        total_allocated += size;
-
-        if (total_allocated - total_freed > peak_allocated)
+        if (site->file == file && site->line == line)
         {
-            peak_allocated = total_allocated - total_freed;
+            return index;
         }
     }
-    return ptr;
+    return OVERFLOW_SITE;
 }
 
-void *tracked_calloc(size_t num, size_t size)
+/* the live bytes of every site while the new peak is held */
+static void record_peak(size_t in_use)
 {
-    void *ptr = calloc(num, size);
-    if (ptr != NULL)
+    PEAK_LOCK();
+    if (in_use >= peak_allocated)
     {
-        MemoryBlock *block = (MemoryBlock *)malloc(sizeof(MemoryBlock));
-        block->ptr = ptr;
-        block->size = size * num;
-        block->next = NULL;
-
-        if (headBlock == NULL)
-        {
-            headBlock = block;
-            currBlock = headBlock;
-        }
-        else
-        {
-            currBlock->next = block;
-            currBlock = block;
-        }
-
-        occupied_blocks++;
-        num_blocks++;
-        total_allocated += size * num;
-
-        if (total_allocated - total_freed > peak_allocated)
+        for (int i = 0; i <= TRACK_MAX_SITES; i++)
         {
-            peak_allocated = total_allocated - total_freed;
+            sites[i].at_peak = ATOMIC_LOAD(sites[i].current);
         }
     }
-    return ptr;
+    PEAK_UNLOCK();
 }
-void tracked_free(void *ptr)
-{
-    MemoryBlock *block = headBlock;
-    MemoryBlock *prevBlock = NULL;
 
+static void *track_block(MemoryBlock *block, size_t size, const char *file, int line, const char *func)
+{
     if (block == NULL)
     {
-        printf("Error: Attempted to free unallocated memory at address %p\n", ptr);
-        return;
+        return NULL;
     }
+    uint32_t index = find_site(file, line, func);
+    MemorySite *site = &sites[index];
+    block->info.size = size;
+    block->info.site = index;
+    block->info.magic = BLOCK_MAGIC;
+
+    atomic_max(&site->peak, ATOMIC_ADD(site->current, size));
+    ATOMIC_ADD(site->total, size);
+    ATOMIC_ADD(site->allocations, 1);
+    ATOMIC_ADD(occupied_blocks, 1);
+    ATOMIC_ADD(num_blocks, 1);
 
-    // If the block to be freed is the first block
-    if (block->ptr == ptr)
+    size_t in_use = ATOMIC_ADD(total_allocated, size) - ATOMIC_LOAD(total_freed);
+    if (ATOMIC_LOAD(timeline_active))
     {
-        headBlock = block->next;
-        total_freed += block->size;
-        occupied_blocks--;
-        if (total_allocated - total_freed > peak_allocated)
-        {
-            peak_allocated = total_allocated - total_freed;
-        }
-        free(ptr);
-        free(block);
-        return;
+        atomic_max(&timeline_high_water, in_use);
     }
-
-    // Traverse the linked list to find the block to free
-    while (block != NULL)
+    if (in_use > ATOMIC_LOAD(peak_allocated))
     {
-        if (block->ptr == ptr)
-        {
-            // Update bookkeeping information
-            total_freed += block->size;
-            occupied_blocks--;
-
-            if (total_allocated - total_freed > peak_allocated)
-            {
-                peak_allocated = total_allocated - total_freed;
-            }
+        atomic_max(&peak_allocated, in_use);
+        record_peak(in_use);
+    }
+    return block + 1;
+}
 
-            // Update the previous block's next pointer
-            prevBlock->next = block->next;
+void *tracked_malloc(size_t size, const char *file, int line, const char *func)
+{
+    if (size > SIZE_MAX - sizeof(MemoryBlock))
+    {
+        return NULL;
+    }
+    return track_block((MemoryBlock *)malloc(sizeof(MemoryBlock) + size), size, file, line, func);
+}
 
-            // If the current block is the current allocation block,
-            // update the currBlock pointer
-            if (block == currBlock)
-            {
-                currBlock = prevBlock;
-            }
+void *tracked_calloc(size_t num, size_t size, const char *file, int line, const char *func)
+{
+    if (size != 0 && num > (SIZE_MAX - sizeof(MemoryBlock)) / size)
+    {
+        return NULL;
+    }
+    return track_block((MemoryBlock *)calloc(1, sizeof(MemoryBlock) + num * size), num * size, file, line, func);
+}
 
-            // Free the memory block and the allocated memory
-            free(ptr);
-            free(block);
-            return;
-        }
-        prevBlock = block;
-        block = block->next;
+void tracked_free(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        printf("Error: Attempted to free unallocated memory at address %p\n", ptr);
+        return;
     }
+    MemoryBlock *block = (MemoryBlock *)ptr - 1;
+    if (block->info.magic != BLOCK_MAGIC)
+    {
+        printf("Error: Attempted to free untracked memory at address %p\n", ptr);
+        return;
+    }
+    block->info.magic = 0; // a second free of the same block is reported instead of corrupting the heap
 
-    // If the pointer does not match any tracked memory block
-    printf("Error: Attempted to free untracked memory at address %p\n", ptr);
+    ATOMIC_SUB(sites[block->info.site].current, block->info.size);
+    ATOMIC_ADD(total_freed, block->info.size);
+    ATOMIC_SUB(occupied_blocks, 1);
+    free(block);
 }
 
 /* Will reset memory tracking numbers, if everything is freed*/
 void reset_memory_tracking()
 {
-    if (headBlock != NULL)
+    if (occupied_blocks != 0)
     {
         printf("Error: Could not reset memory tracking, blocks still being used! \n");
         return;
@@ -155,6 +218,13 @@ void reset_memory_tracking()
     num_blocks = 0;
     occupied_blocks = 0;
     peak_allocated = 0;
+    for (int i = 0; i <= TRACK_MAX_SITES; i++)
+    {
+        sites[i].peak = 0;
+        sites[i].total = 0;
+        sites[i].at_peak = 0;
+        sites[i].allocations = 0;
+    }
 }
 void print_memory()
 {
@@ -165,3 +235,300 @@ void print_memory()
     printf("Peak blocks used: %d\n", num_blocks);
     printf("Total blocks still being used: %d\n", occupied_blocks);
 }
+
+/* Prints the allocation sites since the last reset, largest share of the peak first */
+void print_memory_sites()
+{
+    int order[TRACK_MAX_SITES + 1];
+    int n = 0;
+    for (int i = 0; i <= TRACK_MAX_SITES; i++)
+    {
+        if (sites[i].allocations > 0)
+        {
+            // insertion sort on the bytes held at the peak
+            int j = n++;
+            while (j > 0 && sites[order[j - 1]].at_peak < sites[i].at_peak)
+            {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+        }
+    }
+
+    printf("%10s %10s %10s %8s  %s\n", "at peak", "site peak", "total", "allocs", "site");
+    for (int k = 0; k < n; k++)
+    {
+        MemorySite *site = &sites[order[k]];
+        printf("%10zu %10zu %10zu %8zu  %s (%s:%d)\n", site->at_peak, site->peak, site->total, site->allocations,
+               site->func, site->file, site->line);
+    }
+}
+
+static double timeline_now()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Starts recording phase markers, keeping up to capacity timeline entries (TRACK_TIMELINE_CAPACITY if 0).
+    Restarts the timeline and the phase summaries if one was recorded before. */
+void memory_timeline_start(int capacity)
+{
+    if (capacity <= 0)
+    {
+        capacity = TRACK_TIMELINE_CAPACITY;
+    }
+    if (capacity != timeline_capacity)
+    {
+        free(timeline);
+        timeline = (MemoryTimelineEntry *)malloc(capacity * sizeof(MemoryTimelineEntry));
+        timeline_capacity = (timeline != NULL) ? capacity : 0;
+    }
+    timeline_entries = 0;
+    timeline_dropped = 0;
+    phase_depth = 0;
+    n_phases = 0;
+    timeline_start = timeline_now();
+    ATOMIC_STORE(timeline_high_water, ATOMIC_LOAD(total_allocated) - ATOMIC_LOAD(total_freed));
+#ifdef ENABLE_THREADS
+    timeline_owner = pthread_self();
+#endif
+    ATOMIC_STORE(timeline_active, 1);
+}
+
+/* Stops recording, the timeline stays available for printing and exporting */
+void memory_timeline_stop()
+{
+    ATOMIC_STORE(timeline_active, 0);
+}
+
+/* markers from other threads than the one running the timeline are ignored */
+static int timeline_recording()
+{
+#ifdef ENABLE_THREADS
+    return ATOMIC_LOAD(timeline_active) && pthread_equal(pthread_self(), timeline_owner);
+#else
+    return timeline_active;
+#endif
+}
+
+static OpenPhase *innermost_phase()
+{
+    if (phase_depth == 0)
+    {
+        return NULL;
+    }
+    return &phase_stack[(phase_depth < TRACK_MAX_PHASE_DEPTH ? phase_depth : TRACK_MAX_PHASE_DEPTH) - 1];
+}
+
+/* closes the stretch since the last entry and records the marker, returns the high water mark of the stretch */
+static size_t timeline_event(enum MemoryEvent event, const char *marker, double now)
+{
+    size_t live = ATOMIC_LOAD(total_allocated) - ATOMIC_LOAD(total_freed);
+    size_t high_water = ATOMIC_EXCHANGE(timeline_high_water, live);
+    if (high_water < live)
+    {
+        high_water = live;
+    }
+
+    OpenPhase *phase = innermost_phase();
+    if (phase != NULL && high_water > phase->peak)
+    {
+        phase->peak = high_water;
+    }
+    if (timeline_entries < timeline_capacity)
+    {
+        MemoryTimelineEntry *entry = &timeline[timeline_entries++];
+        entry->time = now - timeline_start;
+        entry->event = event;
+        entry->marker = marker;
+        entry->phase = (phase != NULL) ? phase->name : "";
+        entry->depth = phase_depth;
+        entry->live = live;
+        entry->high_water = high_water;
+    }
+    else
+    {
+        timeline_dropped++;
+    }
+    return live;
+}
+
+/* adds a finished run to the summary of its phase */
+static void summarize_phase(OpenPhase *run, double now)
+{
+    MemoryPhase *phase = NULL;
+    for (int i = 0; i < n_phases; i++)
+    {
+        if (strcmp(phases[i].name, run->name) == 0)
+        {
+            phase = &phases[i];
+            break;
+        }
+    }
+    if (phase == NULL)
+    {
+        if (n_phases == TRACK_MAX_PHASES)
+        {
+            return;
+        }
+        phase = &phases[n_phases++];
+        phase->name = run->name;
+        phase->runs = 0;
+        phase->peak = 0;
+        phase->growth = 0;
+        phase->seconds = 0;
+    }
+    phase->runs++;
+    phase->seconds += now - run->start;
+    if (run->peak > phase->peak)
+    {
+        phase->peak = run->peak;
+    }
+    if (run->peak - run->live_at_begin > phase->growth)
+    {
+        phase->growth = run->peak - run->live_at_begin;
+    }
+}
+
+void memory_phase_begin(const char *name)
+{
+    if (!timeline_recording())
+    {
+        return;
+    }
+    double now = timeline_now();
+    size_t live = timeline_event(MEMORY_PHASE_BEGIN_EVENT, name, now);
+    if (phase_depth < TRACK_MAX_PHASE_DEPTH)
+    {
+        OpenPhase *run = &phase_stack[phase_depth];
+        run->name = name;
+        run->live_at_begin = live;
+        run->peak = live;
+        run->start = now;
+    }
+    phase_depth++;
+}
+
+void memory_phase_end()
+{
+    if (!timeline_recording() || phase_depth == 0)
+    {
+        return;
+    }
+    double now = timeline_now();
+    OpenPhase *run = innermost_phase();
+    timeline_event(MEMORY_PHASE_END_EVENT, (phase_depth <= TRACK_MAX_PHASE_DEPTH) ? run->name : "nested", now);
+    phase_depth--;
+    if (phase_depth < TRACK_MAX_PHASE_DEPTH)
+    {
+        summarize_phase(run, now);
+        // the peak of a nested phase is also reached inside its parent
+        OpenPhase *parent = innermost_phase();
+        if (parent != NULL && run->peak > parent->peak)
+        {
+            parent->peak = run->peak;
+        }
+    }
+}
+
+/* Prints the summary of every phase recorded by the last timeline */
+void print_memory_phases()
+{
+    printf("%-24s %8s %10s %10s %12s\n", "phase", "runs", "peak", "growth", "seconds");
+    for (int i = 0; i < n_phases; i++)
+    {
+        printf("%-24s %8zu %10zu %10zu %12.6f\n", phases[i].name, phases[i].runs, phases[i].peak, phases[i].growth,
+               phases[i].seconds);
+    }
+    if (timeline_dropped > 0)
+    {
+        printf("Timeline full, %zu entries dropped\n", timeline_dropped);
+    }
+}
+
+/* Summaries of the phases recorded by the last timeline, as printed by print_memory_phases
+    @param n: set to the number of phases */
+const MemoryPhase *memory_phases(int *n)
+{
+    *n = n_phases;
+    return phases;
+}
+
+static const char *event_name(enum MemoryEvent event)
+{
+    return (event == MEMORY_PHASE_BEGIN_EVENT) ? "begin" : "end";
+}
+
+/* Writes the timeline as CSV, one row per entry
+    @return 0 on success, -1 on failure */
+int export_memory_timeline_csv(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Error: could not create %s! \n", path);
+        return -1;
+    }
+    fprintf(file, "time,event,marker,phase,depth,live,high_water\n");
+    for (int i = 0; i < timeline_entries; i++)
+    {
+        MemoryTimelineEntry *entry = &timeline[i];
+        fprintf(file, "%.9f,%s,%s,%s,%d,%zu,%zu\n", entry->time, event_name(entry->event), entry->marker, entry->phase,
+                entry->depth, entry->live, entry->high_water);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+static void write_json_string(FILE *file, const char *text)
+{
+    fputc('"', file);
+    for (; *text != '\0'; text++)
+    {
+        if (*text == '"' || *text == '\\')
+        {
+            fputc('\\', file);
+        }
+        fputc(*text, file);
+    }
+    fputc('"', file);
+}
+
+/* Writes the timeline and the phase summaries as JSON
+    @return 0 on success, -1 on failure */
+int export_memory_timeline_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Error: could not create %s! \n", path);
+        return -1;
+    }
+    fprintf(file, "{\n  \"dropped\": %zu,\n  \"timeline\": [", timeline_dropped);
+    for (int i = 0; i < timeline_entries; i++)
+    {
+        MemoryTimelineEntry *entry = &timeline[i];
+        fprintf(file, "%s\n    {\"time\": %.9f, \"event\": \"%s\", \"marker\": ", i > 0 ? "," : "", entry->time,
+                event_name(entry->event));
+        write_json_string(file, entry->marker);
+        fprintf(file, ", \"phase\": ");
+        write_json_string(file, entry->phase);
+        fprintf(file, ", \"depth\": %d, \"live\": %zu, \"high_water\": %zu}", entry->depth, entry->live, entry->high_water);
+    }
+    fprintf(file, "\n  ],\n  \"phases\": [");
+    for (int i = 0; i < n_phases; i++)
+    {
+        fprintf(file, "%s\n    {\"name\": ", i > 0 ? "," : "");
+        write_json_string(file, phases[i].name);
+        fprintf(file, ", \"runs\": %zu, \"peak\": %zu, \"growth\": %zu, \"seconds\": %.9f}", phases[i].runs,
+                phases[i].peak, phases[i].growth, phases[i].seconds);
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return fclose(file) == 0 ? 0 : -1;
+}
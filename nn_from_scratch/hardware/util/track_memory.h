@@ -3,20 +3,89 @@
 #include "config.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h> // declared before malloc, calloc and free are redefined below
 void tracked_free(void *ptr);
-void *tracked_calloc(size_t num, size_t size);
-void *tracked_malloc(size_t size);
+void *tracked_calloc(size_t num, size_t size, const char *file, int line, const char *func);
+void *tracked_malloc(size_t size, const char *file, int line, const char *func);
 void print_memory();
+void print_memory_sites();
 void reset_memory_tracking();
+
+void memory_timeline_start(int capacity);
+void memory_timeline_stop();
+void memory_phase_begin(const char *name);
+void memory_phase_end();
+void print_memory_phases();
+int export_memory_timeline_csv(const char *path);
+int export_memory_timeline_json(const char *path);
+
 #ifdef ENABLE_TRACK_MEMORY
-#define malloc(size) tracked_malloc(size)
-#define calloc(num, size) tracked_calloc(num, size)
-#define free(ptr) tracked_free(ptr)
+#define malloc(size) tracked_malloc(size, __FILE__, __LINE__, __func__)
+#define calloc(num, size) tracked_calloc(num, size, __FILE__, __LINE__, __func__)
+#define free(ptr) tracked_free(ptr) // reports a free of NULL, so tracked code checks a pointer before freeing it
+/* Scoped phase markers, every MEMORY_PHASE_BEGIN needs a matching MEMORY_PHASE_END.
+    Recorded while a timeline is running, by the thread that started it. */
+#define MEMORY_PHASE_BEGIN(name) memory_phase_begin(name)
+#define MEMORY_PHASE_END() memory_phase_end()
 #endif
-typedef struct MemoryBlock
+
+/* Header stored in front of every tracked allocation, so a free finds its size and site without a search.
+    The union keeps the user memory aligned like malloc's. */
+typedef union
 {
-    void *ptr;
-    size_t size;
-    struct MemoryBlock *next;
+    struct
+    {
+        size_t size;
+        uint32_t site;  // index in the site table
+        uint32_t magic; // identifies live tracked blocks
+    } info;
+    long double align_ld;
+    void *align_ptr;
+    long long align_ll;
 } MemoryBlock;
+
+/* Allocation statistics per call site */
+typedef struct
+{
+    const char *file;
+    const char *func;
+    int line;
+    int state;           // 0 free slot, 1 being claimed, 2 in use
+    size_t current;      // bytes live now
+    size_t peak;         // most bytes live at once from this site
+    size_t total;        // bytes allocated in total
+    size_t at_peak;      // bytes live from this site when the global peak was reached
+    size_t allocations;
+} MemorySite;
+
+enum MemoryEvent
+{
+    MEMORY_PHASE_BEGIN_EVENT,
+    MEMORY_PHASE_END_EVENT
+};
+
+/* One timeline entry per phase marker. high_water covers the stretch since the previous entry,
+    which ran inside phase (the innermost open phase, "" outside of phases). */
+typedef struct
+{
+    double time; // seconds since memory_timeline_start
+    enum MemoryEvent event;
+    const char *marker; // phase begun or ended
+    const char *phase;
+    int depth;          // open phases before the event
+    size_t live;        // bytes live at the event
+    size_t high_water;
+} MemoryTimelineEntry;
+
+/* Summary of all runs of a phase, peaks include nested phases */
+typedef struct
+{
+    const char *name;
+    size_t runs;
+    size_t peak;   // highest live bytes during any run
+    size_t growth; // highest peak above the bytes live when a run began
+    double seconds;
+} MemoryPhase;
+
+const MemoryPhase *memory_phases(int *n);
 #endif
@@ -0,0 +1,65 @@
+#include "train_config.h"
+#include <math.h>
+
+#define TRAIN_CONFIG_PI 3.14159265358979323846
+
+/* Settings of one epoch of BATCH_SIZE steps with LEARNING_RATE, in the order of the samples */
+TrainConfig default_train_config(void)
+{
+    TrainConfig config;
+    config.batch_size = BATCH_SIZE;
+    config.n_epochs = 1;
+    config.max_steps = 0;
+    config.learning_rate = LEARNING_RATE;
+    config.schedule = LR_CONSTANT;
+    config.warmup_steps = 0;
+    config.decay_rate = 1;
+    config.decay_steps = 1;
+    config.min_learning_rate = 0;
+    config.shuffle_seed = 0;
+    config.patience = 0;
+    config.min_delta = 0;
+    config.validation_x = NULL;
+    config.validation_y = NULL;
+    config.n_validation = 0;
+    return config;
+}
+
+/* Learning rate of a step, counted from 0
+    @param total_steps: steps of the whole run, the length of the cosine schedule */
+float train_config_learning_rate(const TrainConfig *config, int step, int total_steps)
+{
+    if (step < config->warmup_steps)
+    {
+        return config->learning_rate * (step + 1) / config->warmup_steps;
+    }
+    step -= config->warmup_steps;
+    total_steps -= config->warmup_steps;
+    switch (config->schedule)
+    {
+    case LR_STEP_DECAY:
+        return config->learning_rate * (float)pow(config->decay_rate, step / config->decay_steps);
+    case LR_COSINE:
+    {
+        double progress = (total_steps > 1) ? (double)step / (total_steps - 1) : 1.0;
+        double cosine = 0.5 * (1 + cos(TRAIN_CONFIG_PI * progress));
+        return config->min_learning_rate + (float)((config->learning_rate - config->min_learning_rate) * cosine);
+    }
+    default:
+        return config->learning_rate;
+    }
+}
+
+/* Shuffles an order of samples in place, Fisher-Yates with a linear congruential generator, so a seed gives the same
+    order on every target */
+void shuffle_samples(int *order, int n, uint32_t *state)
+{
+    for (int i = n - 1; i > 0; i--)
+    {
+        *state = *state * 1664525u + 1013904223u;
+        int j = (int)((uint64_t)(*state >> 8) * (i + 1) >> 24);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef TRAIN_CONFIG_H
+#define TRAIN_CONFIG_H
+#include "config.h"
+#include <stdint.h>
+
+enum LearningRateSchedule
+{
+    LR_CONSTANT,
+    LR_STEP_DECAY, // multiplied by decay_rate every decay_steps steps
+    LR_COSINE      // from learning_rate down to min_learning_rate over the steps of the run
+};
+
+/* Settings of a training run of fc_model_fit, read at runtime so they can be swept without rebuilding.
+    default_train_config gives the compile-time defaults of config.h. They drive full-network training only: layer and
+    partial training (partial_model_fc.h) step over BATCH_SIZE samples and take no TrainConfig. */
+typedef struct
+{
+    int batch_size;  // samples per step, the last step of an epoch takes the rest
+    int n_epochs;    // passes over the samples, at most
+    int max_steps;   // steps in total at most, 0 for no limit
+    float learning_rate;
+    enum LearningRateSchedule schedule;
+    int warmup_steps;        // steps the learning rate rises linearly over before the schedule starts, 0 for none
+    float decay_rate;        // LR_STEP_DECAY
+    int decay_steps;         // LR_STEP_DECAY
+    float min_learning_rate; // LR_COSINE
+    uint32_t shuffle_seed;   // order of the samples is shuffled every epoch with this seed, 0 keeps them in order
+    int patience;            // epochs without an improvement of the loss by min_delta before stopping, 0 never stops early
+    float min_delta;
+    float *validation_x;     // rows the loss for early stopping is measured on, NULL for the training samples
+    float *validation_y;
+    int n_validation;
+} TrainConfig;
+
+/* What a run of fc_model_fit did */
+typedef struct
+{
+    int epochs;      // epochs trained
+    int steps;       // training steps taken
+    float loss;      // mean squared error after the last epoch
+    float best_loss; // lowest loss after any epoch
+    int best_epoch;  // epoch of best_loss, counted from 1
+} FitStats;
+
+TrainConfig default_train_config(void);
+float train_config_learning_rate(const TrainConfig *config, int step, int total_steps);
+void shuffle_samples(int *order, int n, uint32_t *state);
+
+#endif
@@ -0,0 +1,11 @@
+#include <stdint.h>
+#include "model_q.h"
+
+{layer_weights}
+{layer_weight_scales}
+{layer_biases}
+
+int8_t* q_layers_weights[N_LAYERS] = {{layers_weights}};
+float* q_layers_weight_scales[N_LAYERS] = {{layers_weight_scales}};
+int32_t* q_layers_biases[N_LAYERS] = {{layers_biases}};
+float q_layers_input_scale[N_LAYERS] = {{layers_input_scale}};
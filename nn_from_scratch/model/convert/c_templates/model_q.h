@@ -0,0 +1,13 @@
+#ifndef MODEL_Q_H
+#define MODEL_Q_H
+
+#include <stdint.h>
+#include "model.h"
+
+// int8 weights with a scale per output, see QuantizedModel in hardware/util/quantized_model.h
+extern int8_t* q_layers_weights[N_LAYERS];          // shape: (n_layers)(output_size * input_size)
+extern float* q_layers_weight_scales[N_LAYERS];     // shape: (n_layers)(output_size)
+extern int32_t* q_layers_biases[N_LAYERS];          // shape: (n_layers)(output_size)
+extern float q_layers_input_scale[N_LAYERS];
+
+#endif
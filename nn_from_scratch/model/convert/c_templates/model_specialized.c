@@ -0,0 +1,7 @@
+#include "model_specialized.h"
+
+{extern_arrays}
+void model_specialized_predict(const float *input, float *output)
+{
+{predict_body}}
+{train_function}
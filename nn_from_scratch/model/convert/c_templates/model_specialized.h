@@ -0,0 +1,9 @@
+#ifndef MODEL_SPECIALIZED_H
+#define MODEL_SPECIALIZED_H
+
+// Functions specialized for one model, generated by model_converter.py --specialize.
+// They work on the weight and bias arrays of model.c, input-major like the generic runtime.
+
+void model_specialized_predict(const float *input, float *output);     // input: {input_size} floats, output: {output_size} floats
+{train_declaration}
+#endif
@@ -1,10 +1,42 @@
 import argparse
 import os
+import struct
 
 import numpy as np
 import tensorflow as tf
 
 
+SAMPLE_FILE_MAGIC = b"NNFD"
+SAMPLE_FILE_VERSION = 1
+SAMPLE_FILE_HEADER_BYTES = 32
+
+
+def convert_data_to_binary(data_x, data_y, save_path, chunk_size=65536):
+    """
+    Convert the data to the binary sample file format read by the streaming reader, see hardware/util/sample_stream.h.
+
+    Args:
+        data_x (np.ndarray): Input data, can be a np.memmap for datasets larger than memory.
+        data_y (np.ndarray): Output data.
+        save_path (str): Path of the sample file.
+        chunk_size (int): Number of samples converted at a time.
+    """
+    assert data_x.shape[0] == data_y.shape[0], "The number of samples in data_x and data_y should be equal"
+    assert data_x.ndim == 2, "data_x should be a 2D array"
+    assert data_y.ndim == 2, "data_y should be a 2D array"
+
+    header = struct.pack("<4s3IQ2I", SAMPLE_FILE_MAGIC, SAMPLE_FILE_VERSION, data_x.shape[1], data_y.shape[1],
+                         data_x.shape[0], SAMPLE_FILE_HEADER_BYTES, 0)
+
+    os.makedirs(os.path.dirname(save_path) or ".", exist_ok=True)
+    with open(save_path, "wb") as f:
+        f.write(header)
+        # each record is the input of a sample followed by its output
+        for start in range(0, data_x.shape[0], chunk_size):
+            records = np.hstack([data_x[start:start + chunk_size], data_y[start:start + chunk_size]])
+            f.write(np.ascontiguousarray(records, dtype="<f4").tobytes())
+
+
 def convert_data_to_c(data_x, data_y, templates_dir, save_dir, file_name="data", var_name="samples"):
     """
     Convert the data to C format and save it to the specified directory.
@@ -55,6 +87,7 @@ if __name__ == "__main__":
     parser.add_argument("--model_path", type=str, required=True, help="Path to the model")
     parser.add_argument("--templates_dir", type=str, default="nn_from_scratch/model/c_templates", help="Path to the directory with the templates")
     parser.add_argument("--save_dir", type=str, default="c_files", help="Path to the directory to save the converted model")
+    parser.add_argument("--format", type=str, choices=["c", "binary"], default="c", help="Emit C source files or a binary sample file (data.bin in save_dir)")
     args = parser.parse_args()
 
     model = tf.keras.models.load_model(args.model_path)
@@ -63,4 +96,7 @@ if __name__ == "__main__":
     random_data_x = np.random.rand(10, input_size).astype(np.float32)
     random_data_y = model.predict(random_data_x)
 
-    convert_data_to_c(random_data_x, random_data_y, args.templates_dir, args.save_dir)
+    if args.format == "binary":
+        convert_data_to_binary(random_data_x, random_data_y, os.path.join(args.save_dir, "data.bin"))
+    else:
+        convert_data_to_c(random_data_x, random_data_y, args.templates_dir, args.save_dir)
@@ -1,19 +1,30 @@
 import argparse
 import os
+import struct
 
 import numpy as np
 import tensorflow as tf
 
 
-def convert_model_to_c(model_path, templates_dir, save_dir, verbose=True):
+MODEL_FILE_MAGIC = b"NNFM"
+MODEL_FILE_VERSION = 1
+MODEL_FILE_HEADER_BYTES = 32
+MODEL_PARAMS_ALIGNMENT = 64     # must match MODEL_PARAMS_ALIGNMENT in hardware/util/model_binding.h
+ACTIVATION_TYPES = {"linear": 0, "relu": 1}     # enum ActivationType in hardware/util/activation_functions.h
+QUANT_MAX = 127     # must match QUANT_MAX in hardware/util/quantized_model.h
+SPARSE_MAX_DENSITY = 0.15   # must match SPARSE_MAX_DENSITY in hardware/util/model_binding.h
+
+
+def load_layers_info(model_path, verbose=True):
     """
-    Convert the model to C format and save it to the specified directory.
+    Load the model and collect the information of its layers.
 
     Args:
         model_path (str): Path to the model.
-        templates_dir (str): Path to the directory with the templates.
-        save_dir (str): Path to the directory to save the converted model.
         verbose (bool): Whether to print the summary of the model.
+
+    Returns:
+        tuple: The input size of the model and a list with the size, activation, weights and biases of each layer.
     """
     model = tf.keras.models.load_model(model_path)
     if verbose:
@@ -36,6 +47,68 @@ def convert_model_to_c(model_path, templates_dir, save_dir, verbose=True):
 
         layers_info.append(layer_info)
 
+    return input_size, layers_info
+
+
+def _align(n_bytes):
+    return (n_bytes + MODEL_PARAMS_ALIGNMENT - 1) // MODEL_PARAMS_ALIGNMENT * MODEL_PARAMS_ALIGNMENT
+
+
+def write_model_binary(input_size, layers_info, save_path):
+    """
+    Write the layers to a binary model file that the C code can memory-map, see hardware/util/model_file.h for the format.
+
+    Args:
+        input_size (int): Input size of the model.
+        layers_info (list): Layer information as returned by load_layers_info.
+        save_path (str): Path of the file to write.
+    """
+    # the flat parameter layout: weights then biases of each layer, every array starting on an aligned boundary
+    blob = bytearray()
+    for layer_info in layers_info:
+        for array in (layer_info["weights"], layer_info["biases"]):
+            data = np.ascontiguousarray(array, dtype="<f4").tobytes()
+            blob += data + bytes(_align(len(data)) - len(data))
+
+    table_end = MODEL_FILE_HEADER_BYTES + 8 * len(layers_info)
+    params_offset = _align(table_end)
+    header = struct.pack("<4s7I", MODEL_FILE_MAGIC, MODEL_FILE_VERSION, MODEL_PARAMS_ALIGNMENT, len(layers_info),
+                         input_size, layers_info[-1]["n"], params_offset, len(blob) // 4)
+    for layer_info in layers_info:
+        header += struct.pack("<2I", layer_info["n"], ACTIVATION_TYPES[layer_info["activation"]])
+    header += bytes(params_offset - table_end)
+
+    os.makedirs(os.path.dirname(save_path) or ".", exist_ok=True)
+    with open(save_path, "wb") as f:
+        f.write(header)
+        f.write(blob)
+
+
+def convert_model_to_binary(model_path, save_path, verbose=True):
+    """
+    Convert the model to the binary model file format and save it to the specified path.
+
+    Args:
+        model_path (str): Path to the model.
+        save_path (str): Path of the binary model file.
+        verbose (bool): Whether to print the summary of the model.
+    """
+    input_size, layers_info = load_layers_info(model_path, verbose)
+    write_model_binary(input_size, layers_info, save_path)
+
+
+def convert_model_to_c(model_path, templates_dir, save_dir, verbose=True):
+    """
+    Convert the model to C format and save it to the specified directory.
+
+    Args:
+        model_path (str): Path to the model.
+        templates_dir (str): Path to the directory with the templates.
+        save_dir (str): Path to the directory to save the converted model.
+        verbose (bool): Whether to print the summary of the model.
+    """
+    input_size, layers_info = load_layers_info(model_path, verbose)
+
     with open(os.path.join(templates_dir, "model.h"), "r") as f:
         model_h = f.read()
     with open(os.path.join(templates_dir, "model.c"), "r") as f:
@@ -84,11 +157,385 @@ def convert_model_to_c(model_path, templates_dir, save_dir, verbose=True):
         f.write(model_c)
 
 
+def prune_weights(weights, sparsity):
+    """
+    Magnitude pruning: set the smallest weights of a layer to zero.
+
+    Args:
+        weights (np.ndarray): Weights of the layer.
+        sparsity (float): Fraction of the weights to set to zero, between 0 and 1.
+
+    Returns:
+        np.ndarray: The pruned weights. Ties at the threshold are pruned together, so slightly more weights may be zero.
+    """
+    weights = np.array(weights, dtype=np.float32)
+    n_pruned = int(round(sparsity * weights.size))
+    if n_pruned > 0:
+        threshold = np.partition(np.abs(weights).flatten(), n_pruned - 1)[n_pruned - 1]
+        weights[np.abs(weights) <= threshold] = 0
+    return weights
+
+
+def prune_model(model_path, save_path, sparsity, verbose=True):
+    """
+    Prune every layer of the model by magnitude and save the pruned model, e.g. before converting it.
+    The C engine stores a layer sparse when at most SPARSE_MAX_DENSITY of its weights are nonzero, see sparsifyModel.
+    The pruned model should usually be fine-tuned to recover its accuracy.
+
+    Args:
+        model_path (str): Path to the model.
+        save_path (str): Path of the pruned model.
+        sparsity (float): Fraction of the weights of every layer to set to zero.
+        verbose (bool): Whether to print the density of every layer.
+    """
+    model = tf.keras.models.load_model(model_path)
+    for i, layer in enumerate(model.layers):
+        if not isinstance(layer, tf.keras.layers.Dense):
+            raise ValueError("Only Dense layers are supported")
+        weights, biases = layer.get_weights()
+        weights = prune_weights(weights, sparsity)
+        layer.set_weights([weights, biases])
+        if verbose:
+            density = np.count_nonzero(weights) / weights.size
+            print("Layer {}: {:.1%} of the weights nonzero, {}".format(i, density, "sparse" if density <= SPARSE_MAX_DENSITY else "dense"))
+
+    os.makedirs(os.path.dirname(save_path) or ".", exist_ok=True)
+    model.save(save_path)
+
+
+def _symmetric_scale(max_abs):
+    # float32 division like symmetricScale in the C code
+    max_abs = np.asarray(max_abs, dtype=np.float32)
+    return np.where(max_abs > 0, max_abs / np.float32(QUANT_MAX), np.float32(1.0)).astype(np.float32)
+
+
+def _round_half_away(values):
+    # rounds like the C code, numpy rounds halves to even
+    return np.sign(values) * np.floor(np.abs(values) + 0.5)
+
+
+def calibrate_quantization(input_size, layers_info, calibration_x):
+    """
+    Quantize the layers to int8 the way quantizeModel in hardware/util/quantized_model.c does.
+    The input of every layer gets one symmetric scale covering its range over the calibration samples,
+    found by running the float model on them, and the weights get one symmetric scale per output.
+
+    Args:
+        input_size (int): Input size of the model.
+        layers_info (list): Layer information as returned by load_layers_info.
+        calibration_x (np.ndarray): Calibration inputs, e.g. the equality check data, shape: (n_samples, input_size).
+
+    Returns:
+        list: The input scale, weights (output-major), weight scales and biases of each quantized layer.
+    """
+    activations = {"linear": lambda x: x, "relu": lambda x: np.maximum(x, 0)}
+    x = np.asarray(calibration_x, dtype=np.float32).reshape(-1, input_size)
+
+    quantized_layers = []
+    for layer_info in layers_info:
+        input_scale = float(_symmetric_scale(np.max(np.abs(x))))
+        weights = np.asarray(layer_info["weights"], dtype=np.float32)     # shape: (input_size, n)
+        weight_scales = _symmetric_scale(np.max(np.abs(weights), axis=0))
+        # multiplied by the float32 reciprocal of the scale like quantizeModel, dividing can round differently by one
+        inv_scales = (np.float32(1.0) / weight_scales).astype(np.float32)
+        q_weights = _round_half_away(weights * inv_scales).astype(np.int8)
+        q_biases = _round_half_away(np.asarray(layer_info["biases"], dtype=np.float64) / (np.float64(input_scale) * weight_scales))
+        q_biases = np.clip(q_biases, -2**31 + 1, 2**31 - 1).astype(np.int32)
+
+        quantized_layers.append({
+            "input_scale": input_scale,
+            "weights": np.ascontiguousarray(q_weights.T),     # shape: (n, input_size)
+            "weight_scales": weight_scales,
+            "biases": q_biases,
+        })
+        x = activations[layer_info["activation"]](x @ weights + layer_info["biases"])
+
+    return quantized_layers
+
+
+def convert_quantized_model_to_c(model_path, templates_dir, save_dir, calibration_x, verbose=True):
+    """
+    Quantize the model to int8 and save its arrays as model_q.h and model_q.c to the specified directory.
+    They extend model.h of the float model, which has to be converted to the same directory.
+
+    Args:
+        model_path (str): Path to the model.
+        templates_dir (str): Path to the directory with the templates.
+        save_dir (str): Path to the directory to save the converted model.
+        calibration_x (np.ndarray): Calibration inputs, shape: (n_samples, input_size).
+        verbose (bool): Whether to print the summary of the model.
+    """
+    input_size, layers_info = load_layers_info(model_path, verbose)
+    quantized_layers = calibrate_quantization(input_size, layers_info, calibration_x)
+
+    with open(os.path.join(templates_dir, "model_q.h"), "r") as f:
+        model_h = f.read()
+    with open(os.path.join(templates_dir, "model_q.c"), "r") as f:
+        model_c = f.read()
+
+    layer_weights = ""
+    layer_weight_scales = ""
+    layer_biases = ""
+    for i, layer in enumerate(quantized_layers):
+        layer_weights += "int8_t q_layer_{}_weights[]".format(i) + " = {" + ", ".join(map(str, layer["weights"].flatten())) + "};\n"
+        layer_weight_scales += "float q_layer_{}_weight_scales[]".format(i) + " = {" + ", ".join(map(repr, layer["weight_scales"].tolist())) + "};\n"
+        layer_biases += "int32_t q_layer_{}_biases[]".format(i) + " = {" + ", ".join(map(str, layer["biases"])) + "};\n"
+
+    n_layers = range(len(quantized_layers))
+    model_c = model_c.replace("{layer_weights}", layer_weights)
+    model_c = model_c.replace("{layer_weight_scales}", layer_weight_scales)
+    model_c = model_c.replace("{layer_biases}", layer_biases)
+    model_c = model_c.replace("{layers_weights}", ", ".join("q_layer_{}_weights".format(i) for i in n_layers))
+    model_c = model_c.replace("{layers_weight_scales}", ", ".join("q_layer_{}_weight_scales".format(i) for i in n_layers))
+    model_c = model_c.replace("{layers_biases}", ", ".join("q_layer_{}_biases".format(i) for i in n_layers))
+    model_c = model_c.replace("{layers_input_scale}", ", ".join(repr(layer["input_scale"]) for layer in quantized_layers))
+
+    os.makedirs(save_dir, exist_ok=True)
+    with open(os.path.join(save_dir, "model_q.h"), "w") as f:
+        f.write(model_h)
+    with open(os.path.join(save_dir, "model_q.c"), "w") as f:
+        f.write(model_c)
+
+
+# activation and its derivative as C expressions of {x}, same as hardware/util/activation_functions.c
+C_ACTIVATIONS = {
+    "linear": ("{x}", "1"),
+    "relu": ("({x} > 0 ? {x} : 0)", "({x} > 0 ? 1 : 0)"),
+}
+
+
+def _emit_layer_forward(i, n_in, n_out, source, target, unroll_limit):
+    """
+    C statements computing the net inputs of layer i into target from the activated inputs in source.
+    Small layers are unrolled into one expression per output, larger ones keep loops with constant bounds.
+    """
+    lines = []
+    if n_in * n_out <= unroll_limit:
+        for o in range(n_out):
+            terms = ["layer_{}_biases[{}]".format(i, o)]
+            terms += ["{}[{}] * layer_{}_weights[{}]".format(source, j, i, j * n_out + o) for j in range(n_in)]
+            lines.append("    {}[{}] = {};".format(target, o, " + ".join(terms)))
+    else:
+        lines.append("    for (int o = 0; o < {}; o++)".format(n_out))
+        lines.append("    {")
+        lines.append("        {}[o] = layer_{}_biases[o];".format(target, i))
+        lines.append("    }")
+        lines.append("    for (int j = 0; j < {}; j++)".format(n_in))
+        lines.append("    {")
+        lines.append("        const float x = {}[j];".format(source))
+        lines.append("        for (int o = 0; o < {}; o++)".format(n_out))
+        lines.append("        {")
+        lines.append("            {}[o] += x * layer_{}_weights[j * {} + o];".format(target, i, n_out))
+        lines.append("        }")
+        lines.append("    }")
+    return lines
+
+
+def _emit_activation(activation, source, target, n, unroll_limit):
+    """C statements storing the activation of n values of source in target, nothing for a linear activation in place"""
+    if activation == "linear" and source == target:
+        return []
+    expression = C_ACTIVATIONS[activation][0]
+    if n <= unroll_limit:
+        return ["    {}[{}] = {};".format(target, o, expression.format(x="{}[{}]".format(source, o))) for o in range(n)]
+    return ["    for (int o = 0; o < {}; o++)".format(n),
+            "    {",
+            "        {}[o] = {};".format(target, expression.format(x="{}[o]".format(source))),
+            "    }"]
+
+
+def _emit_predict(input_size, layers_info, unroll_limit):
+    lines = []
+    source = "input"
+    n_in = input_size
+    for i, layer_info in enumerate(layers_info):
+        n_out = layer_info["n"]
+        target = "output" if i == len(layers_info) - 1 else "layer_{}".format(i)
+        if target != "output":
+            lines.append("    float {}[{}];".format(target, n_out))
+        lines += _emit_layer_forward(i, n_in, n_out, source, target, unroll_limit)
+        lines += _emit_activation(layer_info["activation"], target, target, n_out, unroll_limit)
+        source = target
+        n_in = n_out
+    return "\n".join(lines) + "\n"
+
+
+def _emit_train(input_size, layers_info, unroll_limit):
+    """
+    A training step matching fc_model_train of the generic runtime: the gradients of every sample are accumulated,
+    with the loss derivative of MSE_derivative in hardware/util/loss_functions.c, then applied with
+    learning_rate * gradient / n_samples.
+    """
+    n_layers = len(layers_info)
+    sizes = [input_size] + [layer_info["n"] for layer_info in layers_info]
+    lines = ["void model_specialized_train(const float *samples_x, const float *samples_y, int n_samples, float learning_rate)", "{"]
+    for i in range(n_layers):
+        lines.append("    static float gradient_{0}_weights[{1}];".format(i, sizes[i] * sizes[i + 1]))
+        lines.append("    static float gradient_{0}_biases[{1}];".format(i, sizes[i + 1]))
+    for i in range(n_layers):
+        for name, n in (("weights", sizes[i] * sizes[i + 1]), ("biases", sizes[i + 1])):
+            lines.append("    for (int k = 0; k < {}; k++)".format(n))
+            lines.append("    {")
+            lines.append("        gradient_{}_{}[k] = 0;".format(i, name))
+            lines.append("    }")
+    lines.append("")
+    lines.append("    for (int s = 0; s < n_samples; s++)")
+    lines.append("    {")
+    body = []
+    body.append("    const float *input = samples_x + s * {};".format(input_size))
+    body.append("    const float *target = samples_y + s * {};".format(sizes[-1]))
+    # forward, keeping the net inputs and the activated outputs of every layer
+    source = "input"
+    for i, layer_info in enumerate(layers_info):
+        body.append("    float net_{0}[{1}], out_{0}[{1}];".format(i, sizes[i + 1]))
+        body += _emit_layer_forward(i, sizes[i], sizes[i + 1], source, "net_{}".format(i), unroll_limit)
+        body += _emit_activation(layer_info["activation"], "net_{}".format(i), "out_{}".format(i), sizes[i + 1], unroll_limit)
+        source = "out_{}".format(i)
+    # loss derivative, then the gradients of the output layer's net inputs, kept in net_<i> from here on
+    last = n_layers - 1
+    deriv = C_ACTIVATIONS[layers_info[last]["activation"]][1]
+    body.append("    float loss_deriv = 0;")
+    body.append("    for (int k = 0; k < {}; k++)".format(sizes[-1]))
+    body.append("    {")
+    body.append("        float error = out_{0}[k] - target[k];".format(last))
+    body.append("        loss_deriv += 2 * (error < 0 ? -error : error);")
+    body.append("    }")
+    body.append("    loss_deriv /= {};".format(sizes[-1]))
+    body.append("    for (int k = 0; k < {}; k++)".format(sizes[-1]))
+    body.append("    {")
+    body.append("        net_{0}[k] = loss_deriv * {1};".format(last, deriv.format(x="out_{}[k]".format(last))))
+    body.append("    }")
+    # backward, layer by layer
+    for i in range(last, -1, -1):
+        n_in, n_out = sizes[i], sizes[i + 1]
+        inputs = "input" if i == 0 else "out_{}".format(i - 1)
+        body.append("    for (int k = 0; k < {}; k++)".format(n_out))
+        body.append("    {")
+        body.append("        gradient_{0}_biases[k] += net_{0}[k];".format(i))
+        body.append("    }")
+        body.append("    for (int j = 0; j < {}; j++)".format(n_in))
+        body.append("    {")
+        if i > 0:
+            body.append("        float sum = 0;")
+        body.append("        for (int k = 0; k < {}; k++)".format(n_out))
+        body.append("        {")
+        body.append("            gradient_{0}_weights[j * {1} + k] += {2}[j] * net_{0}[k];".format(i, n_out, inputs))
+        if i > 0:
+            body.append("            sum += layer_{0}_weights[j * {1} + k] * net_{0}[k];".format(i, n_out))
+        body.append("        }")
+        if i > 0:
+            prev_deriv = C_ACTIVATIONS[layers_info[i - 1]["activation"]][1]
+            body.append("        net_{0}[j] = sum * {1};".format(i - 1, prev_deriv.format(x="net_{}[j]".format(i - 1))))
+        body.append("    }")
+    lines += ["    " + line if line else line for line in body]
+    lines.append("    }")
+    lines.append("")
+    for i in range(n_layers):
+        for name, n in (("weights", sizes[i] * sizes[i + 1]), ("biases", sizes[i + 1])):
+            lines.append("    for (int k = 0; k < {}; k++)".format(n))
+            lines.append("    {")
+            lines.append("        layer_{0}_{1}[k] -= learning_rate * (gradient_{0}_{1}[k] / n_samples);".format(i, name))
+            lines.append("    }")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def generate_specialized_c(input_size, layers_info, templates_dir, save_dir, train=False, unroll_limit=64):
+    """
+    Generate a predict function, and optionally a training step, specialized for the model: loop bounds are
+    compile-time constants, layers with at most unroll_limit weights are unrolled, activations are inlined and
+    every buffer is statically sized. The functions use the arrays of the model.c emitted by convert_model_to_c.
+
+    Args:
+        input_size (int): Input size of the model.
+        layers_info (list): Layer information as returned by load_layers_info.
+        templates_dir (str): Path to the directory with the templates.
+        save_dir (str): Path to the directory to save model_specialized.h and model_specialized.c.
+        train (bool): Whether to also emit model_specialized_train.
+        unroll_limit (int): Largest number of weights of a layer that is unrolled.
+    """
+    with open(os.path.join(templates_dir, "model_specialized.h"), "r") as f:
+        model_h = f.read()
+    with open(os.path.join(templates_dir, "model_specialized.c"), "r") as f:
+        model_c = f.read()
+
+    extern_arrays = ""
+    n_in = input_size
+    for i, layer_info in enumerate(layers_info):
+        extern_arrays += "extern float layer_{}_weights[{}];\n".format(i, n_in * layer_info["n"])
+        extern_arrays += "extern float layer_{}_biases[{}];\n".format(i, layer_info["n"])
+        n_in = layer_info["n"]
+
+    train_declaration = ""
+    train_function = ""
+    if train:
+        train_declaration = ("#define MODEL_SPECIALIZED_TRAIN\n"
+                             "void model_specialized_train(const float *samples_x, const float *samples_y, int n_samples, "
+                             "float learning_rate);     // samples row-major\n")
+        train_function = "\n" + _emit_train(input_size, layers_info, unroll_limit)
+
+    model_h = model_h.replace("{input_size}", str(input_size))
+    model_h = model_h.replace("{output_size}", str(layers_info[-1]["n"]))
+    model_h = model_h.replace("{train_declaration}", train_declaration)
+    model_c = model_c.replace("{extern_arrays}", extern_arrays)
+    model_c = model_c.replace("{predict_body}", _emit_predict(input_size, layers_info, unroll_limit))
+    model_c = model_c.replace("{train_function}", train_function)
+
+    os.makedirs(save_dir, exist_ok=True)
+    with open(os.path.join(save_dir, "model_specialized.h"), "w") as f:
+        f.write(model_h)
+    with open(os.path.join(save_dir, "model_specialized.c"), "w") as f:
+        f.write(model_c)
+
+
+def convert_model_to_specialized_c(model_path, templates_dir, save_dir, train=False, unroll_limit=64, verbose=True):
+    """
+    Convert the model to C functions specialized for its shape and save them to the specified directory,
+    see generate_specialized_c.
+
+    Args:
+        model_path (str): Path to the model.
+        templates_dir (str): Path to the directory with the templates.
+        save_dir (str): Path to the directory to save the converted model.
+        train (bool): Whether to also emit a training step.
+        unroll_limit (int): Largest number of weights of a layer that is unrolled.
+        verbose (bool): Whether to print the summary of the model.
+    """
+    input_size, layers_info = load_layers_info(model_path, verbose)
+    generate_specialized_c(input_size, layers_info, templates_dir, save_dir, train, unroll_limit)
+
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser()
     parser.add_argument("--model_path", type=str, required=True, help="Path to the model")
     parser.add_argument("--templates_dir", type=str, default="nn_from_scratch/model/c_templates", help="Path to the directory with the templates")
     parser.add_argument("--save_dir", type=str, default="c_files", help="Path to the directory to save the converted model")
+    parser.add_argument("--format", type=str, choices=["c", "binary"], default="c", help="Emit C source files or a binary model file (model.bin in save_dir)")
+    parser.add_argument("--prune", type=float, default=None, help="Set this fraction of the smallest weights of every layer to zero before converting, the pruned model is saved as model_pruned.keras in save_dir")
+    parser.add_argument("--quantize", action="store_true", help="Also emit the int8 quantized model (model_q.h and model_q.c in save_dir)")
+    parser.add_argument("--calibration_data", type=str, default=None, help="Path to a .npy file with the calibration inputs for --quantize, e.g. the equality check data")
+    parser.add_argument("--specialize", action="store_true", help="Also emit a predict function specialized for the model (model_specialized.h and model_specialized.c in save_dir)")
+    parser.add_argument("--specialize_train", action="store_true", help="Add a specialized training step to --specialize")
+    parser.add_argument("--unroll_limit", type=int, default=64, help="Layers with at most this many weights are fully unrolled by --specialize")
     args = parser.parse_args()
 
-    convert_model_to_c(args.model_path, args.templates_dir, args.save_dir)
+    if args.quantize and (args.format != "c" or args.calibration_data is None):
+        parser.error("--quantize needs --format c and --calibration_data")
+    if (args.specialize or args.specialize_train) and args.format != "c":
+        parser.error("--specialize needs --format c")
+
+    if args.prune is not None:
+        if not 0 <= args.prune < 1:
+            parser.error("--prune needs a fraction between 0 and 1")
+        pruned_path = os.path.join(args.save_dir, "model_pruned.keras")
+        prune_model(args.model_path, pruned_path, args.prune)
+        args.model_path = pruned_path
+
+    if args.format == "binary":
+        convert_model_to_binary(args.model_path, os.path.join(args.save_dir, "model.bin"))
+    else:
+        convert_model_to_c(args.model_path, args.templates_dir, args.save_dir)
+        if args.quantize:
+            convert_quantized_model_to_c(args.model_path, args.templates_dir, args.save_dir, np.load(args.calibration_data), verbose=False)
+        if args.specialize or args.specialize_train:
+            convert_model_to_specialized_c(args.model_path, args.templates_dir, args.save_dir, args.specialize_train, args.unroll_limit, verbose=False)
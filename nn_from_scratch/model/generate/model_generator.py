@@ -11,7 +11,7 @@ import yaml
 from omegaconf import OmegaConf
 
 from nn_from_scratch.model.convert.data_converter import convert_data_to_c
-from nn_from_scratch.model.convert.model_converter import convert_model_to_c
+from nn_from_scratch.model.convert.model_converter import convert_model_to_c, convert_quantized_model_to_c, convert_model_to_specialized_c
 from nn_from_scratch.model.generate.model import create_model, train_model, get_params_count, get_FLOPs, save_model, save_weights, log_model_to_wandb, measure_execution_time
 from nn_from_scratch.model.generate.utils import get_abs_path
 
@@ -177,6 +177,17 @@ def generate_models(cfg):
         convert_data_to_c(eq_data_x, eq_data_y, cfg.c_templates_dir, cfg.c_save_dir, file_name="eqcheck_data", var_name="eqcheck_samples")
         print("Done\n")
 
+        # the equality check data doubles as calibration data, so the quantized eqcheck runs on the samples it was calibrated on
+        if cfg.quantize_models:
+            print("Converting the quantized model to C ...", end=" ", flush=True)
+            convert_quantized_model_to_c(os.path.join(cfg.model_save_dir, "tf/model/keras_format/model.keras"), cfg.c_templates_dir, cfg.c_save_dir, eq_data_x, verbose=False)
+            print("Done\n")
+
+        if cfg.specialize_models:
+            print("Converting the specialized model to C ...", end=" ", flush=True)
+            convert_model_to_specialized_c(os.path.join(cfg.model_save_dir, "tf/model/keras_format/model.keras"), cfg.c_templates_dir, cfg.c_save_dir, train=True, verbose=False)
+            print("Done\n")
+
         print("Converting the fine-tuning data to C ...", end=" ", flush=True)
         ft_data_x = ft_dataset.train_x[:cfg.n_ft_data]
         ft_data_y = ft_dataset.train_y[:cfg.n_ft_data]